@@ -0,0 +1,68 @@
+#!/bin/sh
+# End-to-end benchmarks of iniget (run with "make bench").
+#
+# Usage: bench.sh [INIGET] [GEN]
+#
+# Environment:
+#   BENCH_SIZE    size of the generated INI file (default 16M)
+#   BENCH_KEYS    keys per section (default 50)
+#   BENCH_QUERIES number of queries in the "many queries" scenario (default 2000)
+#   BENCH_REPEAT  runs per scenario, the median is reported (default 3)
+
+set -e -f
+
+INIGET=${1:-./iniget}
+GEN=${2:-bench/gen}
+SIZE=${BENCH_SIZE:-16M}
+KEYS=${BENCH_KEYS:-50}
+NQUERIES=${BENCH_QUERIES:-2000}
+REPEAT=${BENCH_REPEAT:-3}
+
+DIR=$(mktemp -d)
+trap 'rm -rf -- "$DIR"' EXIT INT TERM
+
+# Generate the input
+"$GEN" ini -s "$SIZE" -k "$KEYS" > "$DIR/bench.ini"
+BYTES=$(wc -c < "$DIR/bench.ini")
+SECTIONS=$(grep -c '^\[' "$DIR/bench.ini")
+
+queries() {
+    "$GEN" queries -S "$SECTIONS" -k "$KEYS" "$@"
+}
+
+# Prints a result line: scenario name, median time, file MB/s, queries/s
+report() {
+    awk -v name="$1" -v t="$2" -v bytes="$BYTES" -v n="$3" 'BEGIN {
+        if (t <= 0) t = 1e-9
+        printf "%-22s %10.4f s %12.1f MB/s %14.0f queries/s\n", name, t, bytes / 1048576 / t, n / t
+    }'
+}
+
+# Usage: run NAME QUERY_FILE [-i INPUT] FILE_ARG
+run() {
+    name=$1
+    qfile=$2
+    shift 2
+    n=$(wc -l < "$qfile")
+    if [ "$1" = -i ]; then
+        t=$("$GEN" time -n "$REPEAT" -i "$2" -- "$INIGET" "$3" $(cat "$qfile"))
+    else
+        t=$("$GEN" time -n "$REPEAT" -- "$INIGET" "$1" $(cat "$qfile"))
+    fi
+    report "$name" "$t" "$n"
+}
+
+queries -n 1 -w first          > "$DIR/early"
+queries -n 1 -w last           > "$DIR/late"
+queries -n 1 -w missing        > "$DIR/missing"
+queries -n "$NQUERIES" -o 50   > "$DIR/many"
+queries -n 16 -e 4             > "$DIR/expr"
+
+echo "iniget benchmarks: $BYTES bytes, $SECTIONS sections, $KEYS keys per section, median of $REPEAT runs"
+run "early hit"            "$DIR/early"   "$DIR/bench.ini"
+run "late hit"             "$DIR/late"    "$DIR/bench.ini"
+run "missing key"          "$DIR/missing" "$DIR/bench.ini"
+run "$NQUERIES queries"    "$DIR/many"    "$DIR/bench.ini"
+run "expressions"          "$DIR/expr"    "$DIR/bench.ini"
+run "late hit (stdin)"     "$DIR/late"    -i "$DIR/bench.ini" -
+run "late hit (file)"      "$DIR/late"    "$DIR/bench.ini"
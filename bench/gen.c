@@ -0,0 +1,340 @@
+/* Synthetic workload generator and timer for iniget benchmarks.
+ *
+ * Usage:
+ *   gen ini [-s SIZE] [-S SECTIONS] [-k KEYS] [-t num|str|mix] [-l LEN] [-r SEED]
+ *   gen queries [-n COUNT] [-S SECTIONS] [-k KEYS] [-t num|str|mix]
+ *               [-w first|last|random|missing] [-o OVERLAP] [-e OPERANDS] [-r SEED]
+ *   gen time [-n REPEAT] [-i INPUT] [-a] -- COMMAND [ARG]...
+ *
+ * "ini" prints an INI file with SECTIONS sections of KEYS keys each
+ * (or as many sections as needed to reach SIZE bytes, if given).
+ * Sections are named "sN" and keys "kN". With -t mix, even keys hold
+ * numbers and odd keys hold strings of LEN characters.
+ *
+ * "queries" prints one query per line for a file generated with the
+ * same -S, -k and -t. Each query has OPERANDS operands of one type,
+ * located according to -w. OVERLAP percent of the queries reference
+ * the same 8 values, the rest reference distinct ones (as far as
+ * the file allows).
+ *
+ * "time" runs a command REPEAT times, with stdin taken from INPUT
+ * and all output discarded, and prints the median wall time in seconds
+ * (or, with -a, the wall time of every run in ascending order).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* Value types of keys */
+enum { TYPE_NUM, TYPE_STR, TYPE_MIX };
+
+/* Query locations */
+enum { WHERE_FIRST, WHERE_LAST, WHERE_RANDOM, WHERE_MISSING };
+
+/* The number of values referenced by overlapping queries */
+#define HOT_SET 8
+
+static unsigned long seed = 1;
+
+static int genIni(int argc, char **argv);
+static int genQueries(int argc, char **argv);
+static int timeCommand(int argc, char **argv);
+static unsigned long rnd(void);
+static int keyType(int type, unsigned long key);
+static int parseType(const char *str);
+static unsigned long parseSize(const char *str);
+static int cmpDouble(const void *a, const void *b);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+
+    if (strcmp(argv[1], "ini") == 0) {
+        return genIni(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "queries") == 0) {
+        return genQueries(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "time") == 0) {
+        return timeCommand(argc - 1, argv + 1);
+    }
+
+    usage();
+    return 1;
+}
+
+static int genIni(int argc, char **argv)
+{
+    unsigned long size, sections, keys, len, written, s, k;
+    int type, opt;
+
+    size = 0;
+    sections = 100;
+    keys = 50;
+    len = 16;
+    type = TYPE_MIX;
+    while ((opt = getopt(argc, argv, "s:S:k:t:l:r:")) != -1) {
+        switch (opt) {
+            case 's': size = parseSize(optarg); break;
+            case 'S': sections = strtoul(optarg, NULL, 10); break;
+            case 'k': keys = strtoul(optarg, NULL, 10); break;
+            case 't': type = parseType(optarg); break;
+            case 'l': len = strtoul(optarg, NULL, 10); break;
+            case 'r': seed = strtoul(optarg, NULL, 10); break;
+            default: usage(); return 1;
+        }
+    }
+    if (type < 0 || len == 0) {
+        usage();
+        return 1;
+    }
+
+    written = 0;
+    for (s = 0; size? written < size : s < sections; s++) {
+        written += printf("[s%lu]\n", s);
+        for (k = 0; k < keys; k++) {
+            if (keyType(type, k) == TYPE_NUM) {
+                written += printf("k%lu = %lu.%02lu\n", k, rnd() % 100000, rnd() % 100);
+            } else {
+                unsigned long i;
+                written += printf("k%lu = ", k);
+                for (i = 0; i < len; i++) {
+                    putchar('a' + rnd() % 26);
+                }
+                putchar('\n');
+                written += len + 1;
+            }
+        }
+    }
+
+    return ferror(stdout)? 1 : 0;
+}
+
+static int genQueries(int argc, char **argv)
+{
+    unsigned long count, sections, keys, operands, overlap, q, o;
+    int type, where, opt;
+
+    count = 100;
+    sections = 100;
+    keys = 50;
+    operands = 1;
+    overlap = 0;
+    type = TYPE_MIX;
+    where = WHERE_RANDOM;
+    while ((opt = getopt(argc, argv, "n:S:k:t:w:o:e:r:")) != -1) {
+        switch (opt) {
+            case 'n': count = strtoul(optarg, NULL, 10); break;
+            case 'S': sections = strtoul(optarg, NULL, 10); break;
+            case 'k': keys = strtoul(optarg, NULL, 10); break;
+            case 't': type = parseType(optarg); break;
+            case 'o': overlap = strtoul(optarg, NULL, 10); break;
+            case 'e': operands = strtoul(optarg, NULL, 10); break;
+            case 'r': seed = strtoul(optarg, NULL, 10); break;
+            case 'w':
+                if (strcmp(optarg, "first") == 0) {
+                    where = WHERE_FIRST;
+                } else if (strcmp(optarg, "last") == 0) {
+                    where = WHERE_LAST;
+                } else if (strcmp(optarg, "random") == 0) {
+                    where = WHERE_RANDOM;
+                } else if (strcmp(optarg, "missing") == 0) {
+                    where = WHERE_MISSING;
+                } else {
+                    usage();
+                    return 1;
+                }
+                break;
+            default: usage(); return 1;
+        }
+    }
+    if (type < 0 || sections == 0 || keys < 2 || operands == 0 || overlap > 100) {
+        usage();
+        return 1;
+    }
+
+    for (q = 0; q < count; q++) {
+        /* Every operand of a query is a distinct value of the same type */
+        unsigned long n = (rnd() % 100 < overlap)? rnd() % HOT_SET : HOT_SET + q;
+        int qtype = -1;
+
+        for (o = 0; o < operands; o++, n += count + HOT_SET) {
+            unsigned long s, k;
+
+            switch (where) {
+                case WHERE_FIRST:
+                    s = 0;
+                    k = n % keys;
+                    break;
+                case WHERE_LAST:
+                    s = sections - 1;
+                    k = keys - 1 - n % keys;
+                    break;
+                case WHERE_MISSING:
+                    s = n % sections;
+                    k = keys + n;
+                    break;
+                default:
+                    s = (n * 2654435761UL) % sections;
+                    k = n % keys;
+                    break;
+            }
+
+            /* Keep the type of the first operand */
+            if (qtype < 0) {
+                qtype = keyType(type, k);
+            } else if (keyType(type, k) != qtype) {
+                k = (k + 1) % keys;
+            }
+
+            printf("%s{s%lu.k%lu}", o? "+" : "", s, k);
+        }
+        putchar('\n');
+    }
+
+    return ferror(stdout)? 1 : 0;
+}
+
+static int timeCommand(int argc, char **argv)
+{
+    unsigned long repeat, r;
+    const char *input;
+    double *times;
+    int opt, all;
+
+    repeat = 5;
+    input = NULL;
+    all = 0;
+    while ((opt = getopt(argc, argv, "n:i:a")) != -1) {
+        switch (opt) {
+            case 'n': repeat = strtoul(optarg, NULL, 10); break;
+            case 'i': input = optarg; break;
+            case 'a': all = 1; break;
+            default: usage(); return 1;
+        }
+    }
+    if (optind >= argc || repeat == 0) {
+        usage();
+        return 1;
+    }
+    if (!(times = malloc(repeat * sizeof *times))) {
+        fprintf(stderr, "gen: memory error\n");
+        return 1;
+    }
+
+    for (r = 0; r < repeat; r++) {
+        struct timespec beg, end;
+        pid_t pid;
+        int status;
+
+        clock_gettime(CLOCK_MONOTONIC, &beg);
+        if ((pid = fork()) < 0) {
+            perror("gen: fork");
+            free(times);
+            return 1;
+        }
+        if (pid == 0) {
+            int in  = open(input? input : "/dev/null", O_RDONLY);
+            int out = open("/dev/null", O_WRONLY);
+            if (in < 0 || out < 0) {
+                perror("gen: open");
+                _exit(127);
+            }
+            dup2(in, 0);
+            dup2(out, 1);
+            dup2(out, 2);
+            execvp(argv[optind], argv + optind);
+            _exit(127);
+        }
+        if (waitpid(pid, &status, 0) < 0) {
+            perror("gen: waitpid");
+            free(times);
+            return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+            fprintf(stderr, "gen: '%s' failed to run\n", argv[optind]);
+            free(times);
+            return 1;
+        }
+        times[r] = (end.tv_sec - beg.tv_sec) + (end.tv_nsec - beg.tv_nsec) / 1e9;
+    }
+
+    qsort(times, repeat, sizeof *times, cmpDouble);
+    if (all) {
+        for (r = 0; r < repeat; r++) {
+            printf("%.6f\n", times[r]);
+        }
+    } else {
+        printf("%.6f\n", times[repeat / 2]);
+    }
+    free(times);
+
+    return 0;
+}
+
+/* A small LCG, so that generated files are identical everywhere */
+static unsigned long rnd(void)
+{
+    seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return seed >> 8;
+}
+
+static int keyType(int type, unsigned long key)
+{
+    if (type == TYPE_MIX) {
+        return (key % 2)? TYPE_STR : TYPE_NUM;
+    }
+    return type;
+}
+
+static int parseType(const char *str)
+{
+    if (strcmp(str, "num") == 0) {
+        return TYPE_NUM;
+    } else if (strcmp(str, "str") == 0) {
+        return TYPE_STR;
+    } else if (strcmp(str, "mix") == 0) {
+        return TYPE_MIX;
+    }
+    return -1;
+}
+
+/* Parses a size with an optional K, M or G suffix */
+static unsigned long parseSize(const char *str)
+{
+    char *end;
+    unsigned long size = strtoul(str, &end, 10);
+
+    switch (*end) {
+        case 'K': case 'k': return size << 10;
+        case 'M': case 'm': return size << 20;
+        case 'G': case 'g': return size << 30;
+        default: return size;
+    }
+}
+
+static int cmpDouble(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void usage(void)
+{
+    fputs("usage: gen ini [-s SIZE] [-S SECTIONS] [-k KEYS] [-t num|str|mix] [-l LEN] [-r SEED]\n"
+          "       gen queries [-n COUNT] [-S SECTIONS] [-k KEYS] [-t num|str|mix]\n"
+          "                   [-w first|last|random|missing] [-o OVERLAP] [-e OPERANDS] [-r SEED]\n"
+          "       gen time [-n REPEAT] [-i INPUT] [-a] -- COMMAND [ARG]...\n", stderr);
+}
@@ -0,0 +1,347 @@
+/* Component microbenchmarks for iniget.
+ *
+ * Usage: micro [NAME]...
+ *
+ * Every benchmark drives a single hot function in a tight loop with
+ * realistic inputs, and reports the time and the number of heap
+ * allocations per operation. Without arguments, all benchmarks run.
+ *
+ * Allocations are counted by wrapping malloc, calloc and realloc at
+ * link time (-Wl,--wrap=...), so only calls made by iniget code are
+ * counted, and the binary must be linked with a GNU-compatible linker.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "query.h"
+#include "dataset.h"
+#include "arglist.h"
+#include "stack.h"
+#include "alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/* The minimum duration of a measured run, in seconds */
+#define MIN_TIME 0.2
+
+/* The number of distinct pairs inserted into each dataset */
+#define DATASET_SCALE 1000
+
+/* The number of operands of each evaluated query */
+#define EVAL_DEPTH 64
+
+/* The number of queries printed by a single printQueries call */
+#define PRINT_QUERIES 16
+
+typedef struct {
+    const char *name;
+    const char *desc;
+    int  (*setup)(void);
+    void (*run)(unsigned long n);
+    void (*teardown)(void);
+} Bench;
+
+static unsigned long allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t n, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+static int  setupNone(void);
+static void teardownNone(void);
+static void runLine(unsigned long n);
+static void runValue(unsigned long n);
+static int  setupDataset(void);
+static void runDataset(unsigned long n);
+static void teardownDataset(void);
+static int  setupEval(void);
+static void runEval(unsigned long n);
+static void runPrint(unsigned long n);
+static void teardownEval(void);
+static double now(void);
+
+static const Bench benches[] = {
+    { "line",    "iniExtractFromLine, per line",         setupNone,    runLine,    teardownNone    },
+    { "value",   "argValGetFromString, per value",       setupNone,    runValue,   teardownNone    },
+    { "dataset", "datasetAdd, per insert (1000/set)",    setupDataset, runDataset, teardownDataset },
+    { "eval",    "evalQuery, per query (64 operands)",   setupEval,    runEval,    teardownEval    },
+    { "print",   "printQueries, per query (64 operands)", setupEval,   runPrint,   teardownEval    }
+};
+
+/* Realistic lines of an INI file */
+static const char *const lines[] = {
+    "[database-primary]",
+    "host = db1.internal.example.com",
+    "port = 5432",
+    "max_connections = 250",
+    "timeout = 12.5",
+    "name = \"production database\"",
+    "; a comment line",
+    "",
+    "  user = admin  ",
+    "ratio = -0.75"
+};
+
+/* Realistic values of keys */
+static const char *const values[] = {
+    "5432",
+    "12.5",
+    "-0.75",
+    "db1.internal.example.com",
+    "\"production database\"",
+    "  250  ",
+    "1.2.3.4",
+    "true"
+};
+
+static char **names;   /* section and key names for the dataset benchmark */
+static Query **queries;
+static ValStack *vstack;
+
+int main(int argc, char **argv)
+{
+    size_t i;
+    int j;
+
+    printf("%-10s %-40s %12s %12s\n", "benchmark", "operation", "ns/op", "allocs/op");
+
+    for (i = 0; i < sizeof benches / sizeof *benches; i++) {
+        const Bench *const b = benches + i; /* shortcut */
+        unsigned long n;
+        double t;
+
+        /* Only run the selected benchmarks */
+        for (j = 1; j < argc && strcmp(argv[j], b->name) != 0; j++)
+            ;
+        if (argc > 1 && j == argc) {
+            continue;
+        }
+
+        if (b->setup()) {
+            fprintf(stderr, "micro: %s: setup failed\n", b->name);
+            return 1;
+        }
+
+        /* Double the number of operations until the run is long enough */
+        n = 1;
+        do {
+            n *= 2;
+            allocs = 0;
+            t = now();
+            b->run(n);
+            t = now() - t;
+        } while (t < MIN_TIME);
+
+        printf("%-10s %-40s %12.1f %12.2f\n", b->name, b->desc, t * 1e9 / n, (double)allocs / n);
+        fflush(stdout);
+
+        b->teardown();
+    }
+
+    return 0;
+}
+
+void *__wrap_malloc(size_t size)
+{
+    allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    allocs++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    allocs++;
+    return __real_realloc(ptr, size);
+}
+
+static int setupNone(void)
+{
+    return 0;
+}
+
+static void teardownNone(void)
+{
+}
+
+static void runLine(unsigned long n)
+{
+    unsigned long i;
+
+    for (i = 0; i < n; i++) {
+        IniToken tok = iniExtractFromLine(lines[i % (sizeof lines / sizeof *lines)]);
+
+        if (tok.type == INI_LINE_SECTION) {
+            xfree(tok.content.section);
+        } else if (tok.type == INI_LINE_KVPAIR) {
+            xfree(tok.content.kvpair.key);
+            if (tok.content.kvpair.value.type == ARGVAL_TYPE_STRING) {
+                xfree(tok.content.kvpair.value.value.s);
+            }
+        }
+    }
+}
+
+static void runValue(unsigned long n)
+{
+    unsigned long i;
+
+    for (i = 0; i < n; i++) {
+        ArgVal val = argValGetFromString(values[i % (sizeof values / sizeof *values)]);
+
+        if (val.type == ARGVAL_TYPE_STRING) {
+            xfree(val.value.s);
+        }
+    }
+}
+
+static int setupDataset(void)
+{
+    size_t i;
+
+    if (!(names = malloc(2 * DATASET_SCALE * sizeof *names))) {
+        return 1;
+    }
+    for (i = 0; i < DATASET_SCALE; i++) {
+        names[2 * i] = malloc(32);
+        names[2 * i + 1] = malloc(32);
+        if (!names[2 * i] || !names[2 * i + 1]) {
+            return 1;
+        }
+        sprintf(names[2 * i], "section-%lu", (unsigned long)i / 16);
+        sprintf(names[2 * i + 1], "key_%lu", (unsigned long)i % 16);
+    }
+
+    return 0;
+}
+
+static void runDataset(unsigned long n)
+{
+    unsigned long i;
+
+    while (n) {
+        DataSet *set = datasetCreate();
+
+        /* Every fourth insert is a duplicate, like in real queries */
+        for (i = 0; i < DATASET_SCALE && n; i++, n--) {
+            size_t k = (i % 4 == 3)? i / 2 : i;
+            datasetAdd(set, names[2 * k], names[2 * k + 1]);
+        }
+        datasetFree(set);
+    }
+}
+
+static void teardownDataset(void)
+{
+    size_t i;
+
+    for (i = 0; i < 2 * DATASET_SCALE; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+static int setupEval(void)
+{
+    char *str, *pos;
+    size_t i, j;
+
+    if (!(vstack = valstackCreate())
+            || !(queries = calloc(PRINT_QUERIES, sizeof *queries))
+            || !(str = malloc(EVAL_DEPTH * 32))) {
+        return 1;
+    }
+
+    /* A deeply nested expression, like ((({s0.k}+{s1.k})*{s2.k})-{s3.k})... */
+    pos = str;
+    for (i = 1; i < EVAL_DEPTH; i++) {
+        *pos++ = '(';
+    }
+    pos += sprintf(pos, "{s0.k}");
+    for (i = 1; i < EVAL_DEPTH; i++) {
+        pos += sprintf(pos, "%c{s%lu.k})", "+*-"[i % 3], (unsigned long)i);
+    }
+
+    for (i = 0; i < PRINT_QUERIES; i++) {
+        if (parseQueryString(queries + i, str)) {
+            free(str);
+            return 1;
+        }
+
+        /* Bind values without reading a file */
+        for (j = 0; j < queries[i]->args->size; j++) {
+            ArgVal val;
+
+            val.type = ARGVAL_TYPE_FLOAT;
+            val.value.f = 1 + j / 1000.0;
+            val.is_temporary = false;
+            arglistSet(queries[i]->args, j, &val);
+        }
+    }
+    free(str);
+
+    return 0;
+}
+
+static void runEval(unsigned long n)
+{
+    unsigned long i;
+
+    for (i = 0; i < n; i++) {
+        ArgVal result;
+        evalQuery(queries[i % PRINT_QUERIES], vstack, &result);
+    }
+}
+
+static void runPrint(unsigned long n)
+{
+    int out, null;
+
+    /* Results go to /dev/null, the report goes to stdout */
+    fflush(stdout);
+    out = dup(1);
+    null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+
+    for (; n >= PRINT_QUERIES; n -= PRINT_QUERIES) {
+        printQueries((const Query**)queries, PRINT_QUERIES);
+    }
+    printQueries((const Query**)queries, n);
+
+    fflush(stdout);
+    dup2(out, 1);
+    close(out);
+    close(null);
+}
+
+static void teardownEval(void)
+{
+    size_t i;
+
+    for (i = 0; i < PRINT_QUERIES; i++) {
+        if (queries[i]) {
+            queryFree(queries[i]);
+        }
+    }
+    free(queries);
+    valstackFree(vstack);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
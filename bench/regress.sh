@@ -0,0 +1,156 @@
+#!/bin/sh
+# Performance regression check of iniget (run with "make bench-check").
+#
+# Usage: regress.sh check|baseline [INIGET] [GEN] [BASELINE]
+#
+# Runs a fixed set of scenarios BENCH_RUNS times each and computes the
+# median throughput (MB/s of the input file) with a 95% confidence
+# interval of the median. "baseline" writes the results to BASELINE
+# (default bench/baseline.json), "check" compares them against it and
+# fails if any scenario is more than BENCH_THRESHOLD percent below the
+# baseline: not just its median, but its whole confidence interval, so
+# that noise alone does not fail the check. Baselines are only
+# comparable on the machine they were recorded on.
+#
+# Environment:
+#   BENCH_RUNS      runs per scenario (default 9)
+#   BENCH_THRESHOLD allowed regression in percent (default 10)
+#   BENCH_SIZE      size of the generated INI file (default 16M)
+#   BENCH_KEYS      keys per section (default 50)
+#   BENCH_QUERIES   number of queries in the many_queries scenario (default 200)
+# The workload variables must match the ones of the baseline.
+
+set -e -f
+
+MODE=$1
+INIGET=${2:-./iniget}
+GEN=${3:-bench/gen}
+BASELINE=${4:-bench/baseline.json}
+RUNS=${BENCH_RUNS:-9}
+THRESHOLD=${BENCH_THRESHOLD:-10}
+SIZE=${BENCH_SIZE:-16M}
+KEYS=${BENCH_KEYS:-50}
+NQUERIES=${BENCH_QUERIES:-200}
+
+if [ "$MODE" != check ] && [ "$MODE" != baseline ]; then
+    echo "usage: regress.sh check|baseline [INIGET] [GEN] [BASELINE]" >&2
+    exit 2
+fi
+if [ "$MODE" = check ] && [ ! -f "$BASELINE" ]; then
+    echo "regress.sh: no baseline at $BASELINE (run 'make bench-baseline' first)" >&2
+    exit 2
+fi
+
+DIR=$(mktemp -d)
+trap 'rm -rf -- "$DIR"' EXIT INT TERM
+
+# Generate the input
+"$GEN" ini -s "$SIZE" -k "$KEYS" > "$DIR/bench.ini"
+BYTES=$(wc -c < "$DIR/bench.ini")
+SECTIONS=$(grep -c '^\[' "$DIR/bench.ini")
+WORKLOAD="\"size\": \"$SIZE\", \"keys\": $KEYS, \"queries\": $NQUERIES"
+
+queries() {
+    "$GEN" queries -S "$SECTIONS" -k "$KEYS" "$@"
+}
+
+# Prints "NAME MEDIAN LOW HIGH" (MB/s) for ascending run times on stdin
+summarize() {
+    awk -v name="$1" -v bytes="$BYTES" '{ t[NR] = ($1 > 0)? $1 : 1e-9 } END {
+        n = NR
+        med = (n % 2)? t[(n + 1) / 2] : (t[n / 2] + t[n / 2 + 1]) / 2
+
+        # Ranks of the order statistics bounding the median (normal approximation)
+        h = 1.96 * sqrt(n) / 2
+        lo = int(n / 2 - h); if (lo < 1) lo = 1
+        hi = int(n / 2 + 1 + h + 0.5); if (hi > n) hi = n
+
+        mb = bytes / 1048576
+        printf "%s %.2f %.2f %.2f\n", name, mb / med, mb / t[hi], mb / t[lo]
+    }'
+}
+
+# Usage: measure NAME QUERY_FILE [-i INPUT] FILE_ARG
+measure() {
+    name=$1
+    qfile=$2
+    shift 2
+    if [ "$1" = -i ]; then
+        "$GEN" time -a -n "$RUNS" -i "$2" -- "$INIGET" "$3" $(cat "$qfile")
+    else
+        "$GEN" time -a -n "$RUNS" -- "$INIGET" "$1" $(cat "$qfile")
+    fi | summarize "$name" >> "$DIR/results"
+}
+
+# Scenarios exercising getLine, iniExtractFromLine and the matcher
+queries -n 1 -w last           > "$DIR/late"
+queries -n 1 -w missing        > "$DIR/missing"
+queries -n "$NQUERIES" -o 50   > "$DIR/many"
+queries -n 16 -e 4             > "$DIR/expr"
+
+: > "$DIR/results"
+measure late_hit       "$DIR/late"    "$DIR/bench.ini"
+measure missing_key    "$DIR/missing" "$DIR/bench.ini"
+measure many_queries   "$DIR/many"    "$DIR/bench.ini"
+measure expressions    "$DIR/expr"    "$DIR/bench.ini"
+measure late_hit_stdin "$DIR/late"    -i "$DIR/bench.ini" -
+
+if [ "$MODE" = baseline ]; then
+    awk -v workload="$WORKLOAD" 'BEGIN {
+        print "{"
+        print "  \"workload\": {" workload "},"
+        print "  \"throughput_mbps\": {"
+    } {
+        line[NR] = sprintf("    \"%s\": %s", $1, $2)
+    } END {
+        for (i = 1; i <= NR; i++) {
+            print line[i] ((i < NR)? "," : "")
+        }
+        print "  }"
+        print "}"
+    }' "$DIR/results" > "$BASELINE"
+    echo "regress.sh: wrote $BASELINE ($RUNS runs per scenario)"
+    cat "$BASELINE"
+    exit 0
+fi
+
+# The baseline is only meaningful for the same workload
+if ! grep -qF "{$WORKLOAD}" "$BASELINE"; then
+    echo "regress.sh: $BASELINE was recorded with a different workload:" >&2
+    grep '"workload"' "$BASELINE" >&2
+    exit 2
+fi
+
+echo "iniget regression check: $BYTES bytes, $RUNS runs per scenario, threshold $THRESHOLD%"
+awk -v threshold="$THRESHOLD" '
+    FNR == NR {
+        # Scenario lines look like: "name": 123.45[,]
+        if ($0 ~ /^    "[a-z_]+": [0-9.]+,?$/) {
+            split($0, kv, /"/)
+            value = kv[3]
+            sub(/^: /, "", value)
+            sub(/,$/, "", value)
+            base[kv[2]] = value
+        }
+        next
+    }
+    {
+        if (!($1 in base)) {
+            printf "%-16s %10.2f MB/s  [%.2f, %.2f]  no baseline\n", $1, $2, $3, $4
+            next
+        }
+        change = ($2 / base[$1] - 1) * 100
+        limit = base[$1] * (1 - threshold / 100)
+        if ($4 < limit) {
+            verdict = "REGRESSED"
+            failed++
+        } else if ($2 < limit) {
+            verdict = "noisy (interval reaches the limit)"
+        } else {
+            verdict = "ok"
+        }
+        printf "%-16s %10.2f MB/s  [%.2f, %.2f]  baseline %.2f  %+6.1f%%  %s\n",
+               $1, $2, $3, $4, base[$1], change, verdict
+    }
+    END { exit failed? 1 : 0 }
+' "$BASELINE" "$DIR/results"
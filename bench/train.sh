@@ -0,0 +1,59 @@
+#!/bin/sh
+# Training workload for profile-guided optimization (run by "make release-pgo").
+#
+# Usage: train.sh [INIGET] [GEN]
+#
+# Runs an instrumented iniget over bench/train.ini and generated files
+# in every mode (file, stdin, parallel scan, multiple files), with
+# queries of all kinds, so that the profile reflects typical use. The
+# results are discarded, and failing queries are part of the workload.
+
+set -e -f
+
+INIGET=${1:-./iniget}
+GEN=${2:-bench/gen}
+TRAIN=$(dirname "$0")/train.ini
+
+DIR=$(mktemp -d)
+trap 'rm -rf -- "$DIR"' EXIT INT TERM
+
+run() {
+    "$INIGET" "$@" > /dev/null 2>&1 || true
+}
+
+# Small hand-written file: lookups, expressions, strings, aggregates, wildcards
+run "$TRAIN" '{name}' '{version}' '{server.port}' '{server.keepalive}'
+run "$TRAIN" '{server.workers} * {server.timeout} + {server.backlog} / 2' \
+    '({database-primary.max_connections} + {database-replica.max_connections}) % 7' \
+    '{database-primary.ratio} ^ 2 - {database-replica.ratio}'
+run "$TRAIN" '{database-primary.user} + " on " + {database-primary.host}' \
+    '{limits.message} * 2' '{logging.path}'
+run "$TRAIN" 'sum({backend-*.weight})' 'max({*.port})' 'count({*.host})' \
+    'join({backend-*.region})' 'avg({limits.*})'
+run "$TRAIN" 'sum({server.port}) + min({limits.rate})' '{missing.key}' '{server.port' 'max({name})'
+run - '{server.host}' '{logging.level}' < "$TRAIN"
+
+# Large generated file: early, late and missing values, many queries, all modes
+"$GEN" ini -s 8M -k 40 > "$DIR/big.ini"
+SECTIONS=$(grep -c '^\[' "$DIR/big.ini")
+"$GEN" queries -S "$SECTIONS" -k 40 -n 200 -o 30 > "$DIR/many"
+"$GEN" queries -S "$SECTIONS" -k 40 -n 16 -e 4 > "$DIR/expr"
+"$GEN" queries -S "$SECTIONS" -k 40 -n 4 -w last > "$DIR/late"
+"$GEN" queries -S "$SECTIONS" -k 40 -n 1 -w missing > "$DIR/missing"
+run "$DIR/big.ini" $(cat "$DIR/many")
+run "$DIR/big.ini" $(cat "$DIR/expr")
+run "$DIR/big.ini" $(cat "$DIR/late")
+run "$DIR/big.ini" $(cat "$DIR/missing")
+run - $(cat "$DIR/late") < "$DIR/big.ini"
+run -j 4 "$DIR/big.ini" $(cat "$DIR/late")
+run "$DIR/big.ini" 'count({s1.*})' 'join({s2.*})'
+
+# Many small files
+mkdir "$DIR/hosts"
+i=0
+while [ $i -lt 64 ]; do
+    "$GEN" ini -S 8 -k 20 -r $((i + 1)) > "$DIR/hosts/h$i.ini"
+    i=$((i + 1))
+done
+run "$DIR/hosts" -- '{s0.k0}' '{s3.k1}' '{s7.k4} + {s2.k6}'
+run -j 2 --unordered "$DIR/hosts" -- 'sum({s1.k2})' 'count({s0.*})' '{s5.k3}'
@@ -0,0 +1,318 @@
+#include "aggregate.h"
+#include "query.h"
+#include "batch.h"
+#include "alloc.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+static void intAdd(Accum *acc, long sum, long min, long max);
+static bool addOverflows(long a, long b);
+static int joinAppend(Accum *acc, const char *str, size_t len);
+
+void accumInit(Accum *acc)
+{
+    acc->count = 0;
+    acc->strings = 0;
+    acc->sum = 0;
+    acc->min = 0;
+    acc->max = 0;
+    acc->ints = true;
+    acc->exact = true;
+    acc->isum = 0;
+    acc->imin = 0;
+    acc->imax = 0;
+    acc->build_join = false;
+    acc->join = NULL;
+    acc->jlen = 0;
+    acc->jsize = 0;
+}
+
+void accumReset(Accum *acc)
+{
+    acc->count = 0;
+    acc->strings = 0;
+    acc->sum = 0;
+    acc->min = 0;
+    acc->max = 0;
+    acc->ints = true;
+    acc->exact = true;
+    acc->isum = 0;
+    acc->imin = 0;
+    acc->imax = 0;
+    acc->jlen = 0;
+    if (acc->join) {
+        acc->join[0] = '\0';
+    }
+}
+
+void accumFree(Accum *acc)
+{
+    xfree(acc->join);
+    acc->join = NULL;
+    acc->jlen = 0;
+    acc->jsize = 0;
+}
+
+int accumAdd(Accum *acc, const ArgVal *val)
+{
+    char buf[ARGVAL_NUMBER_SIZE];
+
+    if (ARGVAL_IS_NUMBER(*val)) {
+        const double f = ARGVAL_NUMBER(*val);
+
+        if (acc->count == acc->strings || f < acc->min) {
+            acc->min = f;
+        }
+        if (acc->count == acc->strings || f > acc->max) {
+            acc->max = f;
+        }
+        acc->sum += f;
+        if (val->type == ARGVAL_TYPE_INT) {
+            intAdd(acc, val->value.i, val->value.i, val->value.i);
+        } else {
+            acc->ints = acc->exact = false;
+        }
+    } else {
+        acc->strings++;
+    }
+    acc->count++;
+
+    if (!acc->build_join) {
+        return 0;
+    }
+    if (ARGVAL_IS_NUMBER(*val)) {
+        argValFormatNumber(buf, val);
+        return joinAppend(acc, buf, strlen(buf));
+    }
+    return joinAppend(acc, val->value.s, strlen(val->value.s));
+}
+
+void accumAddColumn(Accum *acc, const double *vals, const unsigned char *ints, size_t n)
+{
+    double s0, s1, s2, s3; /* independent partial sums */
+    double lo0, lo1, hi0, hi1;
+    unsigned char all;     /* 1 if all values are integers */
+    size_t i;
+
+    if (n == 0) {
+        return;
+    }
+
+    /* Several independent accumulators break the dependency chain,
+     * so that the loop can be unrolled and vectorized. */
+    s0 = s1 = s2 = s3 = 0;
+    lo0 = lo1 = hi0 = hi1 = vals[0];
+    for (i = 0; i + 4 <= n; i += 4) {
+        s0 += vals[i];
+        s1 += vals[i + 1];
+        s2 += vals[i + 2];
+        s3 += vals[i + 3];
+        lo0 = (vals[i]     < lo0)? vals[i]     : lo0;
+        lo1 = (vals[i + 1] < lo1)? vals[i + 1] : lo1;
+        lo0 = (vals[i + 2] < lo0)? vals[i + 2] : lo0;
+        lo1 = (vals[i + 3] < lo1)? vals[i + 3] : lo1;
+        hi0 = (vals[i]     > hi0)? vals[i]     : hi0;
+        hi1 = (vals[i + 1] > hi1)? vals[i + 1] : hi1;
+        hi0 = (vals[i + 2] > hi0)? vals[i + 2] : hi0;
+        hi1 = (vals[i + 3] > hi1)? vals[i + 3] : hi1;
+    }
+    for (; i < n; i++) {
+        s0 += vals[i];
+        lo0 = (vals[i] < lo0)? vals[i] : lo0;
+        hi0 = (vals[i] > hi0)? vals[i] : hi0;
+    }
+    for (i = 0, all = 1; i < n; i++) {
+        all &= ints[i];
+    }
+
+    {
+        Accum col;
+        col.count = n;
+        col.sum = (s0 + s1) + (s2 + s3);
+        col.min = (lo0 < lo1)? lo0 : lo1;
+        col.max = (hi0 > hi1)? hi0 : hi1;
+        col.strings = 0;
+        col.ints = col.exact = all;
+        col.isum = 0;
+        col.imin = all? (long)col.min : 0;
+        col.imax = all? (long)col.max : 0;
+        col.build_join = false;
+        col.join = NULL;
+        col.jlen = 0;
+
+        /* No partial sum of integers is larger than n times the largest
+         * magnitude, so below the limit the double sum is exact too */
+        if (col.exact && (col.max > -col.min? col.max : -col.min) * n < BATCH_EXACT_LIMIT
+                && fabs(col.sum) <= LONG_MAX) {
+            col.isum = col.sum;
+        } else {
+            for (i = 0; i < n && col.exact; i++) {
+                if (addOverflows(col.isum, (long)vals[i])) {
+                    col.exact = false;
+                } else {
+                    col.isum += (long)vals[i];
+                }
+            }
+        }
+        accumMerge(acc, &col);
+    }
+}
+
+int accumMerge(Accum *acc, const Accum *other)
+{
+    if (other->count > other->strings) {
+        if (acc->count == acc->strings || other->min < acc->min) {
+            acc->min = other->min;
+        }
+        if (acc->count == acc->strings || other->max > acc->max) {
+            acc->max = other->max;
+        }
+    }
+    if (!other->ints) {
+        acc->ints = acc->exact = false;
+    } else if (other->count > other->strings) {
+        acc->exact = acc->exact && other->exact;
+        intAdd(acc, other->isum, other->imin, other->imax);
+    }
+    acc->count += other->count;
+    acc->strings += other->strings;
+    acc->sum += other->sum;
+
+    if (acc->build_join && other->jlen) {
+        return joinAppend(acc, other->join, other->jlen);
+    }
+    return 0;
+}
+
+int accumResult(const Accum *acc, int op, ArgVal *result)
+{
+    static char empty[] = "";
+
+    result->type = ARGVAL_TYPE_FLOAT;
+    result->is_temporary = false;
+
+    switch (op) {
+        case OP_CNT:
+            result->type = ARGVAL_TYPE_INT;
+            result->value.i = acc->count;
+            return 0;
+        case OP_JOIN:
+            if (!acc->build_join) {
+                STAMP();
+                error("accumulator does not build join");
+                return 2;
+            }
+            result->type = ARGVAL_TYPE_STRING;
+            result->value.s = acc->join? acc->join : empty;
+            return 0;
+        case OP_SUM: case OP_MIN: case OP_MAX: case OP_AVG:
+            break;
+        default:
+            STAMP();
+            error("unmatched aggregate function (%d)", op);
+            return 2;
+    }
+
+    if (acc->strings) {
+        info("illegal operation (cannot aggregate a string with an arithmetic function)");
+        return 3;
+    }
+    if (op == OP_SUM && acc->exact) {
+        result->type = ARGVAL_TYPE_INT;
+        result->value.i = acc->isum;
+        return 0;
+    }
+    if (op == OP_SUM) {
+        result->value.f = acc->sum;
+        return 0;
+    }
+
+    if (acc->count == 0) {
+        info("no values to aggregate");
+        return 4;
+    }
+
+    switch (op) {
+        case OP_MIN:
+            if (acc->ints) {
+                result->type = ARGVAL_TYPE_INT;
+                result->value.i = acc->imin;
+            } else {
+                result->value.f = acc->min;
+            }
+            break;
+        case OP_MAX:
+            if (acc->ints) {
+                result->type = ARGVAL_TYPE_INT;
+                result->value.i = acc->imax;
+            } else {
+                result->value.f = acc->max;
+            }
+            break;
+        case OP_AVG:
+            result->value.f = (acc->exact? (double)acc->isum : acc->sum) / acc->count;
+            break;
+    }
+
+    return 0;
+}
+
+/* Adds integers to the exact part of an accumulator, before its count is
+ * updated. The sum falls back to double (acc->exact becomes false) if it
+ * overflows, like it does in intOperation */
+static void intAdd(Accum *acc, long sum, long min, long max)
+{
+    if (!acc->ints) {
+        return;
+    }
+    if (acc->count == acc->strings || min < acc->imin) {
+        acc->imin = min;
+    }
+    if (acc->count == acc->strings || max > acc->imax) {
+        acc->imax = max;
+    }
+    if (acc->exact && addOverflows(acc->isum, sum)) {
+        acc->exact = false;
+    } else if (acc->exact) {
+        acc->isum += sum;
+    }
+}
+
+/* Returns true if a + b does not fit in a long */
+static bool addOverflows(long a, long b)
+{
+    return (b > 0 && a > LONG_MAX - b) || (b < 0 && a < LONG_MIN - b);
+}
+
+/* Appends a string to the joined values, returns 0 or 1 on memory error */
+static int joinAppend(Accum *acc, const char *str, size_t len)
+{
+    const size_t sep = acc->jlen? strlen(AGG_JOIN_SEPARATOR) : 0;
+
+    /* Enlarge the buffer if needed */
+    if (acc->jlen + sep + len + 1 > acc->jsize) {
+        size_t size = acc->jsize? acc->jsize : 64; /* Arbitrary non-zero initial size */
+        char *join;
+
+        while (acc->jlen + sep + len + 1 > size) {
+            size *= 2;
+        }
+        if (!(join = xrealloc(acc->join, size * sizeof *join))) {
+            info("memory error");
+            return 1;
+        }
+        acc->join = join;
+        acc->jsize = size;
+    }
+
+    memcpy(acc->join + acc->jlen, AGG_JOIN_SEPARATOR, sep);
+    memcpy(acc->join + acc->jlen + sep, str, len);
+    acc->jlen += sep + len;
+    acc->join[acc->jlen] = '\0';
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+/** @file
+ * Accumulators for aggregate functions.
+ */
+
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include "arglist.h"
+#include <stdlib.h>
+#include <stdbool.h>
+
+
+/********************************************************
+ *                     CONSTANTS                        *
+ ********************************************************/
+
+/** The number of values gathered into a column before
+ * it is reduced into an accumulator. */
+#define AGG_BLOCK_SIZE 1024
+
+/** The separator placed between values by the 'join' function. */
+#define AGG_JOIN_SEPARATOR ","
+
+
+/********************************************************
+ *                      TYPEDEFS                        *
+ ********************************************************/
+
+/** @cond */
+typedef struct Accum Accum;
+/** @endcond */
+
+
+/********************************************************
+ *                     STRUCTURES                       *
+ ********************************************************/
+
+/** Partial result of an aggregate function.
+ *
+ * An accumulator holds everything needed to compute the result
+ * of any aggregate function over a set of values, and two
+ * accumulators of disjoint sets can be merged into one. This allows
+ * aggregating values in any order and on any number of threads.
+ *
+ * Strings only count towards @ref count, and are otherwise only
+ * kept by accumulators which build the result of 'join'.
+ *
+ * As long as all numbers are integers, minima and maxima are also
+ * kept exactly, and so are sums until they overflow a long, the same
+ * way integer arithmetic falls back to double only when needed.
+ */
+struct Accum
+{
+    /** The number of aggregated values. */
+    size_t count;
+
+    /** The number of aggregated values which are strings. */
+    size_t strings;
+
+    /** The sum of aggregated values. */
+    double sum;
+
+    /** The smallest aggregated value (if @ref count is non-zero). */
+    double min;
+
+    /** The greatest aggregated value (if @ref count is non-zero). */
+    double max;
+
+    /** @c true while every aggregated number is an integer. */
+    bool ints;
+
+    /** @c true while @ref ints and @ref isum did not overflow. */
+    bool exact;
+
+    /** The exact sum of aggregated values (if @ref exact). */
+    long isum;
+
+    /** The exact smallest aggregated value (if @ref ints). */
+    long imin;
+
+    /** The exact greatest aggregated value (if @ref ints). */
+    long imax;
+
+    /** If @c true, aggregated values are also joined into @ref join. */
+    bool build_join;
+
+    /** All aggregated values, separated by @ref AGG_JOIN_SEPARATOR
+     * (@c NULL until the first value is joined). */
+    char *join;
+
+    /** The length of @ref join. */
+    size_t jlen;
+
+    /** The size of the buffer allocated for @ref join. */
+    size_t jsize;
+};
+
+
+/********************************************************
+ *                     FUNCTIONS                        *
+ ********************************************************/
+
+/** Initializes an empty accumulator (which does not build 'join'). */
+void accumInit(Accum *acc);
+
+/** Empties an accumulator, but keeps its settings and buffers. */
+void accumReset(Accum *acc);
+
+/** Frees all memory owned by an accumulator. */
+void accumFree(Accum *acc);
+
+/** Adds a single value of any type to an accumulator.
+ *
+ * @param[inout] acc The accumulator.
+ * @param[in] val The value to add.
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error (realloc)
+ */
+int accumAdd(Accum *acc, const ArgVal *val);
+
+/** Adds a column of values to an accumulator.
+ *
+ * The loop is written so that the compiler can vectorize it,
+ * so gathering values into columns and reducing them in bulk
+ * is much faster than adding them one by one.
+ *
+ * Integers are summed exactly as long as a double holds all partial
+ * sums exactly, and on longs one by one otherwise.
+ *
+ * @param[inout] acc The accumulator.
+ * @param[in] vals The values to add.
+ * @param[in] ints Same layout as @p vals, 1 for integers (which must
+ * be below @ref BATCH_EXACT_LIMIT in magnitude) and 0 for other numbers.
+ * @param[in] n The number of elements in @p vals.
+ */
+void accumAddColumn(Accum *acc, const double *vals, const unsigned char *ints, size_t n);
+
+/** Merges one accumulator into another.
+ *
+ * @param[inout] acc The accumulator to update.
+ * @param[in] other The accumulator of a disjoint set of values.
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error (realloc)
+ */
+int accumMerge(Accum *acc, const Accum *other);
+
+/** Computes the final result of an aggregate function.
+ *
+ * @param[in] acc The accumulator.
+ * @param[in] op The aggregate function (an @ref OpCode).
+ * @param[out] result The result. It is a string only for 'join',
+ * in which case it points to @ref Accum::join (or a constant empty
+ * string) and must not be freed. It is an integer for 'count', for
+ * 'sum' if @ref Accum::exact, and for 'min' and 'max' if @ref Accum::ints.
+ *
+ * @returns
+ * - 0 - success
+ * - 2 - internal error (@p op is not an aggregate function)
+ * - 3 - illegal operation (arithmetic on aggregated strings)
+ * - 4 - no values to compute the result from
+ */
+int accumResult(const Accum *acc, int op, ArgVal *result);
+
+#endif /* AGGREGATE_H */
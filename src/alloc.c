@@ -0,0 +1,199 @@
+#include "alloc.h"
+
+#ifdef ALLOC_STATS
+#include <string.h>
+#include <pthread.h>
+
+/* Counters of a single call site */
+typedef struct {
+    const char *file;
+    int line;
+    unsigned long calls;
+    unsigned long bytes;
+    size_t live;
+    size_t peak;
+} Site;
+
+/* Prepended to every allocation, aligned like malloc's result */
+typedef union {
+    struct {
+        size_t size;
+        int site;
+    } h;
+    long double ld;
+    void *p;
+    long l;
+} Header;
+
+/* The last site collects all sites beyond the limit */
+static Site sites[ALLOC_MAX_SITES + 1];
+static int nsites;
+static size_t live, peak;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int findSite(const char *file, int line);
+static void account(Header *header, int site, size_t size);
+static int cmpSites(const void *a, const void *b);
+
+void *allocMalloc(const char *file, int line, size_t size)
+{
+    Header *header;
+
+    if (!(header = malloc(sizeof *header + size))) {
+        return NULL;
+    }
+    pthread_mutex_lock(&lock);
+    account(header, findSite(file, line), size);
+    pthread_mutex_unlock(&lock);
+
+    return header + 1;
+}
+
+void *allocCalloc(const char *file, int line, size_t n, size_t size)
+{
+    void *ptr;
+
+    if (size && n > ((size_t)-1 - sizeof(Header)) / size) {
+        return NULL;
+    }
+    if ((ptr = allocMalloc(file, line, n * size))) {
+        memset(ptr, 0, n * size);
+    }
+
+    return ptr;
+}
+
+void *allocRealloc(const char *file, int line, void *ptr, size_t size)
+{
+    Header *header, *old;
+    size_t oldsize;
+    int oldsite;
+
+    if (!ptr) {
+        return allocMalloc(file, line, size);
+    }
+
+    old = (Header*)ptr - 1;
+    oldsize = old->h.size;
+    oldsite = old->h.site;
+    if (!(header = realloc(old, sizeof *header + size))) {
+        return NULL;
+    }
+    pthread_mutex_lock(&lock);
+    sites[oldsite].live -= oldsize;
+    live -= oldsize;
+    account(header, findSite(file, line), size);
+    pthread_mutex_unlock(&lock);
+
+    return header + 1;
+}
+
+void allocFree(void *ptr)
+{
+    Header *header;
+
+    if (!ptr) {
+        return;
+    }
+
+    header = (Header*)ptr - 1;
+    pthread_mutex_lock(&lock);
+    sites[header->h.site].live -= header->h.size;
+    live -= header->h.size;
+    pthread_mutex_unlock(&lock);
+    free(header);
+}
+
+void allocPrint(FILE *out, unsigned long lines)
+{
+    Site sorted[ALLOC_MAX_SITES + 1];
+    unsigned long calls, bytes;
+    char name[64];
+    int i, n;
+
+    pthread_mutex_lock(&lock);
+    memcpy(sorted, sites, sizeof sorted);
+    /* The last site is only used once all others are taken */
+    n = nsites + (sites[ALLOC_MAX_SITES].calls != 0);
+    pthread_mutex_unlock(&lock);
+
+    qsort(sorted, n, sizeof *sorted, cmpSites);
+
+    fprintf(out, "iniget: allocations:\n");
+    fprintf(out, "    %-28s %12s %12s %12s\n", "call site", "calls", "bytes", "peak live");
+    calls = bytes = 0;
+    for (i = 0; i < n; i++) {
+        const Site *const s = sorted + i; /* shortcut */
+
+        if (s->file) {
+            sprintf(name, "%.48s:%d", s->file, s->line);
+        } else {
+            strcpy(name, "(other sites)");
+        }
+        fprintf(out, "    %-28s %12lu %12lu %12lu\n",
+                name, s->calls, s->bytes, (unsigned long)s->peak);
+        calls += s->calls;
+        bytes += s->bytes;
+    }
+    fprintf(out, "    %-28s %12lu %12lu %12lu\n", "total", calls, bytes, (unsigned long)peak);
+    fprintf(out, "    %-28s %12lu\n", "still allocated", (unsigned long)live);
+    if (lines) {
+        fprintf(out, "    %-28s %12.2f\n", "allocations per line", (double)calls / lines);
+    }
+}
+
+/* Returns the index of a call site, adding it if new (lock must be held) */
+static int findSite(const char *file, int line)
+{
+    int i;
+
+    for (i = 0; i < nsites; i++) {
+        if (sites[i].line == line
+                && (sites[i].file == file || strcmp(sites[i].file, file) == 0)) {
+            return i;
+        }
+    }
+    if (nsites == ALLOC_MAX_SITES) {
+        return ALLOC_MAX_SITES;
+    }
+    sites[nsites].file = file;
+    sites[nsites].line = line;
+
+    return nsites++;
+}
+
+/* Counts a new allocation of a site (lock must be held) */
+static void account(Header *header, int site, size_t size)
+{
+    Site *const s = sites + site; /* shortcut */
+
+    header->h.size = size;
+    header->h.site = site;
+    s->calls++;
+    s->bytes += size;
+    s->live += size;
+    if (s->live > s->peak) {
+        s->peak = s->live;
+    }
+    live += size;
+    if (live > peak) {
+        peak = live;
+    }
+}
+
+/* Orders sites by the number of calls, most first */
+static int cmpSites(const void *a, const void *b)
+{
+    const Site *x = a, *y = b;
+    return (x->calls < y->calls) - (x->calls > y->calls);
+}
+
+#else
+
+void allocPrint(FILE *out, unsigned long lines)
+{
+    (void)out;
+    (void)lines;
+}
+
+#endif /* ALLOC_STATS */
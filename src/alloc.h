@@ -0,0 +1,104 @@
+/** @file
+ * Heap allocation interface with optional accounting.
+ *
+ * All modules allocate through the macros defined here. By default
+ * they expand to the standard library functions and cost nothing.
+ * If the program is compiled with @c ALLOC_STATS defined (see the
+ * @c allocstats target of the Makefile), every allocation is counted
+ * per call site, and the totals are added to the --stats report.
+ *
+ * Memory obtained from these macros must be released with @ref xfree,
+ * and memory allocated by the standard library itself (for example
+ * by open_memstream) must be released with plain free.
+ */
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/********************************************************
+ *                     CONSTANTS                        *
+ ********************************************************/
+
+/** The maximum number of distinct call sites which are counted
+ * separately. Any further sites are counted together. */
+#define ALLOC_MAX_SITES 256
+
+#ifdef ALLOC_STATS
+#define xmalloc(size)       allocMalloc(__FILE__, __LINE__, (size))
+#define xcalloc(n, size)    allocCalloc(__FILE__, __LINE__, (n), (size))
+#define xrealloc(ptr, size) allocRealloc(__FILE__, __LINE__, (ptr), (size))
+#define xfree(ptr)          allocFree(ptr)
+#else
+/** Allocates memory, like malloc. */
+#define xmalloc(size)       malloc(size)
+/** Allocates zeroed memory, like calloc. */
+#define xcalloc(n, size)    calloc((n), (size))
+/** Resizes memory, like realloc. */
+#define xrealloc(ptr, size) realloc((ptr), (size))
+/** Releases memory obtained from one of the above, like free. */
+#define xfree(ptr)          free(ptr)
+#endif
+
+
+/********************************************************
+ *                     FUNCTIONS                        *
+ ********************************************************/
+
+#ifdef ALLOC_STATS
+/** Counted malloc (use @ref xmalloc instead).
+ *
+ * @param[in] file The source file of the call site.
+ * @param[in] line The line of the call site.
+ * @param[in] size The number of bytes to allocate.
+ *
+ * @returns The allocated memory, or @c NULL on failure.
+ */
+void *allocMalloc(const char *file, int line, size_t size);
+
+/** Counted calloc (use @ref xcalloc instead).
+ *
+ * @param[in] file The source file of the call site.
+ * @param[in] line The line of the call site.
+ * @param[in] n The number of elements.
+ * @param[in] size The size of a single element.
+ *
+ * @returns The allocated memory, or @c NULL on failure.
+ */
+void *allocCalloc(const char *file, int line, size_t n, size_t size);
+
+/** Counted realloc (use @ref xrealloc instead).
+ *
+ * The resized memory is attributed to the site of the last resize.
+ *
+ * @param[in] file The source file of the call site.
+ * @param[in] line The line of the call site.
+ * @param[in] ptr The memory to resize, or @c NULL.
+ * @param[in] size The new number of bytes.
+ *
+ * @returns The resized memory, or @c NULL on failure
+ * (in which case @p ptr is left untouched).
+ */
+void *allocRealloc(const char *file, int line, void *ptr, size_t size);
+
+/** Counted free (use @ref xfree instead).
+ *
+ * @param[in] ptr The memory to release, or @c NULL.
+ */
+void allocFree(void *ptr);
+#endif
+
+/** Prints the allocation report.
+ *
+ * Does nothing unless the program was compiled with @c ALLOC_STATS.
+ *
+ * @param[inout] out The stream to print to.
+ * @param[in] lines The number of input lines read, used to
+ * report the number of allocations per line (0 to omit it).
+ */
+void allocPrint(FILE *out, unsigned long lines);
+
+#endif /* ALLOC_H */
@@ -1,29 +1,46 @@
 #include "arglist.h"
+#include "aggregate.h"
+#include "alloc.h"
 #include "error.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+
+static ArgValType valueType(const char *beg, const char *end);
+static int parseInt(const char *beg, const char *end, long *result);
+static int parseFloat(const char *beg, const char *end, double *result);
 
 ArgList *arglistCreate(size_t size)
 {
     ArgList *new;
     size_t i;
 
-    if (!(new = malloc(sizeof *new))) {
+    if (!(new = xmalloc(sizeof *new))) {
         info("memory error");
         return NULL;
     }
 
+    /* One extra element keeps the sizes non-zero */
     new->size = size;
-    if (!(new->data = malloc(new->size * sizeof *new->data))) {
+    new->accs = NULL;
+    new->types = xmalloc((size + 1) * sizeof *new->types);
+    new->nums = xmalloc((size + 1) * sizeof *new->nums);
+    new->ints = xmalloc((size + 1) * sizeof *new->ints);
+    new->strs = xmalloc((size + 1) * sizeof *new->strs);
+    if (!new->types || !new->nums || !new->ints || !new->strs) {
         info("memory error");
-        free(new);
+        xfree(new->types);
+        xfree(new->nums);
+        xfree(new->ints);
+        xfree(new->strs);
+        xfree(new);
         return NULL;
     }
 
     for (i = 0; i < size; i++) {
-        new->data[i].type = ARGVAL_TYPE_NONE;
+        new->types[i] = ARGVAL_TYPE_NONE;
     }
 
     return new;
@@ -40,10 +57,16 @@ void arglistClear(ArgList *arglist)
     }
 
     for (i = 0; i < arglist->size; i++) {
-        if (arglist->data[i].type == ARGVAL_TYPE_STRING) {
-            free(arglist->data[i].value.s);
+        if (arglist->types[i] == ARGVAL_TYPE_STRING) {
+            xfree(arglist->strs[i]);
+        }
+        arglist->types[i] = ARGVAL_TYPE_NONE;
+    }
+
+    if (arglist->accs) {
+        for (i = 0; i < arglist->size; i++) {
+            accumReset(arglist->accs + i);
         }
-        arglist->data[i].type = ARGVAL_TYPE_NONE;
     }
 }
 
@@ -59,88 +82,286 @@ void arglistFree(ArgList *arglist)
 
     arglistClear(arglist);
 
-    for (i = 0; i < arglist->size; i++) {
-        if (arglist->data[i].type == ARGVAL_TYPE_STRING) {
-            free(arglist->data[i].value.s);
+    if (arglist->accs) {
+        for (i = 0; i < arglist->size; i++) {
+            accumFree(arglist->accs + i);
         }
+        xfree(arglist->accs);
+    }
+
+    xfree(arglist->types);
+    xfree(arglist->nums);
+    xfree(arglist->ints);
+    xfree(arglist->strs);
+    xfree(arglist);
+}
+
+int arglistSet(ArgList *arglist, size_t i, const ArgVal *val)
+{
+    switch (val->type) {
+        case ARGVAL_TYPE_FLOAT:
+            arglist->nums[i] = val->value.f;
+            break;
+        case ARGVAL_TYPE_INT:
+            arglist->nums[i] = val->value.i;
+            arglist->ints[i] = val->value.i;
+            break;
+        case ARGVAL_TYPE_STRING:
+            if (!(arglist->strs[i] = xmalloc((strlen(val->value.s) + 1) * sizeof *arglist->strs[i]))) {
+                info("memory error");
+                return 1;
+            }
+            strcpy(arglist->strs[i], val->value.s);
+            break;
+        default:
+            STAMP();
+            error("unexpected val->type %d", val->type);
+            return 1;
+    }
+    arglist->types[i] = val->type;
+
+    return 0;
+}
+
+int arglistTake(ArgList *arglist, size_t i, const ArgVal *val)
+{
+    if (val->type != ARGVAL_TYPE_STRING) {
+        return arglistSet(arglist, i, val);
     }
+    arglist->strs[i] = val->value.s;
+    arglist->types[i] = ARGVAL_TYPE_STRING;
 
-    free(arglist->data);
-    free(arglist);
+    return 0;
+}
+
+void arglistUnset(ArgList *arglist, size_t i)
+{
+    if (arglist->types[i] == ARGVAL_TYPE_STRING) {
+        xfree(arglist->strs[i]);
+    }
+    arglist->types[i] = ARGVAL_TYPE_NONE;
+}
+
+ArgVal arglistGet(const ArgList *arglist, size_t i)
+{
+    ArgVal ret;
+
+    ret.type = arglist->types[i];
+    switch (ret.type) {
+        case ARGVAL_TYPE_FLOAT:
+            ret.value.f = arglist->nums[i];
+            break;
+        case ARGVAL_TYPE_INT:
+            ret.value.i = arglist->ints[i];
+            break;
+        case ARGVAL_TYPE_STRING:
+            ret.value.s = arglist->strs[i];
+            break;
+        default:
+            break;
+    }
+    ret.is_temporary = false;
+
+    return ret;
 }
 
 ArgVal argValGetFromString(const char *str)
+{
+    return argValFromRange(str, str + strlen(str));
+}
+
+ArgVal argValFromRange(const char *beg, const char *end)
 {
     ArgVal ret;
-    const char *beg, *end; /* Marks beginning and end of the value */
+
+    /* All strings processed by this function
+     * come directly from an INI file, so therefore
+     * they are not "temporary". */
+    ret.is_temporary = false;
+
+    /* Parse the value */
+    ret.type = argValLocate(&beg, &end);
+    switch (ret.type) {
+        case ARGVAL_TYPE_STRING:
+            /* Create a buffer for a string value */
+            if (!(ret.value.s = xmalloc((end - beg + 1) * sizeof *ret.value.s))) {
+                info("memory error");
+                ret.type = ARGVAL_TYPE_NONE;
+                return ret;
+            }
+            memcpy(ret.value.s, beg, end - beg);
+            ret.value.s[end - beg] = '\0';
+            break;
+        case ARGVAL_TYPE_INT:
+            /* Parse the digits directly, unless the value overflows */
+            if (parseInt(beg, end - 1, &ret.value.i) == 0) {
+                break;
+            }
+            ret.type = ARGVAL_TYPE_FLOAT;
+            /* fallthrough */
+        case ARGVAL_TYPE_FLOAT:
+            if (parseFloat(beg, end, &ret.value.f)) {
+                ret.type = ARGVAL_TYPE_NONE;
+            }
+            break;
+        default:
+            STAMP();
+            error("unexpected ret.type %d", ret.type);
+            break;
+    }
+
+    return ret;
+}
+
+ArgValType argValLocate(const char **beg, const char **end)
+{
+    const char *nul;
+
+    /* Like a C string, the value ends at a null byte */
+    if ((nul = memchr(*beg, '\0', *end - *beg))) {
+        *end = nul;
+    }
 
     /* Locate where the value begins and ends */
-    beg = str;
-    end = str + strlen(str) - 1;
-    while (isspace(*beg))
+    while (*beg < *end && isspace(**beg))
+        (*beg)++;
+    while (*end > *beg && isspace((*end)[-1]))
+        (*end)--;
+
+    /* Only the string in-between the double quotes is kept */
+    if (*end - *beg >= 2 && **beg == '"' && (*end)[-1] == '"') {
+        (*beg)++;
+        (*end)--;
+        return ARGVAL_TYPE_STRING;
+    }
+
+    return valueType(*beg, *end);
+}
+
+ArgVal argValFromBuffer(char *buf)
+{
+    ArgVal ret;
+    char *beg, *end, *new;
+
+    /* Locate where the value begins and ends */
+    beg = buf;
+    end = buf + strlen(buf);
+    while (beg < end && isspace(*beg))
         beg++;
-    while (isspace(*end))
+    while (end > beg && isspace(end[-1]))
         end--;
 
-    /* Parse the value */
-    if (*beg == '"' && *end == '"') {
-        ret.type = ARGVAL_TYPE_STRING;
-
-        /* Create a buffer for a string value */
-        if (!(ret.value.s = malloc((end - beg) * sizeof *ret.value.s))) {
-            info("memory error");
-            ret.type = ARGVAL_TYPE_NONE;
-            return ret;
-        }
+    if (end - beg >= 2 && *beg == '"' && end[-1] == '"') {
+        beg++;
+        end--;
+    } else if (valueType(beg, end) != ARGVAL_TYPE_STRING) {
+        /* Numbers need no buffer */
+        ret = argValFromRange(beg, end);
+        xfree(buf);
+        return ret;
+    }
+
+    /* Move the string to the beginning of the buffer, and give back the rest */
+    memmove(buf, beg, end - beg);
+    buf[end - beg] = '\0';
+    if ((new = xrealloc(buf, (end - beg + 1) * sizeof *buf))) {
+        buf = new;
+    }
+    ret.type = ARGVAL_TYPE_STRING;
+    ret.value.s = buf;
+    ret.is_temporary = false;
 
-        /* Store the string in-between the double quotes */
-        strncpy(ret.value.s, beg + 1, end - beg);
-        ret.value.s[end - beg - 1] = '\0';
+    return ret;
+}
+
+void argValPrint(FILE *out, const ArgVal *val)
+{
+    switch (val->type) {
+        case ARGVAL_TYPE_STRING:
+            fputs(val->value.s, out);
+            break;
+        case ARGVAL_TYPE_FLOAT:
+            fprintf(out, "%.10g", val->value.f);
+            break;
+        case ARGVAL_TYPE_INT:
+            fprintf(out, "%ld", val->value.i);
+            break;
+        default:
+            STAMP();
+            error("unexpected val->type %d", val->type);
+            break;
+    }
+}
+
+void argValFormatNumber(char *buf, const ArgVal *val)
+{
+    if (val->type == ARGVAL_TYPE_INT) {
+        sprintf(buf, "%ld", val->value.i);
     } else {
-        /* If format matches a number, treat it as number.
-         * Otherwise fallback to string. */
-        const char *i;
-        int periods;
-
-        /* Determine the value type */
-        ret.type = ARGVAL_TYPE_NONE;
-        for (i = beg, periods = 0; i <= end; i++) {
-            if ((*i != '.' && !isdigit(*i) && !(*i == '-' && i == beg)) || (*i == '.' && ++periods != 1)) {
-                ret.type = ARGVAL_TYPE_STRING;
-                break;
-            }
-        }
-        if (ret.type == ARGVAL_TYPE_NONE) {
-            ret.type = ARGVAL_TYPE_FLOAT;
+        sprintf(buf, "%.10g", val->value.f);
+    }
+}
+
+/* Determines the type of an unquoted, trimmed value [beg, end): a number
+ * is a run of digits with at most one period and an optional minus sign,
+ * which is an integer without a period (unless it is a lone minus) */
+static ArgValType valueType(const char *beg, const char *end)
+{
+    const char *i;
+    int periods;
+
+    if (beg == end) {
+        return ARGVAL_TYPE_STRING;
+    }
+    for (i = beg, periods = 0; i < end; i++) {
+        if ((*i != '.' && !isdigit(*i) && !(*i == '-' && i == beg)) || (*i == '.' && ++periods != 1)) {
+            return ARGVAL_TYPE_STRING;
         }
+    }
 
-        switch (ret.type) {
-            case ARGVAL_TYPE_STRING:
-                /* Create a buffer for a string value */
-                if (!(ret.value.s = malloc((end - beg + 2) * sizeof *ret.value.s))) {
-                    info("memory error");
-                    ret.type = ARGVAL_TYPE_NONE;
-                    return ret;
-                }
-
-                /* Store the string */
-                strncpy(ret.value.s, beg, end - beg + 2);
-                ret.value.s[end - beg + 1] = '\0';
-                break;
-            case ARGVAL_TYPE_FLOAT:
-                ret.value.f = atof(beg);
-                break;
-            default:
-                STAMP();
-                error("unexpected ret.type %d", ret.type);
-                break;
+    return (periods == 0 && !(*beg == '-' && end - beg == 1))? ARGVAL_TYPE_INT : ARGVAL_TYPE_FLOAT;
+}
+
+/* Parses an optionally negative run of digits [beg, end],
+ * returns 0 on success or 1 if it does not fit in a long */
+static int parseInt(const char *beg, const char *end, long *result)
+{
+    const bool neg = (*beg == '-');
+    const unsigned long limit = neg? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX;
+    unsigned long n;
+
+    for (n = 0, beg += neg; beg <= end; beg++) {
+        const unsigned digit = *beg - '0';
+
+        if (n > (limit - digit) / 10) {
+            return 1;
         }
+        n = n * 10 + digit;
     }
 
-    /* All strings processed by this function
-     * come directly from an INI file, so therefore
-     * they are not "temporary". */
-    ret.is_temporary = false;
+    /* Negate without overflowing on LONG_MIN */
+    *result = (neg && n)? -(long)(n - 1) - 1 : (long)n;
 
-    return ret;
+    return 0;
+}
+
+/* Parses a number [beg, end) with atof, which needs a terminated string,
+ * returns 0 on success or 1 on memory error */
+static int parseFloat(const char *beg, const char *end, double *result)
+{
+    char buf[ARGVAL_NUMBER_SIZE * 2], *str;
+
+    str = buf;
+    if ((size_t)(end - beg) >= sizeof buf && !(str = xmalloc((end - beg + 1) * sizeof *str))) {
+        info("memory error");
+        return 1;
+    }
+    memcpy(str, beg, end - beg);
+    str[end - beg] = '\0';
+    *result = atof(str);
+    if (str != buf) {
+        xfree(str);
+    }
+
+    return 0;
 }
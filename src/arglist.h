@@ -5,6 +5,7 @@
 #ifndef ARGLIST_H
 #define ARGLIST_H
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
 #include <stdbool.h>
@@ -24,15 +25,29 @@ enum ArgValType {
     /** floating-point */
     ARGVAL_TYPE_FLOAT,
 
+    /** integer (a long, so 64-bit on LP64 platforms) */
+    ARGVAL_TYPE_INT,
+
     /** string of characters */
     ARGVAL_TYPE_STRING
 };
 
+/** True if an @ref ArgVal (not a pointer) holds a number of any type. */
+#define ARGVAL_IS_NUMBER(V) ((V).type == ARGVAL_TYPE_FLOAT || (V).type == ARGVAL_TYPE_INT)
+
+/** The numeric value of an @ref ArgVal holding a number, as a double. */
+#define ARGVAL_NUMBER(V) (((V).type == ARGVAL_TYPE_INT)? (double)(V).value.i : (V).value.f)
+
+/** The size of a buffer which fits any number formatted
+ * by @ref argValFormatNumber. */
+#define ARGVAL_NUMBER_SIZE 32
+
 /********************************************************
  *                      TYPEDEFS                        *
  ********************************************************/
 
 /** @cond */
+struct Accum;
 typedef struct ArgList ArgList;
 typedef struct ArgVal ArgVal;
 typedef enum ArgValType ArgValType;
@@ -43,7 +58,7 @@ typedef enum ArgValType ArgValType;
  *                     DATA TYPES                       *
  ********************************************************/
 
-/** A simple arglist of ints implemented as an array.
+/** A list of values, stored column by column.
  *
  * This structure is used during the initial stage of
  * running a @ref Query (@ref runQueries). Since each
@@ -56,14 +71,37 @@ typedef enum ArgValType ArgValType;
  * (each query gets its own ArgList (@ref Query::args), and
  * each ArgList is indexed exactly like that query's @ref
  * Query::set array).
+ *
+ * Instead of an array of @ref ArgVal structures, every component
+ * of the values has an array of its own, so that the numbers of
+ * a list are a dense array of doubles which arithmetic can run
+ * over without looking at anything else. Values are stored with
+ * @ref arglistSet and read with @ref arglistGet.
  */
 struct ArgList
 {
-    /** Array of values. */
-    ArgVal *data;
+    /** The type of each value (@ref ARGVAL_TYPE_NONE if not bound). */
+    ArgValType *types;
+
+    /** The value of each number as a double (also for integers),
+     * undefined for other types. */
+    double *nums;
+
+    /** The exact value of each integer, undefined for other types. */
+    long *ints;
+
+    /** The value of each string, owned by the arglist,
+     * undefined for other types. */
+    char **strs;
 
     /** Number of elements on the arglist. */
     size_t size;
+
+    /** Accumulators of values matched by wildcard references,
+     * indexed like the values, or @c NULL if there are none.
+     * Only the elements of wildcard references are used.
+     */
+    struct Accum *accs;
 };
 
 /** Holds a single value of one of types defined in
@@ -77,6 +115,7 @@ struct ArgVal
     /** The value */
     union {
         double f;
+        long i;
         char *s;
     } value;
 
@@ -99,6 +138,8 @@ struct ArgVal
  ********************************************************/
 
 /** Allocates a new arglist and returns its address.
+ *
+ * The arglist has no accumulators (see @ref queryArglistCreate).
  *
  * @param size The length of the arglist.
  *
@@ -116,16 +157,63 @@ void arglistFree(ArgList *arglist);
  * This function should always be called before a @ref Query
  * is run, to make sure that no memory leaks from an arglist.
  * It is also automatically called in @ref arglistFree.
+ * Accumulators are emptied, but keep their buffers.
  *
  * @param[inout] arglist The arglist to clear.
  */
 void arglistClear(ArgList *arglist);
 
+/** Stores a value in an arglist.
+ *
+ * Strings are copied, the arglist never takes ownership of @p val.
+ *
+ * @param[inout] arglist The arglist.
+ * @param[in] i The index of the value, which must not be bound yet.
+ * @param[in] val The value (of any type but @ref ARGVAL_TYPE_NONE).
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error (malloc)
+ */
+int arglistSet(ArgList *arglist, size_t i, const ArgVal *val);
+
+/** Stores a value in an arglist, taking over its string.
+ *
+ * This is @ref arglistSet without the copy: a string of @p val
+ * must have been allocated with @ref xmalloc, and from now on
+ * belongs to the arglist (so the caller must not free it).
+ *
+ * @param[inout] arglist The arglist.
+ * @param[in] i The index of the value, which must not be bound yet.
+ * @param[in] val The value (of any type but @ref ARGVAL_TYPE_NONE).
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - invalid type of @p val
+ */
+int arglistTake(ArgList *arglist, size_t i, const ArgVal *val);
+
+/** Unbinds a single value of an arglist (see @ref arglistClear). */
+void arglistUnset(ArgList *arglist, size_t i);
+
+/** Reads a value of an arglist.
+ *
+ * @param[in] arglist The arglist.
+ * @param[in] i The index of the value.
+ *
+ * @returns
+ * The value. A string still belongs to the arglist, so it is
+ * never temporary.
+ */
+ArgVal arglistGet(const ArgList *arglist, size_t i);
+
 /** Converts a string representation of a value into ArgVal object.
  *
  * This function receives a raw string representation of a value,
  * as it appeared in an INI file, determines its type (while
  * performing validation) and returns an adequate ArgVal object.
+ * Numbers without a period are integers if they fit in a long,
+ * all other numbers are floating-point.
  *
  * @param[in] str The string to interpret.
  * 
@@ -134,4 +222,66 @@ void arglistClear(ArgList *arglist);
  */
 ArgVal argValGetFromString(const char *str);
 
+/** Same as @ref argValGetFromString, for a string which is not terminated.
+ *
+ * Only the bytes [@p beg, @p end) are read (up to a null byte, if
+ * there is one), so the value can be parsed directly from a mapped
+ * file. A string value is the only allocation.
+ *
+ * @param[in] beg The first byte of the value.
+ * @param[in] end One past the last byte of the value.
+ *
+ * @returns
+ * The value, or one of type @ref ARGVAL_TYPE_NONE on memory error.
+ */
+ArgVal argValFromRange(const char *beg, const char *end);
+
+/** Locates a value in a string which is not terminated, without parsing it.
+ *
+ * The range is narrowed the same way @ref argValFromRange does it:
+ * up to a null byte, without surrounding whitespace and, for a quoted
+ * string, without the quotes. A string can then be used right where
+ * it is, for example printed straight from a mapped file.
+ *
+ * @param[inout] beg The first byte of the value.
+ * @param[inout] end One past the last byte of the value.
+ *
+ * @returns
+ * The type the value would have.
+ */
+ArgValType argValLocate(const char **beg, const char **end);
+
+/** Same as @ref argValGetFromString, reusing the buffer of the string.
+ *
+ * A string value is moved to the beginning of @p buf, which becomes
+ * the string of the result. Otherwise @p buf is freed. Either way,
+ * the caller must not use @p buf anymore, so the value of a huge
+ * line is never copied.
+ *
+ * @param[in] buf The string to interpret, allocated with @ref xmalloc.
+ *
+ * @returns
+ * The value, or one of type @ref ARGVAL_TYPE_NONE on memory error
+ * (@p buf is freed).
+ */
+ArgVal argValFromBuffer(char *buf);
+
+/** Prints a value the way query results are printed.
+ *
+ * Integers are printed exactly, floating-point numbers with up
+ * to 10 significant digits and strings verbatim. No newline
+ * is appended.
+ *
+ * @param[inout] out The stream to print to.
+ * @param[in] val The value to print.
+ */
+void argValPrint(FILE *out, const ArgVal *val);
+
+/** Formats a number the way @ref argValPrint prints it.
+ *
+ * @param[out] buf The buffer, of at least @ref ARGVAL_NUMBER_SIZE bytes.
+ * @param[in] val The value, which must be a number.
+ */
+void argValFormatNumber(char *buf, const ArgVal *val);
+
 #endif /* ARGLIST_H */
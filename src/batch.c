@@ -0,0 +1,297 @@
+#include "batch.h"
+#include "alloc.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static void applyOperator(int op, double *z, unsigned char *zi, const double *x,
+        const unsigned char *xi, const double *y, const unsigned char *yi,
+        unsigned char *mask, size_t n);
+
+int batchCreate(Batch **batch_ptr, const Query *query, size_t beg, size_t end, size_t capacity)
+{
+    const Stack *const op_stack = query->op_stack; /* shortcut */
+    Batch *batch;
+    size_t j, depth, maxdepth, nvals;
+    bool late_errors;
+
+    if (!batch_ptr || end > op_stack->size || beg >= end) {
+        STAMP();
+        error("invalid batch range");
+        return 2;
+    }
+
+    /* Check the expression and find its evaluation depth */
+    depth = maxdepth = 0;
+    late_errors = false;
+    for (j = beg; j < end; j++) {
+        int idx = op_stack->data[j];
+
+        if (idx >= 0) {
+            if ((size_t)idx >= query->set->size) {
+                STAMP();
+                error("op_stack index (%d) out of DataSet range (%lu)", idx, (unsigned long)query->set->size);
+                return 2;
+            }
+            if (query->set->data[idx].wildcard) {
+                return 3;
+            }
+            if (++depth > maxdepth) {
+                maxdepth = depth;
+            }
+        } else if (idx == OP_ADD || idx == OP_SUB || idx == OP_MUL
+                || idx == OP_DIV || idx == OP_MOD || idx == OP_POW) {
+            if (depth < 2) {
+                STAMP();
+                error("operator without operands in batch range");
+                return 2;
+            }
+            depth--;
+            if (idx == OP_DIV && op_stack->data[j - 1] < 0) {
+                late_errors = true;
+            }
+        } else {
+            return 3;
+        }
+    }
+    if (depth != 1) {
+        STAMP();
+        error("batch range is not a single expression");
+        return 2;
+    }
+
+    if (!(batch = xmalloc(sizeof *batch))) {
+        info("memory error");
+        return 1;
+    }
+    nvals = query->set->size;
+    batch->query = query;
+    batch->beg = beg;
+    batch->end = end;
+    batch->capacity = capacity;
+    batch->depth = maxdepth;
+    batch->late_errors = late_errors;
+    batch->nums = xmalloc((nvals * capacity + 1) * sizeof *batch->nums);
+    batch->ints = xcalloc(nvals * capacity + 1, sizeof *batch->ints);
+    batch->mask = xcalloc(capacity + 1, sizeof *batch->mask);
+    batch->stack = xmalloc((maxdepth * capacity + 1) * sizeof *batch->stack);
+    batch->istack = xmalloc((maxdepth * capacity + 1) * sizeof *batch->istack);
+    batch->top = xmalloc(maxdepth * sizeof *batch->top);
+    batch->itop = xmalloc(maxdepth * sizeof *batch->itop);
+    if (!batch->nums || !batch->ints || !batch->mask || !batch->stack
+            || !batch->istack || !batch->top || !batch->itop) {
+        info("memory error");
+        batchFree(batch);
+        return 1;
+    }
+
+    *batch_ptr = batch;
+    return 0;
+}
+
+void batchFree(Batch *batch)
+{
+    xfree(batch->nums);
+    xfree(batch->ints);
+    xfree(batch->mask);
+    xfree(batch->stack);
+    xfree(batch->istack);
+    xfree(batch->top);
+    xfree(batch->itop);
+    xfree(batch);
+}
+
+unsigned batchBind(Batch *batch, size_t row, const ArgList *args)
+{
+    const Stack *const op_stack = batch->query->op_stack; /* shortcut */
+    unsigned flags;
+    size_t j;
+
+    flags = 0;
+    for (j = batch->beg; j < batch->end; j++) {
+        const int idx = op_stack->data[j]; /* shortcut */
+        size_t pos;
+
+        if (idx < 0) {
+            /* The divisor is the value right before, if it is one */
+            if (idx == OP_DIV && op_stack->data[j - 1] >= 0
+                    && batch->nums[op_stack->data[j - 1] * batch->capacity + row] == 0) {
+                flags |= BATCH_DIVZERO;
+            }
+            continue;
+        }
+
+        pos = idx * batch->capacity + row;
+        switch (args->types[idx]) {
+            case ARGVAL_TYPE_FLOAT:
+                batch->nums[pos] = args->nums[idx];
+                batch->ints[pos] = 0;
+                break;
+            case ARGVAL_TYPE_INT:
+                batch->nums[pos] = args->nums[idx];
+                batch->ints[pos] = 1;
+                if (fabs(batch->nums[pos]) >= BATCH_EXACT_LIMIT) {
+                    flags |= BATCH_TYPE;
+                }
+                break;
+            default:
+                batch->nums[pos] = 0;
+                batch->ints[pos] = 0;
+                flags |= BATCH_TYPE;
+                break;
+        }
+    }
+
+    batch->mask[row] = flags;
+    return flags;
+}
+
+int batchRebind(const Batch *batch, size_t row, ArgList *args)
+{
+    const Stack *const op_stack = batch->query->op_stack; /* shortcut */
+    size_t j;
+
+    for (j = batch->beg; j < batch->end; j++) {
+        const int idx = op_stack->data[j]; /* shortcut */
+        size_t pos;
+        ArgVal val;
+
+        if (idx < 0) {
+            continue;
+        }
+        pos = idx * batch->capacity + row;
+        if (batch->ints[pos]) {
+            val.type = ARGVAL_TYPE_INT;
+            val.value.i = (long)batch->nums[pos];
+        } else {
+            val.type = ARGVAL_TYPE_FLOAT;
+            val.value.f = batch->nums[pos];
+        }
+        val.is_temporary = false;
+
+        arglistUnset(args, idx);
+        if (arglistSet(args, idx, &val)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int batchEval(Batch *batch, size_t rows, double *out, unsigned char *iout)
+{
+    const Stack *const op_stack = batch->query->op_stack; /* shortcut */
+    const size_t cap = batch->capacity; /* shortcut */
+    const unsigned char *const mask = batch->mask; /* shortcut */
+    const double *res;
+    const unsigned char *ires;
+    size_t j, depth, r;
+
+    depth = 0;
+    for (j = batch->beg; j < batch->end; j++) {
+        const int idx = op_stack->data[j]; /* shortcut */
+
+        if (idx >= 0) {
+            /* Values are used in place */
+            batch->top[depth] = batch->nums + idx * cap;
+            batch->itop[depth] = batch->ints + idx * cap;
+            depth++;
+        } else {
+            double *z;
+            unsigned char *zi;
+
+            if (depth < 2) {
+                STAMP();
+                error("operator without operands in batch range");
+                return 2;
+            }
+
+            /* The result replaces the left operand, which may be the same column */
+            z = batch->stack + (depth - 2) * cap;
+            zi = batch->istack + (depth - 2) * cap;
+            applyOperator(idx, z, zi, batch->top[depth - 2], batch->itop[depth - 2],
+                    batch->top[depth - 1], batch->itop[depth - 1], batch->mask, rows);
+            depth--;
+            batch->top[depth - 1] = z;
+            batch->itop[depth - 1] = zi;
+        }
+    }
+    if (depth != 1) {
+        STAMP();
+        error("batch expression left %lu results", (unsigned long)depth);
+        return 2;
+    }
+
+    /* Keep the previous value of flagged rows */
+    res = batch->top[0];
+    ires = batch->itop[0];
+    for (r = 0; r < rows; r++) {
+        out[r] = mask[r]? out[r] : res[r];
+        iout[r] = mask[r]? iout[r] : ires[r];
+    }
+
+    return 0;
+}
+
+/* Computes z = x op y for n rows, with the same rules as evalQueryRange:
+ * integer operations whose result might not be exact are flagged, so that
+ * they are computed on longs, and integer results are never -0 */
+static void applyOperator(int op, double *z, unsigned char *zi, const double *x,
+        const unsigned char *xi, const double *y, const unsigned char *yi,
+        unsigned char *mask, size_t n)
+{
+    size_t r;
+
+    switch (op) {
+        case OP_ADD:
+            for (r = 0; r < n; r++) {
+                z[r] = x[r] + y[r];
+                zi[r] = xi[r] & yi[r];
+            }
+            break;
+        case OP_SUB:
+            for (r = 0; r < n; r++) {
+                z[r] = x[r] - y[r];
+                zi[r] = xi[r] & yi[r];
+            }
+            break;
+        case OP_MUL:
+            for (r = 0; r < n; r++) {
+                z[r] = x[r] * y[r];
+                zi[r] = xi[r] & yi[r];
+            }
+            break;
+        case OP_DIV:
+            /* Division is never exact, so there is no integer check */
+            for (r = 0; r < n; r++) {
+                mask[r] |= (y[r] == 0)? BATCH_DIVZERO : 0;
+                z[r] = x[r] / y[r];
+                zi[r] = 0;
+            }
+            return;
+        case OP_MOD:
+            /* Modulo 0 is NaN, which is a float */
+            for (r = 0; r < n; r++) {
+                z[r] = fmod(x[r], y[r]);
+                zi[r] = xi[r] & yi[r] & (y[r] != 0);
+            }
+            break;
+        case OP_POW:
+            /* Negative exponents give floats */
+            for (r = 0; r < n; r++) {
+                z[r] = pow(x[r], y[r]);
+                zi[r] = xi[r] & yi[r] & (y[r] >= 0);
+            }
+            break;
+        default:
+            return;
+    }
+
+    /* Integer results must be exact, and 0 has no sign */
+    for (r = 0; r < n; r++) {
+        mask[r] |= (zi[r] && fabs(z[r]) >= BATCH_EXACT_LIMIT)? BATCH_INEXACT : 0;
+        z[r] = zi[r]? z[r] + 0.0 : z[r];
+    }
+}
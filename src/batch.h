@@ -0,0 +1,189 @@
+/** @file
+ * Evaluating one expression over many sets of values at once.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "query.h"
+#include "arglist.h"
+#include <stdlib.h>
+#include <stdbool.h>
+
+
+/********************************************************
+ *                     CONSTANTS                        *
+ ********************************************************/
+
+/** Flags of @ref Batch::mask, telling why a row has no result. */
+enum BatchError
+{
+    /** A bound value is not a number, or it is an integer which
+     *  a double cannot hold exactly. */
+    BATCH_TYPE = 1,
+
+    /** A division by 0. */
+    BATCH_DIVZERO = 2,
+
+    /** An integer operation has a result which a double cannot
+     *  hold exactly (a long might, so it is not an error). */
+    BATCH_INEXACT = 4
+};
+
+/** The smallest magnitude of an integer which a double may
+ * not hold exactly (2^53). */
+#define BATCH_EXACT_LIMIT 9007199254740992.0
+
+
+/********************************************************
+ *                      TYPEDEFS                        *
+ ********************************************************/
+
+/** @cond */
+typedef struct Batch Batch;
+/** @endcond */
+
+
+/********************************************************
+ *                     DATA TYPES                       *
+ ********************************************************/
+
+/** Bindings of an expression for many rows, and the means to evaluate it.
+ *
+ * Every value referenced by the expression has a column of numbers,
+ * and row @c r of all columns is one set of bindings (for example,
+ * the values of one file). @ref batchEval then runs each operator
+ * of the postfix expression once, over the whole columns, in plain
+ * loops which the compiler can vectorize, instead of interpreting
+ * the whole expression once per row.
+ *
+ * The loops never branch on the data. Rows which cannot be computed
+ * are flagged in @ref mask instead, and are meant to be evaluated
+ * one by one with @ref evalQueryRange, which also gives the exact
+ * same result for integers, or reports the error.
+ */
+struct Batch
+{
+    /** The query of the expression (only @ref Query::set and
+     * @ref Query::op_stack are used). */
+    const Query *query;
+
+    /** Index of the first token of the expression in @ref Query::op_stack. */
+    size_t beg;
+
+    /** Index one past the last token of the expression. */
+    size_t end;
+
+    /** The maximum number of rows. */
+    size_t capacity;
+
+    /** The value columns, indexed like @ref Query::set, of
+     * @ref capacity elements each (only referenced ones are used). */
+    double *nums;
+
+    /** Same layout as @ref nums, non-zero for integers. */
+    unsigned char *ints;
+
+    /** Flags of @ref BatchError for every row, zero if the row is fine. */
+    unsigned char *mask;
+
+    /** Intermediate result columns, one per level of evaluation depth. */
+    double *stack;
+
+    /** Same layout as @ref stack, non-zero for integers. */
+    unsigned char *istack;
+
+    /** The columns of the operands during evaluation, one per level. */
+    const double **top;
+
+    /** Same as @ref top, for the integer flags. */
+    const unsigned char **itop;
+
+    /** Maximum evaluation depth of the expression. */
+    size_t depth;
+
+    /** If @c true, @ref batchEval may flag rows with
+     * @ref BATCH_DIVZERO, because a divisor is computed. Otherwise
+     * every division by 0 is already flagged by @ref batchBind. */
+    bool late_errors;
+};
+
+
+/********************************************************
+ *                     FUNCTIONS                        *
+ ********************************************************/
+
+/** Creates a batch for a part of a query.
+ *
+ * The expression must consist of values and arithmetic operators
+ * only, without aggregate functions or wildcard references.
+ *
+ * @param[out] batch_ptr Address of the batch, which must be freed
+ * with @ref batchFree.
+ * @param[in] query The query (which must outlive the batch).
+ * @param[in] beg Index of the first token of the expression.
+ * @param[in] end Index one past the last token of the expression.
+ * @param[in] capacity The maximum number of rows.
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error (malloc)
+ * - 2 - internal error (the tokens are not a complete expression)
+ * - 3 - the expression cannot be evaluated in batches
+ */
+int batchCreate(Batch **batch_ptr, const Query *query, size_t beg, size_t end, size_t capacity);
+
+/** Frees all memory owned by a batch. */
+void batchFree(Batch *batch);
+
+/** Copies the values of a row from an arglist.
+ *
+ * The row is checked as it is bound: it is flagged with
+ * @ref BATCH_TYPE if a value cannot be used, and with
+ * @ref BATCH_DIVZERO if a divisor which is a single value is 0.
+ *
+ * @param[inout] batch The batch.
+ * @param[in] row The index of the row (below @ref Batch::capacity).
+ * @param[in] args The arglist of @ref Batch::query with all values
+ * of the expression bound.
+ *
+ * @returns
+ * The flags of the row (also stored in @ref Batch::mask), zero
+ * if it can be evaluated by @ref batchEval.
+ */
+unsigned batchBind(Batch *batch, size_t row, const ArgList *args);
+
+/** Copies the values of a row back into an arglist.
+ *
+ * This is used to evaluate a flagged row with @ref evalQueryRange.
+ * Values already bound in @p args are replaced.
+ *
+ * @param[in] batch The batch.
+ * @param[in] row The index of the row.
+ * @param[inout] args The arglist of @ref Batch::query.
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error (malloc)
+ */
+int batchRebind(const Batch *batch, size_t row, ArgList *args);
+
+/** Evaluates the expression for the first @p rows rows.
+ *
+ * Results are numbers only, like those of @ref evalQueryRange
+ * converted with @ref ARGVAL_NUMBER. Rows which are flagged when
+ * the evaluation ends are left untouched in @p out.
+ *
+ * @param[inout] batch The batch, with rows bound by @ref batchBind.
+ * @param[in] rows The number of rows.
+ * @param[out] out The results, @p rows elements.
+ * @param[out] iout Same layout as @p out, 1 for integer results and
+ * 0 for others (flagged rows are left untouched as well).
+ *
+ * @returns
+ * - 0 - success
+ * - 2 - internal error
+ */
+int batchEval(Batch *batch, size_t rows, double *out, unsigned char *iout);
+
+#endif /* BATCH_H */
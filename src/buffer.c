@@ -0,0 +1,112 @@
+#include "buffer.h"
+#include "query.h"
+#include "arglist.h"
+#include "stack.h"
+#include "stats.h"
+#include "trace.h"
+#include "probes.h"
+#include "alloc.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int bufAppend(Buffer *buf, const char *str, size_t len)
+{
+    /* Enlarge the buffer if needed */
+    if (buf->len + len > buf->size) {
+        size_t size = buf->size? buf->size : BUFFER_INIT_SIZE;
+        char *data;
+
+        while (buf->len + len > size) {
+            size *= 2;
+        }
+        if (!(data = xrealloc(buf->data, size * sizeof *data))) {
+            info("memory error");
+            return 1;
+        }
+        buf->data = data;
+        buf->size = size;
+    }
+
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+
+    return 0;
+}
+
+int bufAppendNumber(Buffer *buf, unsigned long n)
+{
+    char num[ARGVAL_NUMBER_SIZE];
+
+    sprintf(num, "%lu", n);
+
+    return bufAppend(buf, num, strlen(num));
+}
+
+int bufEvalQueries(Buffer *out, const Query **queries, size_t qcount, BufFormat format, void *data)
+{
+    ValStack *vstack; /* evaluation stack */
+    size_t i;
+    int err;
+
+    if (!(vstack = valstackCreate())) {
+        info("memory error");
+        return 1;
+    }
+
+    err = 0;
+    for (i = 0; i < qcount && !err; i++) {
+        ArgVal result;
+        StatsTimer timer;
+        char num[ARGVAL_NUMBER_SIZE];
+
+        statsStartCounted(&timer);
+        traceBegin("evalQuery", "query %lu", (unsigned long)i + 1);
+        PROBE_EVAL_START(i + 1);
+        err = evalQuery(queries[i], vstack, &result);
+        PROBE_EVAL_END(i + 1, err);
+        traceEnd();
+        statsStop(&timer, STATS_EVAL);
+        if (err) {
+            break;
+        }
+
+        statsStart(&timer);
+        if (result.type != ARGVAL_TYPE_STRING) {
+            argValFormatNumber(num, &result);
+        }
+        err = format(out, i, (result.type == ARGVAL_TYPE_STRING)? result.value.s : num, data);
+        statsStop(&timer, STATS_OUTPUT);
+        if (result.type == ARGVAL_TYPE_STRING && result.is_temporary) {
+            xfree(result.value.s);
+        }
+    }
+
+    /* Cleanup */
+    valstackFree(vstack);
+
+    return err;
+}
+
+unsigned long hashBytes(unsigned long h, const char *data, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char)data[i];
+        h *= HASH_PRIME;
+    }
+
+    return h;
+}
+
+unsigned long hashString(unsigned long h, const char *str)
+{
+    do {
+        h ^= (unsigned char)*str;
+        h *= HASH_PRIME;
+    } while (*str++);
+
+    return h;
+}
@@ -0,0 +1,140 @@
+/** @file
+ * Growing byte buffers, hashing bytes and capturing query results.
+ */
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include "query.h"
+#include <stdlib.h>
+
+
+/********************************************************
+ *                     CONSTANTS                        *
+ ********************************************************/
+
+/** The size of the first allocation of a @ref Buffer. */
+#define BUFFER_INIT_SIZE 256
+
+/** The initial value of a hash, to be continued with @ref hashBytes
+ * or @ref hashString.
+ *
+ * Hashes are FNV-1a with the offset basis and prime of its 32-bit
+ * variant, computed in an unsigned long. Where unsigned long is wider
+ * than 32 bits (LP64), the hash is as wide, and it is not the standard
+ * 32-bit FNV-1a value: hashes are only ever compared with each other. */
+#define HASH_INIT 2166136261UL
+
+/** The multiplier of every step of a hash (see @ref HASH_INIT). */
+#define HASH_PRIME 16777619UL
+
+
+/********************************************************
+ *                      TYPEDEFS                        *
+ ********************************************************/
+
+/** @cond */
+typedef struct Buffer Buffer;
+/** @endcond */
+
+/** Appends the result of a query to a buffer.
+ *
+ * @param[inout] buf The buffer.
+ * @param[in] index The index of the query.
+ * @param[in] value The result, printed the way @ref argValPrint would.
+ * @param[in] data The pointer passed to @ref bufEvalQueries.
+ *
+ * @returns 0 on success or 1 on memory error.
+ */
+typedef int (*BufFormat)(Buffer *buf, size_t index, const char *value, void *data);
+
+
+/********************************************************
+ *                     STRUCTURES                       *
+ ********************************************************/
+
+/** A byte buffer which grows as it is appended to.
+ *
+ * An empty buffer has all fields zeroed, and @ref data is freed
+ * with xfree once the buffer is no longer needed.
+ */
+struct Buffer
+{
+    /** The content (not null-terminated, @c NULL until the first append). */
+    char *data;
+
+    /** The length of @ref data. */
+    size_t len;
+
+    /** The size of the memory allocated for @ref data. */
+    size_t size;
+};
+
+
+/********************************************************
+ *                     FUNCTIONS                        *
+ ********************************************************/
+
+/** Appends bytes to a buffer.
+ *
+ * @param[inout] buf The buffer.
+ * @param[in] str The bytes to append.
+ * @param[in] len The number of bytes in @p str.
+ *
+ * @returns 0 on success or 1 on memory error.
+ */
+int bufAppend(Buffer *buf, const char *str, size_t len);
+
+/** Appends an unsigned number in decimal to a buffer.
+ *
+ * @param[inout] buf The buffer.
+ * @param[in] n The number.
+ *
+ * @returns 0 on success or 1 on memory error.
+ */
+int bufAppendNumber(Buffer *buf, unsigned long n);
+
+/** Evaluates a list of bound queries into a buffer.
+ *
+ * Each query is evaluated exactly like by @ref printQueries, but its
+ * result is passed to @p format, which appends it to @p out, instead
+ * of being printed.
+ *
+ * @param[inout] out The buffer. On error, it holds the results of the
+ * queries before the one which failed.
+ * @param[in] queries An ordered list of queries, with values bound.
+ * @param[in] qcount The number of elements in @p queries.
+ * @param[in] format The function which appends each result.
+ * @param[in] data Any pointer, passed to @p format as-is.
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error (malloc/realloc)
+ * - 2 - internal error
+ * - 3 - illegal operation (e.g. multiplying strings)
+ */
+int bufEvalQueries(Buffer *out, const Query **queries, size_t qcount, BufFormat format, void *data);
+
+/** Continues a hash with bytes.
+ *
+ * @param[in] h The hash so far (@ref HASH_INIT to start a new one).
+ * @param[in] data The bytes.
+ * @param[in] len The number of bytes in @p data.
+ *
+ * @returns The hash of all bytes so far.
+ */
+unsigned long hashBytes(unsigned long h, const char *data, size_t len);
+
+/** Continues a hash with a string, including its null byte.
+ *
+ * Because the null byte is hashed, two strings hashed one after
+ * another never hash like any other split of the same characters.
+ *
+ * @param[in] h The hash so far (@ref HASH_INIT to start a new one).
+ * @param[in] str The string.
+ *
+ * @returns The hash of all bytes so far.
+ */
+unsigned long hashString(unsigned long h, const char *str);
+
+#endif /* BUFFER_H */
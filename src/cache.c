@@ -0,0 +1,501 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache.h"
+#include "buffer.h"
+#include "query.h"
+#include "arglist.h"
+#include "dataset.h"
+#include "stack.h"
+#include "stats.h"
+#include "trace.h"
+#include "probes.h"
+#include "alloc.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* A cache entry which may be evicted */
+typedef struct {
+    char *path;
+    unsigned long size;
+    struct timespec mtime;
+} Victim;
+
+static int keyFile(Buffer *key, FILE *file, const struct stat *sb, bool hash);
+static int keyQueries(Buffer *key, const Query **queries, size_t qcount);
+static int lookup(const char *epath, const Buffer *key);
+static int formatLine(Buffer *buf, size_t index, const char *value, void *data);
+static void store(const char *dir, const char *epath, const Buffer *key, const Buffer *out);
+static void account(const char *dir, unsigned long added);
+static unsigned long evict(const char *dir);
+static int compareVictims(const void *a, const void *b);
+static char *entryPath(const char *dir, const char *name);
+
+int runQueriesCached(const char *dir, const char *path, const Query **queries, size_t qcount, bool hash)
+{
+    char name[sizeof CACHE_PREFIX + 2 * sizeof(unsigned long)];
+    struct stat sb;
+    Buffer key, out;
+    FILE *file;
+    char *epath;
+    int err;
+
+    if (!(file = fopen(path, "r"))) {
+        info("failed to open file");
+        return 5;
+    }
+    PROBE_FILE_OPEN(path);
+    if (fstat(fileno(file), &sb) < 0) {
+        info("failed to read file");
+        fclose(file);
+        return 5;
+    }
+
+    /* Only a regular file has an identity which tells if it changed */
+    if (!S_ISREG(sb.st_mode)) {
+        err = runQueries(file, queries, qcount);
+        fclose(file);
+        return err;
+    }
+
+    key.data = out.data = NULL;
+    key.len = key.size = out.len = out.size = 0;
+    epath = NULL;
+
+    /* Temporary convenience macro */
+#define CLEANUP() do { \
+                fclose(file); \
+                xfree(key.data); \
+                xfree(out.data); \
+                xfree(epath); \
+            } while (0)
+
+    traceBegin("cache key", NULL);
+    if (!(err = keyFile(&key, file, &sb, hash)) && keyQueries(&key, queries, qcount)) {
+        err = 1;
+    }
+    traceEnd();
+    if (err) {
+        CLEANUP();
+        return err;
+    }
+    sprintf(name, CACHE_PREFIX "%lx", hashBytes(HASH_INIT, key.data, key.len));
+    if (!(epath = entryPath(dir, name))) {
+        CLEANUP();
+        return 1;
+    }
+
+    /* A hit is answered without reading the file */
+    traceBegin("cache lookup", "%s", name);
+    err = lookup(epath, &key);
+    traceEnd();
+    if (err != 4) {
+        CLEANUP();
+        return err;
+    }
+
+    /* A miss runs the queries, and stores the results if all of them succeed */
+    if ((err = bindQueries(file, queries, qcount))) {
+        if (err == 4) {
+            reportMissing(queries, qcount);
+        }
+        CLEANUP();
+        return err;
+    }
+    err = bufEvalQueries(&out, queries, qcount, formatLine, NULL);
+
+    /* Like printQueries, print the results before a failed query */
+    if (out.len) {
+        StatsTimer timer;
+
+        statsStart(&timer);
+        traceBegin("flush", NULL);
+        if (fwrite(out.data, 1, out.len, stdout) != out.len || fflush(stdout)) {
+            info("failed to write output");
+            err = err? err : 5;
+        }
+        traceEnd();
+        statsStop(&timer, STATS_OUTPUT);
+    }
+    if (!err) {
+        traceBegin("cache store", "%s", name);
+        store(dir, epath, &key, &out);
+        traceEnd();
+    }
+
+    CLEANUP();
+#undef CLEANUP
+
+    return err;
+}
+
+/* Appends the identity of a file to a key: its device, inode, size and
+ * modification time, and the hash of its content if hash is set (the file
+ * is then rewound). Returns 0 on success, 1 on memory error and 5 if the
+ * file could not be read */
+static int keyFile(Buffer *key, FILE *file, const struct stat *sb, bool hash)
+{
+    if (bufAppend(key, "iniget-cache ", 13)
+            || bufAppendNumber(key, CACHE_VERSION)
+            || bufAppend(key, "\nfile ", 6)
+            || bufAppendNumber(key, sb->st_dev)
+            || bufAppend(key, " ", 1)
+            || bufAppendNumber(key, sb->st_ino)
+            || bufAppend(key, " ", 1)
+            || bufAppendNumber(key, sb->st_size)
+            || bufAppend(key, " ", 1)
+            || bufAppendNumber(key, sb->st_mtim.tv_sec)
+            || bufAppend(key, " ", 1)
+            || bufAppendNumber(key, sb->st_mtim.tv_nsec)) {
+        return 1;
+    }
+
+    if (hash) {
+        unsigned long h;
+        size_t n;
+        char *block;
+
+        if (!(block = xmalloc(CACHE_HASH_BLOCK * sizeof *block))) {
+            info("memory error");
+            return 1;
+        }
+        h = HASH_INIT;
+        while ((n = fread(block, 1, CACHE_HASH_BLOCK, file))) {
+            h = hashBytes(h, block, n);
+        }
+        xfree(block);
+        if (ferror(file) || fseek(file, 0, SEEK_SET)) {
+            info("failed to read file");
+            return 5;
+        }
+        if (bufAppend(key, " ", 1) || bufAppendNumber(key, h)) {
+            return 1;
+        }
+    }
+
+    return bufAppend(key, "\n", 1);
+}
+
+/* Appends every compiled query to a key: its postfix operation stack, then
+ * the section/key pairs the stack refers to, in order. Names are prefixed
+ * with their lengths, so that no two lists of queries give the same key.
+ * Returns 0 or 1 on memory error */
+static int keyQueries(Buffer *key, const Query **queries, size_t qcount)
+{
+    size_t i, j;
+
+    for (i = 0; i < qcount; i++) {
+        const Stack *const ops = queries[i]->op_stack; /* shortcut */
+        const DataSet *const set = queries[i]->set;    /* shortcut */
+
+        if (bufAppend(key, "query ", 6) || bufAppendNumber(key, ops->size)) {
+            return 1;
+        }
+        for (j = 0; j < ops->size; j++) {
+            /* Operators are negative */
+            if (bufAppend(key, (ops->data[j] < 0)? " -" : " ", (ops->data[j] < 0)? 2 : 1)
+                    || bufAppendNumber(key, (ops->data[j] < 0)? -(long)ops->data[j] : ops->data[j])) {
+                return 1;
+            }
+        }
+        for (j = 0; j < set->size; j++) {
+            const Data *const data = set->data + j; /* shortcut */
+            const size_t slen = strlen(data->section), klen = strlen(data->key);
+
+            if (bufAppend(key, data->wildcard? "\nwildcard " : "\nref ", data->wildcard? 10 : 5)
+                    || bufAppendNumber(key, slen)
+                    || bufAppend(key, ":", 1)
+                    || bufAppend(key, data->section, slen)
+                    || bufAppend(key, " ", 1)
+                    || bufAppendNumber(key, klen)
+                    || bufAppend(key, ":", 1)
+                    || bufAppend(key, data->key, klen)) {
+                return 1;
+            }
+        }
+        if (bufAppend(key, "\n", 1)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Prints the results stored in an entry if its key matches, and marks the
+ * entry as recently used. An entry consists of the length of its key and a
+ * newline, the key and the results. Returns 0 on a hit, 4 on a miss, 1 on
+ * memory error and 5 if the output could not be written */
+static int lookup(const char *epath, const Buffer *key)
+{
+    struct stat sb;
+    FILE *entry;
+    char *data, *i;
+    size_t size, klen;
+    int err;
+
+    /* Any entry which cannot be read is a miss */
+    if (!(entry = fopen(epath, "r"))) {
+        return 4;
+    }
+    if (fstat(fileno(entry), &sb) < 0 || (size = sb.st_size) < key->len) {
+        fclose(entry);
+        return 4;
+    }
+    if (!(data = xmalloc(size + 1))) {
+        info("memory error");
+        fclose(entry);
+        return 1;
+    }
+    if (fread(data, 1, size, entry) != size) {
+        xfree(data);
+        fclose(entry);
+        return 4;
+    }
+    data[size] = '\0';
+
+    /* The key is compared in full (the name is only its hash) */
+    klen = strtoul(data, &i, 10);
+    if (*i != '\n' || klen != key->len || (size_t)(i + 1 - data) + klen > size
+            || memcmp(i + 1, key->data, klen) != 0) {
+        xfree(data);
+        fclose(entry);
+        return 4;
+    }
+    i += 1 + klen;
+
+    /* Least recently used entries are evicted first */
+    futimens(fileno(entry), NULL);
+    fclose(entry);
+
+    err = 0;
+    if (fwrite(i, 1, size - (i - data), stdout) != size - (size_t)(i - data) || fflush(stdout)) {
+        info("failed to write output");
+        err = 5;
+    }
+    xfree(data);
+
+    return err;
+}
+
+/* Appends a result line, returns 0 or 1 on memory error */
+static int formatLine(Buffer *buf, size_t index, const char *value, void *data)
+{
+    (void)index;
+    (void)data;
+
+    return bufAppend(buf, value, strlen(value)) || bufAppend(buf, "\n", 1);
+}
+
+/* Stores an entry atomically: it is written to a temporary file in the
+ * same directory, which is then renamed over any previous entry. Failures
+ * are only reported, since the results have been printed anyway */
+static void store(const char *dir, const char *epath, const Buffer *key, const Buffer *out)
+{
+    FILE *entry;
+    char *tmp;
+    long size;
+    int fd;
+
+    if (mkdir(dir, 0777) < 0 && errno != EEXIST) {
+        info("%s: failed to create cache directory", dir);
+        return;
+    }
+    if (!(tmp = entryPath(dir, "." CACHE_PREFIX "XXXXXX"))) {
+        return;
+    }
+    if ((fd = mkstemp(tmp)) < 0) {
+        info("%s: failed to write cache entry", dir);
+        xfree(tmp);
+        return;
+    }
+    if (!(entry = fdopen(fd, "w"))) {
+        info("%s: failed to write cache entry", dir);
+        close(fd);
+        unlink(tmp);
+        xfree(tmp);
+        return;
+    }
+
+    fprintf(entry, "%lu\n", (unsigned long)key->len);
+    fwrite(key->data, 1, key->len, entry);
+    if (out->len) {
+        fwrite(out->data, 1, out->len, entry);
+    }
+    size = ftell(entry);
+    fd = ferror(entry) || size < 0;
+    if (fclose(entry)) {
+        fd = 1;
+    }
+    if (fd || rename(tmp, epath) < 0) {
+        info("%s: failed to write cache entry", dir);
+        unlink(tmp);
+        xfree(tmp);
+        return;
+    }
+    xfree(tmp);
+
+    account(dir, size);
+}
+
+/* Adds the size of a new entry to the size counter of a cache directory,
+ * and only when the count exceeds CACHE_MAX_SIZE (or is missing), scans
+ * the directory to evict entries and resets the count to the actual size.
+ * Runs which share the directory take turns on a lock of the counter. The
+ * count may overestimate (e.g. when an entry is replaced), which only makes
+ * the next scan come sooner. Failures are only reported */
+static void account(const char *dir, unsigned long added)
+{
+    struct flock lock;
+    char num[ARGVAL_NUMBER_SIZE];
+    unsigned long total;
+    ssize_t len;
+    char *path;
+    int fd;
+
+    if (!(path = entryPath(dir, CACHE_COUNTER))) {
+        return;
+    }
+    if ((fd = open(path, O_RDWR | O_CREAT, 0666)) < 0) {
+        /* Without a counter, the size is never known */
+        info("%s: failed to open cache size counter", dir);
+        xfree(path);
+        evict(dir);
+        return;
+    }
+    xfree(path);
+
+    /* Without locking (e.g. on some network file systems), concurrent
+     * runs may lose each other's updates, which makes the count smaller */
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = 0;
+    lock.l_len = 0;
+    fcntl(fd, F_SETLKW, &lock);
+
+    if ((len = read(fd, num, sizeof num - 1)) > 0) {
+        num[len] = '\0';
+        total = strtoul(num, NULL, 10);
+        total = (total > ULONG_MAX - added)? ULONG_MAX : total + added;
+    } else {
+        total = ULONG_MAX;
+    }
+    if (total > CACHE_MAX_SIZE) {
+        traceBegin("cache evict", NULL);
+        total = evict(dir);
+        traceEnd();
+    }
+
+    sprintf(num, "%lu\n", total);
+    if (lseek(fd, 0, SEEK_SET) < 0 || ftruncate(fd, 0) < 0
+            || write(fd, num, strlen(num)) != (ssize_t)strlen(num)) {
+        info("%s: failed to update cache size counter", dir);
+    }
+    close(fd);
+}
+
+/* Deletes the least recently used entries of a cache directory if all of
+ * them take more than CACHE_MAX_SIZE bytes, until they take at most
+ * CACHE_EVICT_SIZE bytes. Returns the size of the remaining entries */
+static unsigned long evict(const char *dir)
+{
+    DIR *d;
+    struct dirent *ent;
+    Victim *victims;
+    size_t n, size, i;
+    unsigned long total;
+
+    if (!(d = opendir(dir))) {
+        return 0;
+    }
+
+    victims = NULL;
+    n = size = 0;
+    total = 0;
+    while ((ent = readdir(d))) {
+        struct stat sb;
+        char *path;
+
+        if (strncmp(ent->d_name, CACHE_PREFIX, sizeof CACHE_PREFIX - 1) != 0) {
+            continue;
+        }
+        if (!(path = entryPath(dir, ent->d_name))) {
+            break;
+        }
+
+        /* Another run may have deleted the entry in the meantime */
+        if (stat(path, &sb) < 0 || !S_ISREG(sb.st_mode)) {
+            xfree(path);
+            continue;
+        }
+        if (n == size) {
+            Victim *grown;
+
+            size = size? 2 * size : 64; /* Arbitrary initial size */
+            if (!(grown = xrealloc(victims, size * sizeof *grown))) {
+                info("memory error");
+                xfree(path);
+                break;
+            }
+            victims = grown;
+        }
+        victims[n].path = path;
+        victims[n].size = sb.st_size;
+        victims[n].mtime = sb.st_mtim;
+        total += victims[n].size;
+        n++;
+    }
+    closedir(d);
+
+    if (total > CACHE_MAX_SIZE) {
+        qsort(victims, n, sizeof *victims, compareVictims);
+        for (i = 0; i < n && total > CACHE_EVICT_SIZE; i++) {
+            if (unlink(victims[i].path) == 0 || errno == ENOENT) {
+                total -= victims[i].size;
+            }
+        }
+    }
+
+    /* Cleanup */
+    for (i = 0; i < n; i++) {
+        xfree(victims[i].path);
+    }
+    xfree(victims);
+
+    return total;
+}
+
+/* Orders entries from the least recently used */
+static int compareVictims(const void *a, const void *b)
+{
+    const Victim *const va = a, *const vb = b; /* shortcut */
+
+    if (va->mtime.tv_sec != vb->mtime.tv_sec) {
+        return (va->mtime.tv_sec < vb->mtime.tv_sec)? -1 : 1;
+    }
+    if (va->mtime.tv_nsec != vb->mtime.tv_nsec) {
+        return (va->mtime.tv_nsec < vb->mtime.tv_nsec)? -1 : 1;
+    }
+    return strcmp(va->path, vb->path);
+}
+
+/* Returns the path "dir/name", or NULL on memory error */
+static char *entryPath(const char *dir, const char *name)
+{
+    char *path;
+
+    if (!(path = xmalloc((strlen(dir) + strlen(name) + 2) * sizeof *path))) {
+        info("memory error");
+        return NULL;
+    }
+    sprintf(path, "%s/%s", dir, name);
+
+    return path;
+}
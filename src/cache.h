@@ -0,0 +1,90 @@
+/** @file
+ * Caching query results on disk.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "query.h"
+#include <stdlib.h>
+#include <stdbool.h>
+
+
+/********************************************************
+ *                     CONSTANTS                        *
+ ********************************************************/
+
+/** The version of the entry format, which is part of every key
+ * (so that entries of other versions never match). */
+#define CACHE_VERSION 1
+
+/** The prefix of the names of cache entries in the cache directory.
+ * Other files in the directory are never touched. */
+#define CACHE_PREFIX "iniget-"
+
+/** The total size of the entries (in bytes) above which the least
+ * recently used ones are deleted. */
+#define CACHE_MAX_SIZE (1UL << 24)
+
+/** The total size of the entries (in bytes) which is left once the
+ * least recently used ones are deleted. The gap to @ref CACHE_MAX_SIZE
+ * is filled with new entries before the directory is scanned again. */
+#define CACHE_EVICT_SIZE (CACHE_MAX_SIZE / 4 * 3)
+
+/** The name of the file in the cache directory which keeps count of
+ * the total size of the entries. It does not start with
+ * @ref CACHE_PREFIX, so it is never mistaken for an entry. */
+#define CACHE_COUNTER "iniget.size"
+
+/** The size of the blocks a file is read in to hash its content. */
+#define CACHE_HASH_BLOCK (1UL << 16)
+
+
+/********************************************************
+ *                     FUNCTIONS                        *
+ ********************************************************/
+
+/** Runs a list of queries on a file, reusing earlier results.
+ *
+ * The results of a successful run are stored in @p dir (created if it
+ * does not exist), under a key made of the identity of the file (its
+ * device, inode, size and modification time in nanoseconds, plus a
+ * hash of its content if @p hash is set) and of a serialization of
+ * every compiled query (its postfix operation stack and the
+ * section/key pairs it references). When the key of a run matches a
+ * stored entry, the stored results are printed and the file is not
+ * read at all. Otherwise the queries are run exactly like by
+ * @ref runQueries, with the same output.
+ *
+ * Entries are written to a temporary file which is then renamed, so
+ * that concurrent runs never see a partial entry. The full key is kept
+ * in the entry and compared, so a hash collision of entry names is
+ * only a miss. Every hit refreshes the modification time of its entry.
+ * The size of every new entry is added to a counter kept in
+ * @ref CACHE_COUNTER, and only once the count exceeds
+ * @ref CACHE_MAX_SIZE bytes, the directory is scanned and the least
+ * recently used entries are deleted until all of them take at most
+ * @ref CACHE_EVICT_SIZE bytes. A cache which cannot be written is
+ * reported, but does not fail the run.
+ *
+ * Files which are not regular files are never cached.
+ *
+ * @param[in] dir Path to the cache directory.
+ * @param[in] path Path to the file to run the queries on.
+ * @param[in] queries An ordered list of queries to run.
+ * @param[in] qcount The number of elements in @p queries.
+ * @param[in] hash If @c true, the content of the file is part of the key.
+ * The file is then read once more on every run, but a change which keeps
+ * the size and the modification time (within its precision) is noticed.
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error (malloc/realloc)
+ * - 2 - internal error
+ * - 3 - illegal operation (e.g. multiplying strings)
+ * - 4 - value not found in file
+ * - 5 - failed to open or read the file, or to write the output
+ */
+int runQueriesCached(const char *dir, const char *path, const Query **queries, size_t qcount, bool hash);
+
+#endif /* CACHE_H */
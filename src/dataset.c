@@ -1,4 +1,5 @@
 #include "dataset.h"
+#include "alloc.h"
 #include "error.h"
 #include <stdlib.h>
 #include <string.h>
@@ -7,15 +8,15 @@ DataSet *datasetCreate()
 {
     DataSet *new;
 
-    if (!(new = malloc(sizeof *new))) {
+    if (!(new = xmalloc(sizeof *new))) {
         info("memory error");
         return NULL;
     }
 
     new->capacity = DATASET_INIT_CAPACITY;
-    if (!(new->data = malloc(new->capacity * sizeof *new->data))) {
+    if (!(new->data = xmalloc(new->capacity * sizeof *new->data))) {
         info("memory error");
-        free(new);
+        xfree(new);
         return NULL;
     }
 
@@ -50,7 +51,7 @@ size_t datasetAdd(DataSet *set, const char *section, const char *key)
     /* Increase capacity, if needed */
     if (set->size == set->capacity) {
         set->capacity *= 2;
-        if (!(set->data = realloc(set->data, set->capacity * sizeof *set->data))) {
+        if (!(set->data = xrealloc(set->data, set->capacity * sizeof *set->data))) {
             info("memory error");
             return -1;
         }
@@ -59,11 +60,11 @@ size_t datasetAdd(DataSet *set, const char *section, const char *key)
     /* Allocate buffers for section/key strings */
     size1 = strlen(section) + 1;
     size2 = strlen(key) + 1;
-    if (!(set->data[set->size].section = malloc(size1 * sizeof *set->data[set->size].section))) {
+    if (!(set->data[set->size].section = xmalloc(size1 * sizeof *set->data[set->size].section))) {
         info("memory error");
         return -1;
     }
-    if (!(set->data[set->size].key = malloc(size2 * sizeof *set->data[set->size].key))) {
+    if (!(set->data[set->size].key = xmalloc(size2 * sizeof *set->data[set->size].key))) {
         info("memory error");
         return -1;
     }
@@ -71,10 +72,30 @@ size_t datasetAdd(DataSet *set, const char *section, const char *key)
     /* Copy section/key to their destination */
     strcpy(set->data[set->size].section, section);
     strcpy(set->data[set->size].key, key);
+    set->data[set->size].wildcard = (size1 > 1 && section[size1 - 2] == '*')
+        || (size2 > 1 && key[size2 - 2] == '*');
 
     return set->size++;
 }
 
+bool patternMatches(const char *pattern, const char *name)
+{
+    size_t len = strlen(pattern);
+
+    if (len && pattern[len - 1] == '*') {
+        return strncmp(pattern, name, len - 1) == 0;
+    }
+    return strcmp(pattern, name) == 0;
+}
+
+bool dataMatches(const Data *data, const char *section, const char *key)
+{
+    if (!data->wildcard) {
+        return strcmp(data->section, section) == 0 && strcmp(data->key, key) == 0;
+    }
+    return patternMatches(data->key, key) && patternMatches(data->section, section);
+}
+
 void datasetFree(DataSet *set)
 {
     size_t i;
@@ -86,9 +107,9 @@ void datasetFree(DataSet *set)
     }
 
     for (i = 0; i < set->size; i++) {
-        free(set->data[i].section);
-        free(set->data[i].key);
+        xfree(set->data[i].section);
+        xfree(set->data[i].key);
     }
-    free(set->data);
-    free(set);
+    xfree(set->data);
+    xfree(set);
 }
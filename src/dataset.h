@@ -7,6 +7,7 @@
 
 #include <stdlib.h>
 #include <limits.h>
+#include <stdbool.h>
 
 
 /********************************************************
@@ -41,6 +42,10 @@ typedef struct DataSet DataSet;
  * It is used to reference a single value within a file.
  * The type or existence of this value is not known until
  * access is attempted.
+ *
+ * Both section and key may end with a '*' wildcard, which matches
+ * any (possibly empty) suffix. Such an address references a list
+ * of values instead of a single one.
  */
 struct Data
 {
@@ -49,6 +54,9 @@ struct Data
 
     /** The name of the key. */
     char *key;
+
+    /** True if @ref section or @ref key ends with a wildcard. */
+    bool wildcard;
 };
 
 /** An ordered set of @ref Data elements.
@@ -94,6 +102,27 @@ DataSet *datasetCreate();
  */
 size_t datasetAdd(DataSet *set, const char *section, const char *key);
 
+/** Checks if a name matches a section or key name of a @ref Data address.
+ *
+ * @param[in] pattern The section or key name, possibly ending with a wildcard.
+ * @param[in] name The name to check.
+ *
+ * @returns
+ * @c true if @p name matches @p pattern, @c false otherwise.
+ */
+bool patternMatches(const char *pattern, const char *name);
+
+/** Checks if a section/key pair from a file matches a @ref Data address.
+ *
+ * @param[in] data The address, possibly with wildcards.
+ * @param[in] section The section name from the file.
+ * @param[in] key The key name from the file.
+ *
+ * @returns
+ * @c true if @p section and @p key match @p data, @c false otherwise.
+ */
+bool dataMatches(const Data *data, const char *section, const char *key);
+
 /** Frees all memory owned by the dataset. */
 void datasetFree(DataSet *set);
 
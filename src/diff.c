@@ -0,0 +1,511 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "diff.h"
+#include "buffer.h"
+#include "query.h"
+#include "arglist.h"
+#include "trace.h"
+#include "probes.h"
+#include "alloc.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+/* A section/key pair with its value, or an interned section name (key only) */
+typedef struct {
+    const char *section;  /* interned section name (NULL for a section name) */
+    char *key;
+    ArgVal value;
+    ArgVal other;         /* the value in FILE1, if the table holds FILE2 */
+    unsigned long hash;   /* hash of the section and the key */
+    size_t next;          /* index + 1 of the next entry in the bucket, 0 if none */
+    bool matched;         /* the pair was found in the other file */
+} Entry;
+
+/* A chained hash table, whose entries are kept in insertion order */
+typedef struct {
+    Entry *entries;
+    size_t nentries;
+    size_t esize;
+    size_t *buckets;      /* index + 1 of the first entry in each bucket, 0 if none */
+    size_t nbuckets;      /* always a power of 2 */
+} Table;
+
+/* Reads the key/value pairs of a file one by one */
+typedef struct {
+    FILE *file;
+    char *line;           /* the current line */
+    size_t lsize;         /* the size of line */
+    bool eof;             /* EOF was read */
+    char *section;        /* the current section (NULL before the first header) */
+    unsigned long shash;  /* hash of the current section */
+    size_t nheaders;      /* the number of section headers read so far */
+} Reader;
+
+static int tableInit(Table *t);
+static void tableFree(Table *t);
+static Entry *tableFind(const Table *t, const char *section, const char *key, unsigned long hash);
+static Entry *tableAdd(Table *t, const char *section, char *key, unsigned long hash);
+static const char *intern(Table *sections, const Reader *r);
+static int readerOpen(Reader *r, const char *path);
+static void readerClose(Reader *r);
+static int readPair(Reader *r, char **key, ArgVal *value);
+static long fileSize(const char *path);
+static bool argValEqual(const ArgVal *a, const ArgVal *b);
+static const char *typeName(const ArgVal *val);
+static void printDiff(bool *differ, const char *section, const char *key, const ArgVal *a, const ArgVal *b);
+
+int diffFiles(const char *path_a, const char *path_b, bool *differ)
+{
+    Table sections; /* interned section names of both files */
+    Table pairs;    /* the pairs of the smaller file */
+    Table extra;    /* the pairs only in the larger file (values kept if it is FILE1) */
+    Reader r;
+    const char *small, *large;
+    const char *section;  /* the interned current section */
+    size_t nheaders;      /* the value of Reader::nheaders section belongs to */
+    long size_a, size_b;
+    bool small_is_a;
+    size_t i;
+    int err;
+
+    *differ = false;
+    if (strcmp(path_a, "-") == 0 && strcmp(path_b, "-") == 0) {
+        info("cannot compare standard input with itself");
+        return 5;
+    }
+
+    /* The smaller file goes into the table (streams are never smaller) */
+    size_a = fileSize(path_a);
+    size_b = fileSize(path_b);
+    small_is_a = size_a >= 0 && (size_b < 0 || size_a <= size_b);
+    small = small_is_a? path_a : path_b;
+    large = small_is_a? path_b : path_a;
+
+    if (tableInit(&sections)) {
+        return 1;
+    }
+    if (tableInit(&pairs)) {
+        tableFree(&sections);
+        return 1;
+    }
+    if (tableInit(&extra)) {
+        tableFree(&sections);
+        tableFree(&pairs);
+        return 1;
+    }
+
+    /* Temporary convenience macro */
+#define CLEANUP() do { \
+                tableFree(&sections); \
+                tableFree(&pairs); \
+                tableFree(&extra); \
+            } while (0)
+
+    /* Build: store the first occurrence of every pair of the smaller file */
+    if ((err = readerOpen(&r, small))) {
+        CLEANUP();
+        return err;
+    }
+    traceBegin("diff build", "%s", small);
+    section = NULL;
+    nheaders = (size_t)-1;
+    for (;;) {
+        char *key;
+        ArgVal value;
+        unsigned long hash;
+        Entry *e;
+
+        if ((err = readPair(&r, &key, &value))) {
+            break;
+        }
+        if (nheaders != r.nheaders) {
+            if (!(section = intern(&sections, &r))) {
+                err = 1;
+                break;
+            }
+            nheaders = r.nheaders;
+        }
+
+        hash = hashString(r.shash, key);
+        if (tableFind(&pairs, section, key, hash)) {
+            /* Only the first occurrence counts */
+            xfree(key);
+            if (value.type == ARGVAL_TYPE_STRING) {
+                xfree(value.value.s);
+            }
+            continue;
+        }
+        if (!(e = tableAdd(&pairs, section, key, hash))) {
+            xfree(key);
+            if (value.type == ARGVAL_TYPE_STRING) {
+                xfree(value.value.s);
+            }
+            err = 1;
+            break;
+        }
+        e->value = value;
+    }
+    traceEnd();
+    readerClose(&r);
+    if (err != EOF) {
+        CLEANUP();
+        return err;
+    }
+
+    /* Probe: look up every pair of the larger file */
+    if ((err = readerOpen(&r, large))) {
+        CLEANUP();
+        return err;
+    }
+    traceBegin("diff probe", "%s", large);
+    section = NULL;
+    nheaders = (size_t)-1;
+    for (;;) {
+        char *key;
+        ArgVal value;
+        unsigned long hash;
+        Entry *e;
+
+        if ((err = readPair(&r, &key, &value))) {
+            break;
+        }
+        if (nheaders != r.nheaders) {
+            if (!(section = intern(&sections, &r))) {
+                err = 1;
+                break;
+            }
+            nheaders = r.nheaders;
+        }
+
+        /* Lines are printed in the order of FILE2, so those of FILE1 wait */
+        hash = hashString(r.shash, key);
+        if ((e = tableFind(&pairs, section, key, hash))) {
+            if (!e->matched && small_is_a) {
+                if (!argValEqual(&e->value, &value)) {
+                    printDiff(differ, section, key, &e->value, &value);
+                }
+            } else if (!e->matched) {
+                e->other = value;
+                value.type = ARGVAL_TYPE_NONE;
+            }
+            e->matched = true;
+            xfree(key);
+        } else if (tableFind(&extra, section, key, hash)) {
+            xfree(key);
+        } else if (!(e = tableAdd(&extra, section, key, hash))) {
+            xfree(key);
+            err = 1;
+        } else if (small_is_a) {
+            printDiff(differ, section, key, NULL, &value);
+        } else {
+            e->value = value;
+            value.type = ARGVAL_TYPE_NONE;
+        }
+        if (value.type == ARGVAL_TYPE_STRING) {
+            xfree(value.value.s);
+        }
+        if (err) {
+            break;
+        }
+    }
+    traceEnd();
+    readerClose(&r);
+    if (err != EOF) {
+        CLEANUP();
+        return err;
+    }
+
+    /* The rest of FILE2, then the pairs only in FILE1, each in its order */
+    for (i = 0; i < pairs.nentries; i++) {
+        const Entry *const e = pairs.entries + i; /* shortcut */
+
+        if (small_is_a && !e->matched) {
+            printDiff(differ, e->section, e->key, &e->value, NULL);
+        } else if (!small_is_a && !e->matched) {
+            printDiff(differ, e->section, e->key, NULL, &e->value);
+        } else if (!small_is_a && !argValEqual(&e->other, &e->value)) {
+            printDiff(differ, e->section, e->key, &e->other, &e->value);
+        }
+    }
+    for (i = 0; i < extra.nentries && !small_is_a; i++) {
+        const Entry *const e = extra.entries + i; /* shortcut */
+
+        printDiff(differ, e->section, e->key, &e->value, NULL);
+    }
+
+    CLEANUP();
+#undef CLEANUP
+
+    if (fflush(stdout) || ferror(stdout)) {
+        info("failed to write output");
+        return 5;
+    }
+
+    return 0;
+}
+
+/* Returns 0 on success and 1 on memory error */
+static int tableInit(Table *t)
+{
+    t->nentries = 0;
+    t->esize = DIFF_INIT_BUCKETS;
+    t->nbuckets = DIFF_INIT_BUCKETS;
+    t->entries = xmalloc(t->esize * sizeof *t->entries);
+    t->buckets = xcalloc(t->nbuckets, sizeof *t->buckets);
+    if (!t->entries || !t->buckets) {
+        info("memory error");
+        xfree(t->entries);
+        xfree(t->buckets);
+        return 1;
+    }
+    return 0;
+}
+
+static void tableFree(Table *t)
+{
+    size_t i;
+
+    for (i = 0; i < t->nentries; i++) {
+        xfree(t->entries[i].key);
+        if (t->entries[i].value.type == ARGVAL_TYPE_STRING) {
+            xfree(t->entries[i].value.value.s);
+        }
+        if (t->entries[i].other.type == ARGVAL_TYPE_STRING) {
+            xfree(t->entries[i].other.value.s);
+        }
+    }
+    xfree(t->entries);
+    xfree(t->buckets);
+}
+
+/* Returns the entry of a pair, or NULL if there is none. Sections are
+ * interned, so they are compared by address */
+static Entry *tableFind(const Table *t, const char *section, const char *key, unsigned long hash)
+{
+    size_t i;
+
+    for (i = t->buckets[hash & (t->nbuckets - 1)]; i; i = t->entries[i - 1].next) {
+        Entry *const e = t->entries + i - 1; /* shortcut */
+
+        if (e->hash == hash && e->section == section && strcmp(e->key, key) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/* Adds a pair which is not in the table yet, taking over the key. The values
+ * of the new entry are of type ARGVAL_TYPE_NONE. Returns the new entry, or
+ * NULL on memory error */
+static Entry *tableAdd(Table *t, const char *section, char *key, unsigned long hash)
+{
+    Entry *e;
+    size_t b;
+
+    if (t->nentries == t->esize) {
+        Entry *entries;
+
+        if (!(entries = xrealloc(t->entries, 2 * t->esize * sizeof *entries))) {
+            info("memory error");
+            return NULL;
+        }
+        t->entries = entries;
+        t->esize *= 2;
+    }
+
+    /* Keep the load factor under 3/4 */
+    if (t->nentries + 1 > t->nbuckets / 4 * 3) {
+        size_t *buckets, i;
+
+        if (!(buckets = xcalloc(2 * t->nbuckets, sizeof *buckets))) {
+            info("memory error");
+            return NULL;
+        }
+        xfree(t->buckets);
+        t->buckets = buckets;
+        t->nbuckets *= 2;
+        for (i = 0; i < t->nentries; i++) {
+            b = t->entries[i].hash & (t->nbuckets - 1);
+            t->entries[i].next = t->buckets[b];
+            t->buckets[b] = i + 1;
+        }
+    }
+
+    e = t->entries + t->nentries++;
+    e->section = section;
+    e->key = key;
+    e->value.type = ARGVAL_TYPE_NONE;
+    e->other.type = ARGVAL_TYPE_NONE;
+    e->hash = hash;
+    e->matched = false;
+    b = hash & (t->nbuckets - 1);
+    e->next = t->buckets[b];
+    t->buckets[b] = t->nentries;
+
+    return e;
+}
+
+/* Returns the interned name of the current section of a reader,
+ * or NULL on memory error */
+static const char *intern(Table *sections, const Reader *r)
+{
+    const char *const name = r->section? r->section : ""; /* shortcut */
+    Entry *e;
+    char *copy;
+
+    if ((e = tableFind(sections, NULL, name, r->shash))) {
+        return e->key;
+    }
+    if (!(copy = xmalloc((strlen(name) + 1) * sizeof *copy))) {
+        info("memory error");
+        return NULL;
+    }
+    strcpy(copy, name);
+    if (!(e = tableAdd(sections, NULL, copy, r->shash))) {
+        xfree(copy);
+        return NULL;
+    }
+    return e->key;
+}
+
+/* Returns 0 on success, 1 on memory error and 5 if the file failed to open */
+static int readerOpen(Reader *r, const char *path)
+{
+    if (strcmp(path, "-") == 0) {
+        r->file = stdin;
+    } else if (!(r->file = fopen(path, "r"))) {
+        info("%s: failed to open file", path);
+        return 5;
+    } else {
+        PROBE_FILE_OPEN(path);
+    }
+
+    r->lsize = 256; /* Arbitrary non-zero initial size */
+    if (!(r->line = xmalloc(r->lsize * sizeof *r->line))) {
+        info("memory error");
+        if (r->file != stdin) {
+            fclose(r->file);
+        }
+        return 1;
+    }
+    r->eof = false;
+    r->section = NULL;
+    r->shash = hashString(HASH_INIT, "");
+    r->nheaders = 0;
+
+    return 0;
+}
+
+static void readerClose(Reader *r)
+{
+    if (r->file != stdin) {
+        fclose(r->file);
+    }
+    xfree(r->line);
+    xfree(r->section);
+}
+
+/* Reads up to the next key/value pair, whose key and value the caller must
+ * free. Returns 0 on success, EOF at end of file, 1 on memory error or error
+ * in the file and 2 on internal error */
+static int readPair(Reader *r, char **key, ArgVal *value)
+{
+    while (!r->eof) {
+        IniToken tok;
+
+        switch (getLine(r->file, &r->line, &r->lsize)) {
+            case 0:
+                break;
+            case EOF:
+                r->eof = true;
+                break;
+            case 1:
+                return 1;
+            default:
+                STAMP();
+                error("getLine internal error");
+                return 2;
+        }
+
+        tok = iniExtractFromLine(r->line);
+        switch (tok.type) {
+            case INI_LINE_KVPAIR:
+                *key = tok.content.kvpair.key;
+                *value = tok.content.kvpair.value;
+                return 0;
+            case INI_LINE_SECTION:
+                xfree(r->section);
+                r->section = tok.content.section;
+                r->shash = hashString(HASH_INIT, r->section);
+                r->nheaders++;
+                PROBE_SECTION(r->section);
+                break;
+            case INI_LINE_BLANK:
+                break;
+            case INI_LINE_ERROR:
+                return 1;
+            case INI_LINE_INTERROR:
+                STAMP();
+                error("iniExtractFromLine internal error");
+                return 2;
+            default:
+                STAMP();
+                error("unmatched IniLineType %d", tok.type);
+                return 2;
+        }
+    }
+
+    return EOF;
+}
+
+/* Returns the size of a regular file, or -1 for anything else */
+static long fileSize(const char *path)
+{
+    struct stat sb;
+
+    if (strcmp(path, "-") == 0 || stat(path, &sb) < 0 || !S_ISREG(sb.st_mode)) {
+        return -1;
+    }
+    return sb.st_size;
+}
+
+/* Compares two values after typing (integers and floats by value) */
+static bool argValEqual(const ArgVal *a, const ArgVal *b)
+{
+    if (a->type == ARGVAL_TYPE_STRING || b->type == ARGVAL_TYPE_STRING) {
+        return a->type == b->type && strcmp(a->value.s, b->value.s) == 0;
+    }
+    if (a->type == ARGVAL_TYPE_INT && b->type == ARGVAL_TYPE_INT) {
+        return a->value.i == b->value.i;
+    }
+    return ARGVAL_NUMBER(*a) == ARGVAL_NUMBER(*b);
+}
+
+/* Returns the name of the type of a value, like --dump prints it */
+static const char *typeName(const ArgVal *val)
+{
+    return (val->type == ARGVAL_TYPE_STRING)? "string"
+        : (val->type == ARGVAL_TYPE_INT)? "int" : "float";
+}
+
+/* Prints a line of differences between the value in FILE1 (a) and in FILE2
+ * (b), either of which is NULL if the pair is not in that file, and records
+ * that the files differ */
+static void printDiff(bool *differ, const char *section, const char *key, const ArgVal *a, const ArgVal *b)
+{
+    printf("%c\t%s\t%s", (a && b)? '~' : a? '-' : '+', section, key);
+    if (a) {
+        printf("\t%s\t", typeName(a));
+        argValPrint(stdout, a);
+    }
+    if (b) {
+        printf("\t%s\t", typeName(b));
+        argValPrint(stdout, b);
+    }
+    putchar('\n');
+    *differ = true;
+}
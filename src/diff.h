@@ -0,0 +1,63 @@
+/** @file
+ * Comparing the key/value pairs of two files.
+ */
+
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+
+/********************************************************
+ *                     CONSTANTS                        *
+ ********************************************************/
+
+/** The initial number of buckets of a hash table (a power of 2). */
+#define DIFF_INIT_BUCKETS 256
+
+
+/********************************************************
+ *                     FUNCTIONS                        *
+ ********************************************************/
+
+/** Prints the differences between the key/value pairs of two files.
+ *
+ * Pairs are identified by their section and key. Like a query, only
+ * the first occurrence of a pair in a file counts. Values are compared
+ * after typing: numbers are equal if they have the same value (so 1.0
+ * equals 1), strings if they have the same bytes, and a string never
+ * equals a number. Every difference is a line of tab-separated fields:
+ * - "+", section, key, type, value - the pair is only in @p path_b,
+ * - "-", section, key, type, value - the pair is only in @p path_a,
+ * - "~", section, key, type and value in @p path_a, type and value
+ *   in @p path_b.
+ *
+ * Types are "string", "int" and "float", and values are printed like
+ * query results, exactly like by @ref dumpFile. The section of keys
+ * before the first section header is empty.
+ *
+ * Both files are read once, line by line. The pairs of the smaller one
+ * (by size, stdin and other streams count as the larger) are stored in
+ * a hash table, and every pair of the larger one is looked up in it, so
+ * the run time is linear. Memory is bounded by the smaller file plus
+ * the differences: the keys of the pairs only in the larger file (to
+ * report each of them once) and, if the larger file is @p path_a, the
+ * values of its pairs which are printed after all others. Whichever
+ * file is larger, the "+" and "~" lines come first, in the order of
+ * @p path_b, followed by the "-" lines, in the order of @p path_a.
+ *
+ * @param[in] path_a Path to the old file ("-" for stdin).
+ * @param[in] path_b Path to the new file ("-" for stdin).
+ * @param[out] differ Set to @c true if any difference was printed.
+ *
+ * @returns
+ * - 0 - success (whether the files differ or not, see @p differ)
+ * - 1 - memory error (malloc/realloc), or error in a file
+ * - 2 - internal error
+ * - 5 - failed to open a file, or both are stdin, or failed to
+ *   write the output
+ */
+int diffFiles(const char *path_a, const char *path_b, bool *differ);
+
+#endif /* DIFF_H */
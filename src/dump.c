@@ -0,0 +1,357 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "dump.h"
+#include "query.h"
+#include "arglist.h"
+#include "trace.h"
+#include "probes.h"
+#include "alloc.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* The state of a dump */
+typedef struct {
+    char sep;         /* the byte after every field but the last */
+    char end;         /* the byte after the last field of a record */
+    char *head;       /* the current line, up to its first '=' */
+    size_t hsize;     /* the size of head */
+    char *section;    /* the current section (NULL before the first header) */
+    char *out;        /* the output buffer, of DUMP_BUFFER_SIZE bytes */
+    size_t olen;      /* the number of bytes in out */
+} Dump;
+
+static int dumpPath(Dump *dump, const char *path);
+static int dumpStream(Dump *dump, FILE *file);
+static int dumpRange(Dump *dump, const char *beg, const char *end);
+static int dumpLine(Dump *dump, const char *beg, const char *eol);
+static int dumpField(Dump *dump, const char *str, size_t len, bool last);
+static bool isCanonical(const char *beg, const char *end, ArgValType type);
+
+int dumpFile(const char *path, bool nul)
+{
+    Dump dump;
+    int err;
+
+    dump.sep = nul? '\0' : '\t';
+    dump.end = nul? '\0' : '\n';
+    dump.section = NULL;
+    dump.olen = 0;
+    dump.hsize = 256; /* Arbitrary non-zero initial size */
+    if (!(dump.head = xmalloc(dump.hsize * sizeof *dump.head))) {
+        info("memory error");
+        return 1;
+    }
+    if (!(dump.out = xmalloc(DUMP_BUFFER_SIZE * sizeof *dump.out))) {
+        info("memory error");
+        xfree(dump.head);
+        return 1;
+    }
+
+    traceBegin("dump", "%s", path);
+    if (strcmp(path, "-") == 0) {
+        err = dumpStream(&dump, stdin);
+    } else {
+        err = dumpPath(&dump, path);
+    }
+    traceEnd();
+
+    /* Write out the rest, even after an error (like a partial output
+     * of runQueries, the records before the error are valid) */
+    traceBegin("flush", NULL);
+    if ((dump.olen && fwrite(dump.out, 1, dump.olen, stdout) != dump.olen) || fflush(stdout)) {
+        info("failed to write output");
+        err = err? err : 5;
+    }
+    traceEnd();
+
+    /* Cleanup */
+    xfree(dump.head);
+    xfree(dump.section);
+    xfree(dump.out);
+
+    return err;
+}
+
+/* Dumps a file, mapping it if it is a regular file. Returns 0 on success,
+ * 1 on memory error or error in the file, 2 on internal error and 5 if
+ * the file could not be opened or read */
+static int dumpPath(Dump *dump, const char *path)
+{
+    struct stat sb;
+    FILE *file;
+    int fd, err;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        info("failed to open file");
+        return 5;
+    }
+    PROBE_FILE_OPEN(path);
+    if (fstat(fd, &sb) < 0) {
+        info("failed to read file");
+        close(fd);
+        return 5;
+    }
+
+    /* Keys and strings are written straight from the mapping */
+    if (S_ISREG(sb.st_mode)) {
+        const size_t len = sb.st_size;
+        void *map;
+
+        err = 0;
+        if (len && (map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+            info("failed to map file");
+            err = 5;
+        } else if (len) {
+            posix_madvise(map, len, POSIX_MADV_SEQUENTIAL);
+            err = dumpRange(dump, map, (const char*)map + len);
+            munmap(map, len);
+        }
+        close(fd);
+        return err;
+    }
+
+    /* Anything else (e.g. a pipe) is read line by line */
+    if (!(file = fdopen(fd, "r"))) {
+        info("failed to read file");
+        close(fd);
+        return 5;
+    }
+    err = dumpStream(dump, file);
+    fclose(file);
+
+    return err;
+}
+
+/* Dumps a file read line by line. Returns 0 on success, 1 on memory error
+ * or error in the file and 2 on internal error */
+static int dumpStream(Dump *dump, FILE *file)
+{
+    char  *line;    /* Stores an entire line from file */
+    size_t lsize;   /* Remembers the line size */
+    bool   eof;     /* True if EOF was read */
+    int    err;
+
+    lsize = 256; /* Arbitrary non-zero initial size */
+    if (!(line = xmalloc(lsize * sizeof *line))) {
+        info("memory error");
+        return 1;
+    }
+
+    err = 0;
+    eof = false;
+    while (!err && !eof) {
+        switch (getLine(file, &line, &lsize)) {
+            case 0:
+                break;
+            case EOF:
+                eof = true;
+                break;
+            case 1:
+                xfree(line);
+                return 1;
+            default:
+                STAMP();
+                error("getLine internal error");
+                xfree(line);
+                return 2;
+        }
+        err = dumpLine(dump, line, line + strlen(line));
+    }
+
+    xfree(line);
+
+    return err;
+}
+
+/* Dumps a file in memory. Returns the same as dumpStream */
+static int dumpRange(Dump *dump, const char *beg, const char *end)
+{
+    int err;
+
+    err = 0;
+    while (beg < end && !err) {
+        const char *eol;
+
+        if (!(eol = memchr(beg, '\n', end - beg))) {
+            eol = end;
+        }
+        err = dumpLine(dump, beg, eol);
+        beg = eol + 1;
+    }
+
+    return err;
+}
+
+/* Dumps a line [beg, eol) if it is a key/value pair, or remembers its section.
+ * Returns the same as dumpStream */
+static int dumpLine(Dump *dump, const char *beg, const char *eol)
+{
+    const char *val, *vbeg, *vend;
+    const char *type;
+    char num[ARGVAL_NUMBER_SIZE];
+    IniToken tok;
+    ArgVal value;
+    size_t n;
+
+    /* Only the line head is copied, the value is parsed where it is */
+    val = memchr(beg, '=', eol - beg);
+    val = val? val + 1 : eol;
+    n = val - beg;
+    if (n + 1 > dump->hsize) {
+        while (n + 1 > dump->hsize) {
+            dump->hsize *= 2;
+        }
+        if (!(dump->head = xrealloc(dump->head, dump->hsize * sizeof *dump->head))) {
+            info("memory error");
+            return 1;
+        }
+    }
+    memcpy(dump->head, beg, n);
+    dump->head[n] = '\0';
+
+    tok = iniExtractFromHead(dump->head);
+    switch (tok.type) {
+        case INI_LINE_KVPAIR:
+            break;
+        case INI_LINE_SECTION:
+            xfree(dump->section);
+            dump->section = tok.content.section;
+            PROBE_SECTION(dump->section);
+            return 0;
+        case INI_LINE_BLANK:
+            return 0;
+        case INI_LINE_ERROR:
+            return 1;
+        case INI_LINE_INTERROR:
+            STAMP();
+            error("iniExtractFromHead internal error");
+            return 2;
+        default:
+            STAMP();
+            error("unmatched IniLineType %d", tok.type);
+            return 2;
+    }
+
+    /* Type the value, and format it unless it is a string, or a
+     * number which is already written the way it would be printed */
+    if (!iniValueValid(val, eol)) {
+        xfree(tok.content.kvpair.key);
+        return 1;
+    }
+    vbeg = val;
+    vend = eol;
+    switch ((value.type = argValLocate(&vbeg, &vend))) {
+        case ARGVAL_TYPE_STRING:
+            type = "string";
+            break;
+        case ARGVAL_TYPE_INT:
+        case ARGVAL_TYPE_FLOAT:
+            if (isCanonical(vbeg, vend, value.type)) {
+                type = (value.type == ARGVAL_TYPE_INT)? "int" : "float";
+                break;
+            }
+            if ((value = argValFromRange(vbeg, vend)).type == ARGVAL_TYPE_NONE) {
+                xfree(tok.content.kvpair.key);
+                return 1;
+            }
+            type = (value.type == ARGVAL_TYPE_INT)? "int" : "float";
+            argValFormatNumber(num, &value);
+            vbeg = num;
+            vend = num + strlen(num);
+            break;
+        default:
+            STAMP();
+            error("unexpected value type");
+            xfree(tok.content.kvpair.key);
+            return 2;
+    }
+
+    if (dumpField(dump, dump->section? dump->section : "", dump->section? strlen(dump->section) : 0, false)
+            || dumpField(dump, tok.content.kvpair.key, strlen(tok.content.kvpair.key), false)
+            || dumpField(dump, type, strlen(type), false)
+            || dumpField(dump, vbeg, vend - vbeg, true)) {
+        xfree(tok.content.kvpair.key);
+        return 5;
+    }
+    xfree(tok.content.kvpair.key);
+
+    return 0;
+}
+
+/* Appends a field followed by its separator to the output buffer, and writes
+ * the buffer out when it is full. Returns 0 on success and 5 on write error */
+static int dumpField(Dump *dump, const char *str, size_t len, bool last)
+{
+    if (dump->olen + len + 1 > DUMP_BUFFER_SIZE) {
+        if (fwrite(dump->out, 1, dump->olen, stdout) != dump->olen) {
+            info("failed to write output");
+            return 5;
+        }
+        dump->olen = 0;
+
+        /* A field which does not fit is written directly */
+        if (len + 1 > DUMP_BUFFER_SIZE) {
+            if (fwrite(str, 1, len, stdout) != len || putchar(last? dump->end : dump->sep) == EOF) {
+                info("failed to write output");
+                return 5;
+            }
+            return 0;
+        }
+    }
+
+    memcpy(dump->out + dump->olen, str, len);
+    dump->olen += len;
+    dump->out[dump->olen++] = last? dump->end : dump->sep;
+
+    return 0;
+}
+
+/* Returns true if a number is written exactly the way argValFormatNumber
+ * would print it ("%ld", or "%.10g" with a period), so that it can be
+ * copied as it is. Integers must certainly fit in a long, and floats may
+ * have at most 10 significant digits, which survive a round trip */
+static bool isCanonical(const char *beg, const char *end, ArgValType type)
+{
+    const char *first;  /* the first digit */
+    const char *period; /* the end of the integer part */
+    const char *i;
+
+    /* An optional minus, then no leading zeros (but "-0" is printed as "0") */
+    first = (beg < end && *beg == '-')? beg + 1 : beg;
+    if (first == end || !isdigit((unsigned char)*first)
+            || (*first == '0' && ((first + 1 < end && first[1] != '.') || (first + 1 == end && first != beg)))) {
+        return false;
+    }
+    for (period = first; period < end && isdigit((unsigned char)*period); period++)
+        ;
+    if (type == ARGVAL_TYPE_INT) {
+        return period == end && (size_t)(end - first) <= (sizeof(long) * CHAR_BIT - 1) * 3 / 10;
+    }
+
+    /* A float needs a period and fractional digits without trailing zeros */
+    if (period == end || *period != '.' || period + 1 == end || end[-1] == '0') {
+        return false;
+    }
+    for (i = period + 1; i < end && isdigit((unsigned char)*i); i++)
+        ;
+    if (i != end) {
+        return false;
+    }
+
+    /* Below 1e-4, the number would be printed with an exponent */
+    if (*first == '0') {
+        for (i = period + 1; *i == '0'; i++)
+            ;
+        return i - period - 1 <= 3 && end - i <= 10;
+    }
+    return (period - first) + (end - period - 1) <= 10;
+}
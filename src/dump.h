@@ -0,0 +1,54 @@
+/** @file
+ * Printing all key/value pairs of a file as records.
+ */
+
+#ifndef DUMP_H
+#define DUMP_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+
+/********************************************************
+ *                     CONSTANTS                        *
+ ********************************************************/
+
+/** The size of the output buffer (in bytes). */
+#define DUMP_BUFFER_SIZE (1UL << 16)
+
+
+/********************************************************
+ *                     FUNCTIONS                        *
+ ********************************************************/
+
+/** Prints every key/value pair of a file, in file order.
+ *
+ * Each pair is printed as a record of four fields: the section
+ * (empty before the first section header), the key, the type of the
+ * value ("string", "int" or "float") and the value, exactly as a
+ * query referencing it would print it. Lines are parsed the same way
+ * as by @ref runQueries, and the first erroneous line stops the dump.
+ *
+ * With @p nul unset, fields are separated by tabs and records end with
+ * a newline. Values may contain tabs, though, so with @p nul set,
+ * every field is followed by a null byte instead (no field can
+ * contain one).
+ *
+ * A regular file is memory-mapped. Strings, and numbers which are
+ * already written the way they are printed, are copied straight from
+ * the mapping into an output buffer of @ref DUMP_BUFFER_SIZE bytes,
+ * which is written out whenever it is full. Other files (e.g. stdin)
+ * are read line by line.
+ *
+ * @param[in] path Path to the file to dump ("-" for stdin).
+ * @param[in] nul If @c true, fields end with a null byte.
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error (malloc/realloc), or error in the file
+ * - 2 - internal error
+ * - 5 - failed to open or read the file, or to write the output
+ */
+int dumpFile(const char *path, bool nul);
+
+#endif /* DUMP_H */
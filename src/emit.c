@@ -0,0 +1,899 @@
+#include "emit.h"
+#include "query.h"
+#include "dataset.h"
+#include "alloc.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdbool.h>
+
+/* A name to be matched by the generated program, and what it maps to */
+typedef struct {
+    const char *name;
+    size_t len;
+    int id;
+} Name;
+
+/* The generated program is assembled from these fixed parts and the
+ * generated ones (values, matchers and queries) in-between. The parts
+ * are split into chunks, because C89 compilers are only required to
+ * support string literals of 509 characters. */
+
+/* Includes and types of the generated program */
+static const char *const prologue[] = {
+"#include <stdio.h>\n"
+"#include <stdlib.h>\n"
+"#include <string.h>\n"
+"#include <stdarg.h>\n"
+"#include <ctype.h>\n"
+"#include <math.h>\n"
+"#include <limits.h>\n"
+"\n"
+"/* Exit statuses, the same as iniget's */\n"
+"enum {\n"
+"    RET_SUCCESS = 0,\n"
+"    RET_FILE_ERROR = 1,\n"
+"    RET_INVALID_QUERY = 2,\n"
+"    RET_VALUE_NOT_FOUND = 3,\n"
+"    RET_INVALID_OPTION = 4,\n"
+"    RET_MEMORY_ERROR = -2\n"
+"};\n",
+"\n"
+"/* Value types */\n"
+"enum { T_NONE, T_FLOAT, T_INT, T_STR };\n"
+"\n"
+"/* Aggregate functions (of a single value) */\n"
+"enum { AGG_SUM, AGG_MIN, AGG_MAX, AGG_AVG, AGG_COUNT, AGG_JOIN };\n"
+"\n"
+"/* A value read from the file or computed by a query */\n"
+"typedef struct {\n"
+"    int type;    /* one of T_* */\n"
+"    double f;    /* the number, if type is T_FLOAT */\n"
+"    long i;      /* the number, if type is T_INT */\n"
+"    char *s;     /* the string, if type is T_STR */\n",
+"    int temp;    /* non-zero if s is an intermediate result to be freed */\n"
+"} Val;\n"
+"\n"
+"/* The value of a number of either type, as a double */\n"
+"#define NUM(v) (((v).type == T_INT)? (double)(v).i : (v).f)\n"
+"\n",
+    NULL
+};
+
+/* Reading the file, after the matchers */
+static const char *const scanner[] = {
+"static void info(const char *fmt, ...)\n"
+"{\n"
+"    va_list ap;\n"
+"\n"
+"    va_start(ap, fmt);\n"
+"    fputs(\"iniget: \", stderr);\n"
+"    vfprintf(stderr, fmt, ap);\n"
+"    putc('\\n', stderr);\n"
+"    va_end(ap);\n"
+"}\n"
+"\n"
+"static void release(Val *val)\n"
+"{\n"
+"    if (val->type == T_STR && val->temp) {\n"
+"        free(val->s);\n"
+"    }\n"
+"}\n"
+"\n"
+"/* Types a value like iniget does, returns 0 or 1 (memory error) */\n"
+"static int setValue(Val *val, const char *beg)\n"
+"{\n"
+"    const char *end, *i;\n"
+"    unsigned long n, limit;\n"
+"    int periods;\n",
+"\n"
+"    end = beg + strlen(beg) - 1;\n"
+"    while (isspace((unsigned char)*end))\n"
+"        end--;\n"
+"\n"
+"    if (end > beg && *beg == '\"' && *end == '\"') {\n"
+"        beg++;\n"
+"        end--;\n"
+"    } else {\n"
+"        val->type = T_FLOAT;\n"
+"        for (i = beg, periods = 0; i <= end; i++) {\n"
+"            if ((*i != '.' && !isdigit((unsigned char)*i) && !(*i == '-' && i == beg))\n"
+"                    || (*i == '.' && ++periods != 1)) {\n"
+"                val->type = T_STR;\n"
+"                break;\n",
+"            }\n"
+"        }\n"
+"        if (val->type == T_FLOAT && periods == 0 && !(*beg == '-' && beg == end)) {\n"
+"            /* An integer, if it fits in a long */\n"
+"            limit = (*beg == '-')? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX;\n"
+"            for (n = 0, i = beg + (*beg == '-'); i <= end; i++) {\n"
+"                if (n > (limit - (*i - '0')) / 10) {\n"
+"                    break;\n"
+"                }\n"
+"                n = n * 10 + (*i - '0');\n"
+"            }\n",
+"            if (i > end) {\n"
+"                val->type = T_INT;\n"
+"                val->i = (*beg == '-' && n)? -(long)(n - 1) - 1 : (long)n;\n"
+"                return 0;\n"
+"            }\n"
+"        }\n"
+"        if (val->type == T_FLOAT) {\n"
+"            val->f = atof(beg);\n"
+"            return 0;\n"
+"        }\n"
+"    }\n"
+"\n"
+"    if (!(val->s = malloc(end - beg + 2))) {\n"
+"        info(\"memory error\");\n"
+"        return 1;\n"
+"    }\n"
+"    memcpy(val->s, beg, end - beg + 1);\n"
+"    val->s[end - beg + 1] = '\\0';\n",
+"    val->type = T_STR;\n"
+"    val->temp = 0;\n"
+"    return 0;\n"
+"}\n"
+"\n"
+"/* Interprets a line of the file, returns 0 or 1 (error in the file) */\n"
+"static int scanLine(const char *line, int *section, size_t *remaining)\n"
+"{\n"
+"    const char *i, *j;\n"
+"    int slot;\n"
+"\n"
+"    i = line;\n"
+"    while (isspace((unsigned char)*i))\n"
+"        i++;\n",
+"\n"
+"    if (*i == '[') {\n"
+"        j = ++i;\n"
+"        while (*i && *i != ']') {\n"
+"            if (!isalnum((unsigned char)*i) && *i != '-' && *i != '_') {\n"
+"                info(\"error found in file (illegal character '%c' in section name)\", *i);\n"
+"                return 1;\n"
+"            }\n"
+"            i++;\n"
+"        }\n"
+"        if (*i != ']') {\n"
+"            info(\"error found in file (no closing bracket after section name)\");\n"
+"            return 1;\n"
+"        }\n",
+"        *section = matchSection(j, i - j);\n"
+"    } else if (isalnum((unsigned char)*i) || *i == '_' || *i == '-') {\n"
+"        j = i;\n"
+"        while (*i && !isspace((unsigned char)*i) && *i != '=')\n"
+"            i++;\n"
+"        slot = (*i && *section >= 0)? matchKey(*section, j, i - j) : -1;\n"
+"        while (*i && *i != '=')\n"
+"            i++;\n"
+"        if (*i == '=') {\n"
+"            i++;\n"
+"            while (isspace((unsigned char)*i))\n"
+"                i++;\n"
+"        }\n"
+"        if (!*i) {\n",
+"            info(\"error found in file (no value after key name)\");\n"
+"            return 1;\n"
+"        }\n"
+"        if (slot >= 0 && vals[slot].type == T_NONE) {\n"
+"            if (setValue(vals + slot, i)) {\n"
+"                return 1;\n"
+"            }\n"
+"            (*remaining)--;\n"
+"        }\n"
+"    } else if (*i != ';' && *i) {\n"
+"        info(\"error found in file (invalid byte %#x)\", *i);\n"
+"        return 1;\n"
+"    }\n",
+"\n"
+"    return 0;\n"
+"}\n"
+"\n"
+"/* Reads the file until all values are found, returns 0, 1 (error) or 4 (not found) */\n"
+"static int scan(FILE *file)\n"
+"{\n"
+"    char *line, *tmp;\n"
+"    size_t size, pos, remaining;\n"
+"    int c, section;\n"
+"\n"
+"    size = 256;\n"
+"    if (!(line = malloc(size))) {\n"
+"        info(\"memory error\");\n"
+"        return 1;\n"
+"    }\n"
+"    section = matchSection(\"\", 0);\n"
+"    remaining = NVALUES;\n",
+"\n"
+"    do {\n"
+"        pos = 0;\n"
+"        while ((c = getc(file)) != EOF && c != '\\n') {\n"
+"            if (pos == size - 1) {\n"
+"                size *= 2;\n"
+"                if (!(tmp = realloc(line, size))) {\n"
+"                    info(\"memory error\");\n"
+"                    free(line);\n"
+"                    return 1;\n"
+"                }\n"
+"                line = tmp;\n"
+"            }\n"
+"            line[pos++] = c;\n"
+"        }\n"
+"        line[pos] = '\\0';\n",
+"\n"
+"        if (scanLine(line, &section, &remaining)) {\n"
+"            free(line);\n"
+"            return 1;\n"
+"        }\n"
+"    } while (c != EOF && remaining);\n"
+"\n"
+"    free(line);\n"
+"    return remaining? 4 : 0;\n"
+"}\n"
+"\n",
+    NULL
+};
+
+/* Integer arithmetic and operators involving strings, if a query has any operators */
+static const char *const operators[] = {
+"/* Returns non-zero if a * b does not fit in a long */\n"
+"static int mulOverflows(long a, long b)\n"
+"{\n"
+"    if (a == 0 || b == 0) {\n"
+"        return 0;\n"
+"    }\n"
+"    if (a > 0) {\n"
+"        return (b > 0)? a > LONG_MAX / b : b < LONG_MIN / a;\n"
+"    }\n"
+"    return (b > 0)? a < LONG_MIN / b : b < LONG_MAX / a;\n"
+"}\n"
+"\n"
+"/* Applies an operator to two integers, returns 0 or 1 if the result\n"
+" * must be computed on floats (like iniget, see intOperation there) */\n",
+"static int intOp(int op, long a, long b, long *r)\n"
+"{\n"
+"    long acc;\n"
+"\n"
+"    switch (op) {\n"
+"        case '+':\n"
+"            if ((b > 0 && a > LONG_MAX - b) || (b < 0 && a < LONG_MIN - b)) {\n"
+"                return 1;\n"
+"            }\n"
+"            *r = a + b;\n"
+"            return 0;\n"
+"        case '-':\n"
+"            if ((b < 0 && a > LONG_MAX + b) || (b > 0 && a < LONG_MIN + b)) {\n"
+"                return 1;\n"
+"            }\n"
+"            *r = a - b;\n"
+"            return 0;\n"
+"        case '*':\n",
+"            if (mulOverflows(a, b)) {\n"
+"                return 1;\n"
+"            }\n"
+"            *r = a * b;\n"
+"            return 0;\n"
+"        case '%':\n"
+"            if (b == 0 || a == LONG_MIN || b == LONG_MIN) {\n"
+"                return 1;\n"
+"            }\n"
+"            *r = (a < 0)? -(labs(a) % labs(b)) : labs(a) % labs(b);\n"
+"            return 0;\n"
+"        case '^':\n"
+"            if (b < 0) {\n"
+"                return 1;\n"
+"            }\n"
+"            for (acc = 1; b; b /= 2) {\n",
+"                if (b % 2) {\n"
+"                    if (mulOverflows(acc, a)) {\n"
+"                        return 1;\n"
+"                    }\n"
+"                    acc *= a;\n"
+"                }\n"
+"                if (b > 1) {\n"
+"                    if (mulOverflows(a, a)) {\n"
+"                        return 1;\n"
+"                    }\n"
+"                    a *= a;\n"
+"                }\n"
+"            }\n"
+"            *r = acc;\n"
+"            return 0;\n"
+"    }\n"
+"    return 1;\n"
+"}\n",
+"\n"
+"/* Applies an operator to two values which are not both numbers,\n"
+" * returns 0, 1 (memory error) or 3 (illegal operation) */\n"
+"static int mixed(int op, Val *a, Val *b, Val *r)\n"
+"{\n"
+"    const char *str;\n"
+"    double num;\n"
+"    size_t len, n, k;\n"
+"    int err;\n"
+"\n"
+"    err = 0;\n"
+"    if (a->type == T_STR && b->type == T_STR) {\n"
+"        if (op == '+') {\n"
+"            len = strlen(a->s);\n"
+"            if (!(r->s = malloc(len + strlen(b->s) + 1))) {\n"
+"                info(\"memory error\");\n",
+"                err = 1;\n"
+"            } else {\n"
+"                strcpy(r->s, a->s);\n"
+"                strcpy(r->s + len, b->s);\n"
+"            }\n"
+"        } else {\n"
+"            info(\"illegal operation on two strings\");\n"
+"            err = 3;\n"
+"        }\n"
+"    } else if (op == '*') {\n"
+"        if (a->type == T_STR) {\n"
+"            str = a->s;\n"
+"            num = NUM(*b);\n"
+"        } else {\n"
+"            str = b->s;\n"
+"            num = NUM(*a);\n"
+"        }\n"
+"        len = strlen(str);\n",
+"        if (num > (double)ULONG_MAX) {\n"
+"            info(\"cannot multiply a string by %.0g (factor too large)\", num);\n"
+"            err = 3;\n"
+"        } else if (num > (double)ULONG_MAX / len - 1) {\n"
+"            info(\"cannot multiply a string by %.0g (resulting string too long)\", num);\n"
+"            err = 3;\n"
+"        } else if (!(r->s = malloc(len * (n = (size_t)num) + 1))) {\n"
+"            info(\"memory error\");\n"
+"            err = 1;\n"
+"        } else {\n"
+"            for (k = 0; k < n; k++) {\n",
+"                memcpy(r->s + k * len, str, len);\n"
+"            }\n"
+"            r->s[len * n] = '\\0';\n"
+"        }\n"
+"    } else {\n"
+"        info(\"illegal operation on a string and a number\");\n"
+"        err = 3;\n"
+"    }\n"
+"\n"
+"    release(a);\n"
+"    release(b);\n"
+"    r->type = T_STR;\n"
+"    r->temp = 1;\n"
+"    return err;\n"
+"}\n"
+"\n",
+    NULL
+};
+
+/* Aggregate functions, if a query has any */
+static const char *const aggregates[] = {
+"/* Applies an aggregate function to a single value,\n"
+" * returns 0, 1 (memory error) or 3 (illegal operation) */\n"
+"static int aggregate(int fn, Val *v, Val *r)\n"
+"{\n"
+"    static const char *const names[] = { \"sum\", \"min\", \"max\", \"avg\" };\n"
+"    char buf[32];\n"
+"\n"
+"    *r = *v;\n"
+"    if (fn == AGG_COUNT) {\n"
+"        release(v);\n"
+"        r->type = T_INT;\n"
+"        r->i = 1;\n"
+"    } else if (v->type == T_STR && fn != AGG_JOIN) {\n",
+"        info(\"illegal operation (cannot aggregate a string with %s)\", names[fn]);\n"
+"        release(v);\n"
+"        return 3;\n"
+"    } else if (v->type != T_STR && fn == AGG_JOIN) {\n"
+"        if (v->type == T_INT) {\n"
+"            sprintf(buf, \"%ld\", v->i);\n"
+"        } else {\n"
+"            sprintf(buf, \"%.10g\", v->f);\n"
+"        }\n"
+"        if (!(r->s = malloc(strlen(buf) + 1))) {\n"
+"            info(\"memory error\");\n"
+"            return 1;\n"
+"        }\n"
+"        strcpy(r->s, buf);\n"
+"        r->type = T_STR;\n",
+"        r->temp = 1;\n"
+"    }\n"
+"    return 0;\n"
+"}\n"
+"\n",
+    NULL
+};
+
+/* The main function, after the queries */
+static const char *const epilogue[] = {
+"int main(int argc, char **argv)\n"
+"{\n"
+"    FILE *file;\n"
+"    Val result;\n"
+"    size_t i;\n"
+"    int err;\n"
+"\n"
+"    if (argc != 2) {\n"
+"        fprintf(stderr, \"usage: %s FILE\\n\", argv[0]);\n"
+"        return RET_INVALID_OPTION;\n"
+"    }\n"
+"    if (strcmp(argv[1], \"-\") == 0) {\n"
+"        file = stdin;\n"
+"    } else if (!(file = fopen(argv[1], \"r\"))) {\n"
+"        info(\"failed to open file\");\n"
+"        return RET_FILE_ERROR;\n"
+"    }\n",
+"\n"
+"    err = scan(file);\n"
+"    fclose(file);\n"
+"    if (err == 4) {\n"
+"        info(\"failed to find the following values:\");\n"
+"        for (i = 0; i < sizeof refs / sizeof *refs; i++) {\n"
+"            if (vals[refs[i].slot].type == T_NONE) {\n"
+"                fprintf(stderr, \"->\\t%s\\n\", refs[i].name);\n"
+"            }\n"
+"        }\n"
+"        return RET_VALUE_NOT_FOUND;\n"
+"    } else if (err) {\n"
+"        return RET_MEMORY_ERROR;\n"
+"    }\n",
+"\n"
+"    for (i = 0; i < sizeof queries / sizeof *queries; i++) {\n"
+"        if ((err = queries[i](&result))) {\n"
+"            return (err == 3)? RET_INVALID_QUERY : RET_MEMORY_ERROR;\n"
+"        }\n"
+"        if (result.type == T_STR) {\n"
+"            fputs(result.s, stdout);\n"
+"            release(&result);\n"
+"        } else if (result.type == T_INT) {\n"
+"            printf(\"%ld\", result.i);\n"
+"        } else {\n"
+"            printf(\"%.10g\", result.f);\n"
+"        }\n"
+"        putchar('\\n');\n"
+"    }\n",
+"\n"
+"    for (i = 0; i < NVALUES; i++) {\n"
+"        if (vals[i].type == T_STR) {\n"
+"            free(vals[i].s);\n"
+"        }\n"
+"    }\n"
+"\n"
+"    return RET_SUCCESS;\n"
+"}\n",
+    NULL
+};
+
+/* Names of the generated aggregate constants, indexed like opNames */
+static const char *const aggNames[OP_COUNT] = {
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+    "AGG_SUM", "AGG_MIN", "AGG_MAX", "AGG_AVG", "AGG_COUNT", "AGG_JOIN"
+};
+
+/* Inlined floating-point arithmetic of binary operators on two numbered temporaries */
+static const char *const opExprs[OP_COUNT] = {
+    NULL, "NUM(t%d) + NUM(t%d)", "NUM(t%d) - NUM(t%d)", "NUM(t%d) * NUM(t%d)",
+    "NUM(t%d) / NUM(t%d)", "fmod(NUM(t%d), NUM(t%d))", NULL, NULL, "pow(NUM(t%d), NUM(t%d))"
+};
+
+/* Operator characters passed to the generated mixed() */
+static const char opChars[OP_COUNT] = {
+    0, '+', '-', '*', '/', '%', 0, 0, '^'
+};
+
+static void emitChunks(FILE *out, const char *const *chunks);
+static void emitComment(FILE *out, const char *str);
+static int nameCompare(const void *a, const void *b);
+static size_t bestPosition(const Name *names, size_t n);
+static void emitMatcher(FILE *out, Name *names, size_t n, int indent);
+static int emitQuery(FILE *out, const Query *query, const int *slots, const char *str, size_t num);
+
+int emitQueries(FILE *out, const Query **queries, char *const *strs, size_t qcount)
+{
+    const Data **values; /* distinct referenced values, indexed by slot */
+    int *slots;          /* the slot of every reference, query after query */
+    int *secs;           /* the section (index into names) of every slot */
+    Name *names;         /* buffer for the names of a matcher */
+    size_t nrefs, nvalues, nsecs, i, j, k, r;
+    bool ops, aggs;      /* whether any query has operators or aggregates */
+    int err;
+
+    /* Count the references and see which helpers are needed */
+    nrefs = 0;
+    ops = aggs = false;
+    for (i = 0; i < qcount; i++) {
+        for (j = 0; j < queries[i]->op_stack->size; j++) {
+            if (OP_IS_AGGREGATE(queries[i]->op_stack->data[j])) {
+                aggs = true;
+            } else if (queries[i]->op_stack->data[j] < 0) {
+                ops = true;
+            }
+        }
+        for (j = 0; j < queries[i]->set->size; j++) {
+            if (queries[i]->set->data[j].wildcard) {
+                info("--emit-c does not support wildcards (query %lu)", (unsigned long)i + 1);
+                return 3;
+            }
+        }
+        nrefs += queries[i]->set->size;
+    }
+
+    /* Allocate space (one extra element keeps the sizes non-zero) */
+    values = xmalloc((nrefs + 1) * sizeof *values);
+    slots = xmalloc((nrefs + 1) * sizeof *slots);
+    secs = xmalloc((nrefs + 1) * sizeof *secs);
+    names = xmalloc((nrefs + 1) * sizeof *names);
+    if (!values || !slots || !secs || !names) {
+        info("memory error");
+        xfree(values);
+        xfree(slots);
+        xfree(secs);
+        xfree(names);
+        return 1;
+    }
+
+    /* Temporary convenience macro */
+#define CLEANUP() do { \
+                    xfree(values); \
+                    xfree(slots); \
+                    xfree(secs); \
+                    xfree(names); \
+                } while (0)
+
+    /* Give every distinct section/key pair a slot */
+    nvalues = 0;
+    for (i = 0, r = 0; i < qcount; i++) {
+        for (j = 0; j < queries[i]->set->size; j++, r++) {
+            const Data *const data = queries[i]->set->data + j; /* shortcut */
+
+            for (k = 0; k < nvalues; k++) {
+                if (strcmp(values[k]->section, data->section) == 0
+                        && strcmp(values[k]->key, data->key) == 0) {
+                    break;
+                }
+            }
+            if (k == nvalues) {
+                values[nvalues++] = data;
+            }
+            slots[r] = k;
+        }
+    }
+
+    /* Number the distinct sections */
+    nsecs = 0;
+    for (k = 0; k < nvalues; k++) {
+        for (j = 0; j < nsecs; j++) {
+            if (strcmp(names[j].name, values[k]->section) == 0) {
+                break;
+            }
+        }
+        if (j == nsecs) {
+            names[nsecs].name = values[k]->section;
+            names[nsecs].len = strlen(values[k]->section);
+            names[nsecs].id = nsecs;
+            nsecs++;
+        }
+        secs[k] = j;
+    }
+
+    /* Header */
+    fputs("/* Generated by iniget --emit-c, do not edit.\n"
+          " *\n"
+          " * A standalone program running the following queries:\n", out);
+    for (i = 0; i < qcount; i++) {
+        fprintf(out, " *   %lu: ", (unsigned long)i + 1);
+        emitComment(out, strs[i]);
+        putc('\n', out);
+    }
+    fputs(" *\n"
+          " * Build it with e.g. \"cc -O2 -o extract extract.c -lm\" and run it\n"
+          " * as \"extract FILE\" (or \"-\" for stdin). The output, messages and\n"
+          " * exit status are the same as those of iniget with these queries.\n"
+          " */\n\n", out);
+    emitChunks(out, prologue);
+
+    /* Values and references */
+    fprintf(out, "/* The number of distinct values referenced by the queries */\n"
+                 "#define NVALUES %lu\n\n"
+                 "/* The values, in order of first reference */\n"
+                 "static Val vals[NVALUES];\n\n"
+                 "/* Every reference of every query, for reporting missing values */\n"
+                 "static const struct {\n"
+                 "    int slot;\n"
+                 "    const char *name;\n"
+                 "} refs[] = {\n", (unsigned long)nvalues);
+    for (i = 0, r = 0; i < qcount; i++) {
+        for (j = 0; j < queries[i]->set->size; j++, r++) {
+            const Data *const data = queries[i]->set->data + j; /* shortcut */
+
+            fprintf(out, "    { %d, \"%s%s%s\" }%s\n", slots[r], data->section,
+                    (*data->section)? "." : "", data->key, (r + 1 < nrefs)? "," : "");
+        }
+    }
+    fputs("};\n\n", out);
+
+    /* Section matcher (section and key names only consist of
+     * alphanumeric characters, '-' and '_', so need no escaping) */
+    fputs("/* Returns the number of a referenced section, or -1 */\n"
+          "static int matchSection(const char *s, size_t len)\n"
+          "{\n", out);
+    if (nsecs == 1 && names[0].len == 0) {
+        fputs("    (void)s; /* only the global section is referenced */\n", out);
+    }
+    emitMatcher(out, names, nsecs, 4);
+    fputs("    return -1;\n"
+          "}\n\n", out);
+
+    /* Key matcher */
+    fputs("/* Returns the slot of a key of a referenced section, or -1 */\n"
+          "static int matchKey(int section, const char *s, size_t len)\n"
+          "{\n"
+          "    switch (section) {\n", out);
+    for (j = 0; j < nsecs; j++) {
+        size_t nkeys = 0;
+
+        for (k = 0; k < nvalues; k++) {
+            if (secs[k] == (int)j) {
+                names[nkeys].name = values[k]->key;
+                names[nkeys].len = strlen(values[k]->key);
+                names[nkeys].id = k;
+                nkeys++;
+            }
+        }
+        fprintf(out, "        case %lu:\n", (unsigned long)j);
+        emitMatcher(out, names, nkeys, 12);
+        fputs("            break;\n", out);
+    }
+    fputs("    }\n"
+          "    return -1;\n"
+          "}\n\n", out);
+
+    emitChunks(out, scanner);
+    if (ops) {
+        emitChunks(out, operators);
+    }
+    if (aggs) {
+        emitChunks(out, aggregates);
+    }
+
+    /* Queries */
+    for (i = 0, r = 0; i < qcount; i++) {
+        if ((err = emitQuery(out, queries[i], slots + r, strs[i], i + 1))) {
+            CLEANUP();
+            return err;
+        }
+        r += queries[i]->set->size;
+    }
+    fputs("/* The queries, in order of output */\n"
+          "static int (*const queries[])(Val *) = {\n", out);
+    for (i = 0; i < qcount; i++) {
+        fprintf(out, "    query%lu%s\n", (unsigned long)i + 1, (i + 1 < qcount)? "," : "");
+    }
+    fputs("};\n\n", out);
+
+    emitChunks(out, epilogue);
+
+    CLEANUP();
+#undef CLEANUP
+
+    if (fflush(out) || ferror(out)) {
+        info("failed to write the program");
+        return 5;
+    }
+
+    return 0;
+}
+
+static void emitChunks(FILE *out, const char *const *chunks)
+{
+    const char *const *chunk;
+
+    for (chunk = chunks; *chunk; chunk++) {
+        fputs(*chunk, out);
+    }
+}
+
+/* Writes a string so that it can't end or break a comment */
+static void emitComment(FILE *out, const char *str)
+{
+    for (; *str; str++) {
+        if (*str == '\n') {
+            putc(' ', out);
+        } else {
+            putc(*str, out);
+            if (*str == '*' && str[1] == '/') {
+                putc(' ', out);
+            }
+        }
+    }
+}
+
+/* Orders names by length, then by content */
+static int nameCompare(const void *a, const void *b)
+{
+    const Name *const na = a, *const nb = b; /* shortcuts */
+
+    if (na->len != nb->len) {
+        return (na->len < nb->len)? -1 : 1;
+    }
+    return memcmp(na->name, nb->name, na->len);
+}
+
+/* Returns the position where names of the same length differ the most */
+static size_t bestPosition(const Name *names, size_t n)
+{
+    bool seen[UCHAR_MAX + 1];
+    size_t pos, best, bestcount, count, i;
+
+    best = bestcount = 0;
+    for (pos = 0; pos < names[0].len; pos++) {
+        memset(seen, 0, sizeof seen);
+        count = 0;
+        for (i = 0; i < n; i++) {
+            unsigned char c = names[i].name[pos];
+            if (!seen[c]) {
+                seen[c] = true;
+                count++;
+            }
+        }
+        if (count > bestcount) {
+            best = pos;
+            bestcount = count;
+        }
+    }
+
+    return best;
+}
+
+/* Emits a switch returning the id of the name equal to the first len
+ * bytes of s, which falls through if there is none. The switch is on
+ * the length, and then on the most distinctive character, so that at
+ * most a few names are compared. */
+static void emitMatcher(FILE *out, Name *names, size_t n, int indent)
+{
+    size_t i, end, k, m, pos;
+
+    if (n == 0) {
+        return;
+    }
+    qsort(names, n, sizeof *names, nameCompare);
+
+    fprintf(out, "%*sswitch (len) {\n", indent, "");
+    for (i = 0; i < n; i = end) {
+        for (end = i + 1; end < n && names[end].len == names[i].len; end++)
+            ;
+        fprintf(out, "%*scase %lu:\n", indent + 4, "", (unsigned long)names[i].len);
+
+        if (names[i].len == 0) {
+            fprintf(out, "%*sreturn %d;\n", indent + 8, "", names[i].id);
+            continue;
+        }
+        if (end - i == 1) {
+            fprintf(out, "%*sif (memcmp(s, \"%s\", %lu) == 0) {\n"
+                         "%*sreturn %d;\n"
+                         "%*s}\n"
+                         "%*sbreak;\n",
+                    indent + 8, "", names[i].name, (unsigned long)names[i].len,
+                    indent + 12, "", names[i].id, indent + 8, "", indent + 8, "");
+            continue;
+        }
+
+        /* Several names of this length */
+        pos = bestPosition(names + i, end - i);
+        fprintf(out, "%*sswitch (s[%lu]) {\n", indent + 8, "", (unsigned long)pos);
+        for (k = i; k < end; k++) {
+            /* Skip characters which already have a case */
+            for (m = i; m < k && names[m].name[pos] != names[k].name[pos]; m++)
+                ;
+            if (m < k) {
+                continue;
+            }
+            fprintf(out, "%*scase '%c':\n", indent + 12, "", names[k].name[pos]);
+            for (m = k; m < end; m++) {
+                if (names[m].name[pos] == names[k].name[pos]) {
+                    fprintf(out, "%*sif (memcmp(s, \"%s\", %lu) == 0) {\n"
+                                 "%*sreturn %d;\n"
+                                 "%*s}\n",
+                            indent + 16, "", names[m].name, (unsigned long)names[m].len,
+                            indent + 20, "", names[m].id, indent + 16, "");
+                }
+            }
+            fprintf(out, "%*sbreak;\n", indent + 16, "");
+        }
+        fprintf(out, "%*s}\n"
+                     "%*sbreak;\n", indent + 8, "", indent + 8, "");
+    }
+    fprintf(out, "%*s}\n", indent, "");
+}
+
+/* Emits a query as a function of straight-line code, which follows the
+ * postfix stack with a temporary for every token. Returns like emitQueries. */
+static int emitQuery(FILE *out, const Query *query, const int *slots, const char *str, size_t num)
+{
+    const Stack *const op_stack = query->op_stack; /* shortcut */
+    int *stack;  /* the temporaries which would be on the value stack */
+    size_t top, j;
+
+    if (!(stack = xmalloc((op_stack->size + 1) * sizeof *stack))) {
+        info("memory error");
+        return 1;
+    }
+
+    fputs("/* ", out);
+    emitComment(out, str);
+    fprintf(out, " */\n"
+                 "static int query%lu(Val *r)\n"
+                 "{\n"
+                 "    Val t0", (unsigned long)num);
+    for (j = 1; j < op_stack->size; j++) {
+        fprintf(out, ", t%lu", (unsigned long)j);
+    }
+    fputs((op_stack->size > 1)? ";\n    int err;\n\n" : ";\n\n", out);
+
+    top = 0;
+    for (j = 0; j < op_stack->size; j++) {
+        const int idx = op_stack->data[j]; /* shortcut */
+
+        if (idx >= 0) {
+            if ((size_t)idx >= query->set->size) {
+                STAMP();
+                error("op_stack index (%d) out of DataSet range (%d)", idx, query->set->size);
+                xfree(stack);
+                return 2;
+            }
+            fprintf(out, "    t%lu = vals[%d];\n", (unsigned long)j, slots[idx]);
+        } else if (OP_IS_AGGREGATE(idx) && top >= 1) {
+            fprintf(out, "    if ((err = aggregate(%s, &t%d, &t%lu))) {\n"
+                         "        return err;\n"
+                         "    }\n", aggNames[-idx], stack[--top], (unsigned long)j);
+        } else if (idx > -OP_COUNT && opExprs[-idx] && top >= 2) {
+            const int b = stack[--top], a = stack[--top];
+
+            /* Exactly on integers (except for division), on floats if that fails */
+            if (idx != OP_DIV) {
+                /* (f is set too, only to tell compilers that NUM() never reads garbage) */
+                fprintf(out, "    if (t%d.type == T_INT && t%d.type == T_INT && intOp('%c', t%d.i, t%d.i, &t%lu.i) == 0) {\n"
+                             "        t%lu.type = T_INT;\n"
+                             "        t%lu.f = 0;\n"
+                             "    } else ", a, b, opChars[-idx], a, b, (unsigned long)j, (unsigned long)j, (unsigned long)j);
+            } else {
+                fputs("    ", out);
+            }
+            fprintf(out, "if (t%d.type != T_STR && t%d.type != T_STR) {\n", a, b);
+            if (idx == OP_DIV) {
+                fprintf(out, "        if (NUM(t%d) == 0) {\n"
+                             "            info(\"cannot divide by 0\");\n"
+                             "            return 3;\n"
+                             "        }\n", b);
+            }
+            fprintf(out, "        t%lu.type = T_FLOAT;\n"
+                         "        t%lu.f = ", (unsigned long)j, (unsigned long)j);
+            fprintf(out, opExprs[-idx], a, b);
+            fprintf(out, ";\n"
+                         "    } else if ((err = mixed('%c', &t%d, &t%d, &t%lu))) {\n"
+                         "        return err;\n"
+                         "    }\n", opChars[-idx], a, b, (unsigned long)j);
+        } else {
+            STAMP();
+            error("invalid token (%d) in op_stack", idx);
+            xfree(stack);
+            return 2;
+        }
+        stack[top++] = j;
+    }
+    if (top != 1) {
+        STAMP();
+        error("query leaves %lu values", (unsigned long)top);
+        xfree(stack);
+        return 2;
+    }
+
+    fprintf(out, "\n"
+                 "    *r = t%d;\n"
+                 "    return 0;\n"
+                 "}\n\n", stack[0]);
+
+    xfree(stack);
+    return 0;
+}
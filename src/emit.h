@@ -0,0 +1,47 @@
+/** @file
+ * Generating a specialized C program for a fixed list of queries.
+ */
+
+#ifndef EMIT_H
+#define EMIT_H
+
+#include "query.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/********************************************************
+ *                     FUNCTIONS                        *
+ ********************************************************/
+
+/** Writes a standalone C source file which runs a list of queries.
+ *
+ * The generated program takes a single file argument (or "-" for
+ * stdin) and behaves like iniget run with the same queries: same
+ * output, messages and exit status. Nothing is interpreted at
+ * runtime, though:
+ * - the referenced sections and keys are matched by nested
+ *   switches on the name length and its most distinctive
+ *   character, followed by a single memcmp,
+ * - every query is a function of straight-line code following
+ *   its postfix stack, with numeric operators inlined (only
+ *   operations involving strings call a helper).
+ *
+ * The program is plain C89 and needs only the math library.
+ *
+ * @param[out] out The stream to write the source to.
+ * @param[in] queries An ordered list of queries to compile.
+ * @param[in] strs The query strings @p queries were parsed from
+ * (for comments in the source).
+ * @param[in] qcount The number of elements in @p queries.
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error (malloc)
+ * - 2 - internal error
+ * - 3 - a query has a wildcard reference, which is not supported
+ * - 5 - failed to write to @p out
+ */
+int emitQueries(FILE *out, const Query **queries, char *const *strs, size_t qcount);
+
+#endif /* EMIT_H */
@@ -0,0 +1,90 @@
+#include "export.h"
+#include "buffer.h"
+#include "query.h"
+#include "stats.h"
+#include "trace.h"
+#include "alloc.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+static int formatAssignment(Buffer *buf, size_t index, const char *value, void *data);
+static int bufAppendQuoted(Buffer *buf, const char *str);
+
+char *exportQuery(const char *assignment)
+{
+    const char *i = assignment;
+
+    if (!isalpha((unsigned char)*i) && *i != '_') {
+        return NULL;
+    }
+    while (isalnum((unsigned char)*i) || *i == '_')
+        i++;
+
+    return (*i == '=')? (char*)i + 1 : NULL;
+}
+
+int exportQueries(FILE *file, const Query **queries, char *const *assignments, size_t qcount)
+{
+    Buffer out; /* the output of all queries, written at once */
+    int err;
+
+    if ((err = bindQueries(file, queries, qcount))) {
+        if (err == 4) {
+            reportMissing(queries, qcount);
+        }
+        return err;
+    }
+
+    out.data = NULL;
+    out.len = out.size = 0;
+    err = bufEvalQueries(&out, queries, qcount, formatAssignment, (void*)assignments);
+
+    /* Print all or nothing */
+    if (!err) {
+        StatsTimer timer;
+
+        statsStart(&timer);
+        traceBegin("flush", NULL);
+        if (fwrite(out.data, 1, out.len, stdout) != out.len || fflush(stdout)) {
+            info("failed to write output");
+            err = 5;
+        }
+        traceEnd();
+        statsStop(&timer, STATS_OUTPUT);
+    }
+    xfree(out.data);
+
+    return err;
+}
+
+/* Appends NAME='value' of an assignment in data, returns 0 or 1 on memory error */
+static int formatAssignment(Buffer *buf, size_t index, const char *value, void *data)
+{
+    const char *const assignment = ((char *const*)data)[index]; /* shortcut */
+
+    return bufAppend(buf, assignment, exportQuery(assignment) - assignment)
+        || bufAppendQuoted(buf, value);
+}
+
+/* Appends a string in single quotes followed by a newline, with every
+ * single quote replaced by '\'' (close, escaped quote, reopen). Returns
+ * 0 or 1 on memory error */
+static int bufAppendQuoted(Buffer *buf, const char *str)
+{
+    const char *quote;
+
+    if (bufAppend(buf, "'", 1)) {
+        return 1;
+    }
+    while ((quote = strchr(str, '\''))) {
+        if (bufAppend(buf, str, quote - str) || bufAppend(buf, "'\\''", 4)) {
+            return 1;
+        }
+        str = quote + 1;
+    }
+
+    return bufAppend(buf, str, strlen(str)) || bufAppend(buf, "'\n", 2);
+}
@@ -0,0 +1,60 @@
+/** @file
+ * Printing query results as shell variable assignments.
+ */
+
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "query.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/********************************************************
+ *                     FUNCTIONS                        *
+ ********************************************************/
+
+/** Locates the query of an assignment in format "NAME=QUERY".
+ *
+ * NAME must be a valid shell variable name: a letter or an
+ * underscore, followed by any number of letters, digits and
+ * underscores.
+ *
+ * @param[in] assignment The assignment.
+ *
+ * @returns
+ * A pointer to the first character of QUERY in @p assignment,
+ * or @c NULL if @p assignment does not start with "NAME=".
+ */
+char *exportQuery(const char *assignment);
+
+/** Runs a list of queries and prints their results for a shell.
+ *
+ * Exactly like @ref runQueries, the file is read in a single pass,
+ * but each result is printed in format "NAME='result'", so that the
+ * output can be passed to the shell's eval. Single quotes inside
+ * results are written as '\'' and nothing else is special inside
+ * single quotes, so results are always taken literally.
+ *
+ * All lines are built in a single buffer, which is only written
+ * once every query succeeded: a failure never leaves some of the
+ * variables assigned.
+ *
+ * @param[inout] file The file to run the queries on.
+ * @param[in] queries An ordered list of queries to run.
+ * @param[in] assignments The assignments @p queries were parsed from,
+ * which give the variable names. Every one of them must be valid
+ * (see @ref exportQuery), which the caller checks while parsing.
+ * @param[in] qcount The number of elements in @p queries.
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error (malloc/realloc)
+ * - 2 - internal error
+ * - 3 - illegal operation (e.g. multiplying strings)
+ * - 4 - value not found in file
+ * - 5 - failed to write the output
+ */
+int exportQueries(FILE *file, const Query **queries, char *const *assignments, size_t qcount);
+
+#endif /* EXPORT_H */
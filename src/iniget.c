@@ -1,4 +1,16 @@
 #include "query.h"
+#include "watch.h"
+#include "scan.h"
+#include "multi.h"
+#include "emit.h"
+#include "export.h"
+#include "dump.h"
+#include "diff.h"
+#include "cache.h"
+#include "stats.h"
+#include "trace.h"
+#include "probes.h"
+#include "alloc.h"
 #include "error.h"
 
 #include <stdio.h>
@@ -12,59 +24,411 @@ enum {
     RET_FILE_ERROR = 1,
     RET_INVALID_QUERY = 2,
     RET_VALUE_NOT_FOUND = 3,
+    RET_INVALID_OPTION = 4,
+    RET_FILES_DIFFER = 1, /* only with --diff, like diff(1) */
+    RET_DIFF_TROUBLE = 2, /* any failure of --diff, like diff(1) */
     RET_INTERNAL_ERROR = -1,
     RET_MEMORY_ERROR = -2
 };
 
 void help(void);
+static int parseQueries(Query ***queries_ptr, char **strs, int count);
+static void freeQueries(Query **queries, int count);
+static int runError(int err);
+static int runOverlay(char **paths, int npaths, char **strs, int qcount);
+static void closeTrace(void);
+static int run(int argc, char **argv);
 
 int main(int argc, char **argv)
+{
+    int ret = run(argc, argv);
+
+    PROBE_EXIT(ret);
+
+    return ret;
+}
+
+/* Does all the work of main, returns one of RET_* codes */
+static int run(int argc, char **argv)
 {
     Query **queries;
-    int i, err;
+    int qcount, argi, sep, err;
+    long jobs;
+    bool watch, ordered, print_stats, emit_c, shell_export, dump, dump_nul, diff, differ, overlay, cache_hash;
+    bool parallel;
+    const char *trace_path, *cache_dir;
+    char **strs;
     FILE *input;
 
-    /* Parse command-line options */
     if (argc < 2) {
         info("try 'iniget --help' for more information.");
         return RET_SUCCESS;
     }
-    if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
-        help();
+
+    /* Parse command-line options */
+    watch = false;
+    ordered = true;
+    print_stats = false;
+    emit_c = false;
+    shell_export = false;
+    dump = dump_nul = false;
+    diff = false;
+    overlay = false;
+    cache_hash = false;
+    trace_path = NULL;
+    cache_dir = NULL;
+    jobs = -1;
+    for (argi = 1; argi < argc && argv[argi][0] == '-' && argv[argi][1] && strcmp(argv[argi], "--") != 0; argi++) {
+        if (strcmp(argv[argi], "-h") == 0 || strcmp(argv[argi], "--help") == 0) {
+            help();
+            return RET_SUCCESS;
+        } else if (strcmp(argv[argi], "--watch") == 0) {
+            watch = true;
+        } else if (strcmp(argv[argi], "-j") == 0 || strcmp(argv[argi], "--jobs") == 0) {
+            char *end;
+            long n;
+
+            if (++argi == argc || (n = strtol(argv[argi], &end, 10)) < 0 || *end || end == argv[argi]) {
+                info("option '%s' requires a non-negative number", argv[argi - 1]);
+                return RET_INVALID_OPTION;
+            }
+            jobs = n;
+        } else if (strcmp(argv[argi], "--unordered") == 0) {
+            ordered = false;
+        } else if (strcmp(argv[argi], "--stats") == 0) {
+            print_stats = true;
+        } else if (strcmp(argv[argi], "--trace") == 0) {
+            if (++argi == argc) {
+                info("option '%s' requires a file name", argv[argi - 1]);
+                return RET_INVALID_OPTION;
+            }
+            trace_path = argv[argi];
+        } else if (strcmp(argv[argi], "--emit-c") == 0) {
+            emit_c = true;
+        } else if (strcmp(argv[argi], "--export") == 0) {
+            shell_export = true;
+        } else if (strcmp(argv[argi], "--dump") == 0 || strcmp(argv[argi], "--dump0") == 0) {
+            dump = true;
+            dump_nul = argv[argi][6] == '0';
+        } else if (strcmp(argv[argi], "--diff") == 0) {
+            diff = true;
+        } else if (strcmp(argv[argi], "--overlay") == 0) {
+            overlay = true;
+        } else if (strcmp(argv[argi], "--cache") == 0) {
+            if (++argi == argc) {
+                info("option '%s' requires a directory", argv[argi - 1]);
+                return RET_INVALID_OPTION;
+            }
+            cache_dir = argv[argi];
+        } else if (strcmp(argv[argi], "--cache-hash") == 0) {
+            cache_hash = true;
+        } else {
+            info("unknown option '%s'", argv[argi]);
+            info("try 'iniget --help' for more information.");
+            return RET_INVALID_OPTION;
+        }
+    }
+    if (argi < argc && strcmp(argv[argi], "--") == 0 && emit_c) {
+        argi++;
+    }
+    if (argi == argc) {
+        /* No file to read */
         return RET_SUCCESS;
     }
 
+    /* The trace is finished however the program exits */
+    if (trace_path) {
+        if (watch) {
+            info("--trace cannot be used with --watch");
+            return RET_INVALID_OPTION;
+        }
+        if ((err = traceOpen(trace_path))) {
+            return runError(err);
+        }
+        atexit(closeTrace);
+    }
+
+    /* A single file is scanned by one thread unless told otherwise,
+     * so only other values of --jobs conflict with single-file modes */
+    parallel = jobs >= 0 && jobs != 1;
+
+    /* The cache stores the plain results of a single file */
+    if (cache_hash && !cache_dir) {
+        info("--cache-hash requires --cache");
+        return RET_INVALID_OPTION;
+    }
+    if (cache_dir && (watch || emit_c || shell_export || dump || diff || overlay || parallel)) {
+        info("--cache cannot be used with %s", watch? "--watch" : emit_c? "--emit-c" : shell_export? "--export"
+                : dump? "--dump" : diff? "--diff" : overlay? "--overlay" : "--jobs");
+        return RET_INVALID_OPTION;
+    }
+
+    /* All arguments are queries to generate a program for */
+    if (emit_c) {
+        if (watch || print_stats || shell_export || dump || diff || overlay) {
+            info("--emit-c cannot be used with %s", watch? "--watch" : print_stats? "--stats"
+                    : shell_export? "--export" : dump? "--dump" : diff? "--diff" : "--overlay");
+            return RET_INVALID_OPTION;
+        }
+        qcount = argc - argi;
+        if ((err = parseQueries(&queries, argv + argi, qcount))) {
+            return err;
+        }
+        err = runError(emitQueries(stdout, (const Query**)queries, argv + argi, qcount));
+        freeQueries(queries, qcount);
+        return err;
+    }
+
+    /* The whole file is printed instead of running queries */
+    if (dump) {
+        const char *const opt = dump_nul? "--dump0" : "--dump"; /* shortcut */
+
+        if (watch || print_stats || shell_export || diff || overlay || parallel) {
+            info("%s cannot be used with %s", opt, watch? "--watch" : print_stats? "--stats"
+                    : shell_export? "--export" : diff? "--diff" : overlay? "--overlay" : "--jobs");
+            return RET_INVALID_OPTION;
+        }
+        if (argi + 1 != argc) {
+            info("%s takes a single file and no queries", opt);
+            return RET_INVALID_OPTION;
+        }
+        return runError(dumpFile(argv[argi], dump_nul));
+    }
+
+    /* Two files are compared instead of running queries */
+    if (diff) {
+        if (watch || print_stats || shell_export || overlay || parallel) {
+            info("--diff cannot be used with %s", watch? "--watch" : print_stats? "--stats"
+                    : shell_export? "--export" : overlay? "--overlay" : "--jobs");
+            return RET_INVALID_OPTION;
+        }
+        if (argi + 2 != argc) {
+            info("--diff takes two files and no queries");
+            return RET_INVALID_OPTION;
+        }
+        if (diffFiles(argv[argi], argv[argi + 1], &differ)) {
+            return RET_DIFF_TROUBLE;
+        }
+        return differ? RET_FILES_DIFFER : RET_SUCCESS;
+    }
+
+    /* Multiple files are separated from queries with "--" */
+    for (sep = argi; sep < argc && strcmp(argv[sep], "--") != 0; sep++)
+        ;
+
+    /* Layers are separated from queries the same way, but read one by one */
+    if (overlay) {
+        if (watch || shell_export || parallel) {
+            info("--overlay cannot be used with %s", watch? "--watch" : shell_export? "--export" : "--jobs");
+            return RET_INVALID_OPTION;
+        }
+        if (sep == argc) {
+            info("--overlay requires the files to be separated from queries with --");
+            return RET_INVALID_OPTION;
+        }
+        qcount = argc - sep - 1;
+        if (qcount == 0 || sep == argi) {
+            return RET_SUCCESS;
+        }
+        if (print_stats) {
+            statsEnable();
+        }
+        err = runOverlay(argv + argi, sep - argi, argv + sep + 1, qcount);
+        if (stats.enabled) {
+            statsPrint(stderr);
+        }
+        return err;
+    }
+    if (sep < argc) {
+        char **paths;
+        size_t npaths, k;
+
+        if (watch) {
+            info("cannot watch multiple files");
+            return RET_INVALID_OPTION;
+        }
+        if (print_stats || shell_export || cache_dir) {
+            info("%s cannot be used with multiple files", print_stats? "--stats"
+                    : shell_export? "--export" : "--cache");
+            return RET_INVALID_OPTION;
+        }
+        qcount = argc - sep - 1;
+        if (qcount == 0 || sep == argi) {
+            return RET_SUCCESS;
+        }
+        if ((err = parseQueries(&queries, argv + sep + 1, qcount))) {
+            return err;
+        }
+        if (expandPaths(&paths, &npaths, argv + argi, sep - argi)) {
+            err = RET_MEMORY_ERROR;
+        } else {
+            err = runError(runQueriesMulti(paths, npaths, (const Query**)queries, qcount,
+                        (jobs < 0)? 0 : jobs, ordered));
+            for (k = 0; k < npaths; k++) {
+                xfree(paths[k]);
+            }
+            xfree(paths);
+        }
+        freeQueries(queries, qcount);
+        return err;
+    }
+
+    /* Watch mode does its own reading */
+    if (watch) {
+        if (strcmp(argv[argi], "-") == 0) {
+            info("cannot watch standard input");
+            return RET_INVALID_OPTION;
+        }
+        if (print_stats || shell_export) {
+            info("%s cannot be used with --watch", print_stats? "--stats" : "--export");
+            return RET_INVALID_OPTION;
+        }
+        qcount = argc - argi - 1;
+        if ((err = parseQueries(&queries, argv + argi + 1, qcount))) {
+            return err;
+        }
+        err = runError(watchQueries(argv[argi], (const Query**)queries, qcount));
+        freeQueries(queries, qcount);
+        return err;
+    }
+
+    if (print_stats) {
+        statsEnable();
+    }
+
+    /* Shell assignments are evaluated in a single streaming pass */
+    if (shell_export && parallel) {
+        info("--export cannot be used with --jobs");
+        return RET_INVALID_OPTION;
+    }
+
+    /* Files are mapped and scanned by worker threads, a single one unless
+     * told otherwise (stdin cannot be mapped, so it is always streamed) */
+    if (strcmp(argv[argi], "-") != 0 && argi + 1 < argc && !cache_dir && !shell_export) {
+        qcount = argc - argi - 1;
+        if ((err = parseQueries(&queries, argv + argi + 1, qcount))) {
+            return err;
+        }
+        err = runError(runQueriesParallel(argv[argi], (const Query**)queries, qcount, (jobs < 0)? 1 : jobs));
+        freeQueries(queries, qcount);
+        if (stats.enabled) {
+            statsPrint(stderr);
+        }
+        return err;
+    }
+
+    /* Results for an unchanged file come from the cache */
+    if (cache_dir) {
+        if (strcmp(argv[argi], "-") == 0) {
+            info("cannot cache standard input");
+            return RET_INVALID_OPTION;
+        }
+        qcount = argc - argi - 1;
+        if (qcount == 0) {
+            return RET_SUCCESS;
+        }
+        if ((err = parseQueries(&queries, argv + argi + 1, qcount))) {
+            return err;
+        }
+        err = runError(runQueriesCached(cache_dir, argv[argi], (const Query**)queries, qcount, cache_hash));
+        freeQueries(queries, qcount);
+        if (stats.enabled) {
+            statsPrint(stderr);
+        }
+        return err;
+    }
+
     /* Determine input stream */
-    if (strcmp(argv[1], "-") == 0) {
+    if (strcmp(argv[argi], "-") == 0) {
         input = stdin;
     } else {
-        if (!(input = fopen(argv[1], "r"))) {
+        if (!(input = fopen(argv[argi], "r"))) {
             info("failed to open file");
             return RET_FILE_ERROR;
         }
+        PROBE_FILE_OPEN(argv[argi]);
     }
-    if (argc < 3) {
+    if (argi + 1 == argc) {
         /* No queries to run */
         fclose(input);
         return RET_SUCCESS;
     }
 
+    /* Parse queries (of assignments "NAME=QUERY" with --export) */
+    qcount = argc - argi - 1;
+    strs = argv + argi + 1;
+    if (shell_export) {
+        int k;
+
+        if (!(strs = xmalloc(qcount * sizeof *strs))) {
+            info("memory error");
+            fclose(input);
+            return RET_MEMORY_ERROR;
+        }
+        for (k = 0; k < qcount; k++) {
+            if (!(strs[k] = exportQuery(argv[argi + 1 + k]))) {
+                info("invalid assignment '%s' (expected NAME=QUERY)", argv[argi + 1 + k]);
+                xfree(strs);
+                fclose(input);
+                return RET_INVALID_QUERY;
+            }
+        }
+    }
+    err = parseQueries(&queries, strs, qcount);
+    if (shell_export) {
+        xfree(strs);
+    }
+    if (err) {
+        fclose(input);
+        return err;
+    }
+
+    /* Run queries */
+    if (shell_export) {
+        err = runError(exportQueries(input, (const Query**)queries, argv + argi + 1, qcount));
+    } else {
+        err = runError(runQueries(input, (const Query**)queries, qcount));
+    }
+
+    /* Cleanup */
+    fclose(input);
+    freeQueries(queries, qcount);
+
+    if (stats.enabled) {
+        statsPrint(stderr);
+    }
+
+    return err;
+}
+
+/* Parses an array of query strings, returns one of RET_* codes */
+static int parseQueries(Query ***queries_ptr, char **strs, int count)
+{
+    Query **queries;
+    StatsTimer timer;
+    int i;
+
+    statsStart(&timer);
+
     /* Allocate space for queries */
-    if (!(queries = malloc((argc - 2) * sizeof *queries))) {
+    if (!(queries = xmalloc(count * sizeof *queries))) {
         info("memory error");
         return RET_MEMORY_ERROR;
     }
 
     /* Parse queries */
-    for (i = 2; i < argc; i++) {
+    for (i = 0; i < count; i++) {
         Query *q;
         int err;
 
-        if ((err = parseQueryString(&q, argv[i]))) {
-            while (i-- > 2) {
-                queryFree(queries[i-2]);
+        traceBegin("parseQueryString", "%s", strs[i]);
+        err = parseQueryString(&q, strs[i]);
+        traceEnd();
+        if (err) {
+            while (i-- > 0) {
+                queryFree(queries[i]);
             }
-            free(queries);
+            xfree(queries);
             switch (err) {
                 case 1:
                     return RET_MEMORY_ERROR;
@@ -79,58 +443,238 @@ int main(int argc, char **argv)
             }
         }
 
-        queries[i-2] = q;
+        queries[i] = q;
     }
 
-    /* Run queries */
-    if ((err = runQueries(input, (const Query**)queries, argc - 2))) {
-        switch (err) {
-            case 1:
-                err = RET_MEMORY_ERROR;
-                break;
-            case 2:
-                err = RET_INTERNAL_ERROR;
-                break;
-            case 3:
-                err = RET_INVALID_QUERY;
-                break;
-            case 4:
-                err = RET_VALUE_NOT_FOUND;
-                break;
-            default:
-                STAMP();
-                error("unmatched return code");
-                err = RET_INTERNAL_ERROR;
+    *queries_ptr = queries;
+
+    statsStop(&timer, STATS_PARSE);
+
+    return RET_SUCCESS;
+}
+
+/* Runs queries on layers of files (the last one has the highest priority),
+ * returns one of RET_* codes */
+static int runOverlay(char **paths, int npaths, char **strs, int qcount)
+{
+    Query **queries;
+    FILE **files;
+    bool in;    /* True if stdin is one of the layers */
+    int k, n, err;
+
+    if (!(files = xmalloc(npaths * sizeof *files))) {
+        info("memory error");
+        return RET_MEMORY_ERROR;
+    }
+
+    /* Temporary convenience macro */
+#define CLEANUP() do { \
+                for (k = 0; k < n; k++) { \
+                    if (files[k] != stdin) { \
+                        fclose(files[k]); \
+                    } \
+                } \
+                xfree(files); \
+            } while (0)
+
+    /* Open all layers first, so that a missing one is reported before any scanning */
+    in = false;
+    for (n = 0; n < npaths; n++) {
+        if (strcmp(paths[n], "-") == 0) {
+            if (in) {
+                info("standard input can only be one layer");
+                CLEANUP();
+                return RET_INVALID_OPTION;
+            }
+            in = true;
+            files[n] = stdin;
+        } else if (!(files[n] = fopen(paths[n], "r"))) {
+            info("%s: failed to open file", paths[n]);
+            CLEANUP();
+            return RET_FILE_ERROR;
+        } else {
+            PROBE_FILE_OPEN(paths[n]);
         }
     }
 
-    /* Cleanup */
-    fclose(input);
-    for (i = 2; i < argc; i++) {
-        queryFree(queries[i - 2]);
+    if ((err = parseQueries(&queries, strs, qcount))) {
+        CLEANUP();
+        return err;
     }
-    free(queries);
+    err = runError(runLayers(files, npaths, (const Query**)queries, qcount));
+
+    CLEANUP();
+#undef CLEANUP
+    freeQueries(queries, qcount);
 
     return err;
 }
 
+static void closeTrace(void)
+{
+    traceClose();
+}
+
+static void freeQueries(Query **queries, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        queryFree(queries[i]);
+    }
+    xfree(queries);
+}
+
+/* Translates a return code of runQueries into one of RET_* codes */
+static int runError(int err)
+{
+    switch (err) {
+        case 0:
+            return RET_SUCCESS;
+        case 1:
+            return RET_MEMORY_ERROR;
+        case 2:
+            return RET_INTERNAL_ERROR;
+        case 3:
+            return RET_INVALID_QUERY;
+        case 4:
+            return RET_VALUE_NOT_FOUND;
+        case 5:
+            return RET_FILE_ERROR;
+        default:
+            STAMP();
+            error("unmatched return code");
+            return RET_INTERNAL_ERROR;
+    }
+}
+
 void help(void)
 {
-    printf("%s%s%s%s", 
+    /* The text is split into chunks, because C89 compilers are
+     * only required to support string literals of 509 characters. */
+    static const char *const chunks[] = {
 "NAME\n"
 "       iniget - extract information from INI files\n"
 "\n"
 "SYNOPSIS\n"
-"       iniget [OPTION] [FILE] [QUERY]...\n"
-"\n"
+"       iniget [OPTION]... [FILE] [QUERY]...\n"
+"       iniget [OPTION]... FILE... -- [QUERY]...\n"
+"       iniget --emit-c [QUERY]...\n"
+"       iniget --export [FILE] [NAME=QUERY]...\n"
+"       iniget --dump|--dump0 FILE\n"
+"       iniget --diff FILE1 FILE2\n"
+"       iniget [OPTION]... --overlay FILE... -- [QUERY]...\n"
+"\n",
 "DESCRIPTION\n"
 "       Intakes a path to a file (or - for stdin) and\n"
 "       evaluates any number of queries on that file\n"
 "       (query syntax is explained in detail below).\n"
-"\n"
+"       If several files (directories, glob patterns)\n"
+"       are separated from queries by --, they are all\n"
+"       processed in parallel and every result line is\n"
+"       prefixed with the file name and a tab (or '*'\n"
+"       for aggregate queries, which are printed last).\n"
+"\n",
 "OPTIONS\n"
 "       -h, --help\n"
 "           Prints this help message.\n"
+"\n"
+"       --watch\n"
+"           Keeps running and re-evaluates the queries\n"
+"           every time FILE changes. Only results that\n"
+"           changed are printed, in format \"N<TAB>result\",\n"
+"           where N is the 1-based index of the query.\n"
+"\n",
+"       -j, --jobs N\n"
+"           Scans FILE with N threads (0 means one per\n"
+"           CPU, default 1). Useful for very large files.\n"
+"           A regular FILE is always memory-mapped, and\n"
+"           single-value results are written from there.\n"
+"           Options which take no --jobs accept -j 1.\n"
+"           With multiple files, N files are processed\n"
+"           at once instead (default is one per CPU).\n"
+"\n",
+"       --unordered\n"
+"           With multiple files, prints the results of\n"
+"           each file as soon as it is done, instead of\n"
+"           in the order of arguments.\n"
+"\n",
+"       --stats\n"
+"           Prints a report on stderr when done: wall and\n"
+"           CPU time of each phase (parse, scan, bind,\n"
+"           eval, output), bytes and lines read, where\n"
+"           the scan stopped early, key lines compared,\n"
+"           values matched and peak memory use, plus\n"
+"           hardware counters of scan and eval where\n"
+"           perf_event_open is permitted. Only for a\n"
+"           single file without --watch.\n"
+"\n",
+"       --trace FILE\n"
+"           Writes a timeline of the run to FILE in Chrome\n"
+"           trace format (for chrome://tracing or Perfetto),\n"
+"           with a track per thread. Not for --watch.\n"
+"\n",
+"       --emit-c\n"
+"           Treats all arguments as queries and prints a\n"
+"           standalone C program running them on the file\n"
+"           given to it, with the same output and exit\n"
+"           status as iniget. Sections and keys are matched\n"
+"           by switches, queries are straight-line code.\n"
+"           Build with \"cc -O2 -o extract extract.c -lm\".\n"
+"           Wildcards are not supported.\n"
+"\n",
+"       --export\n"
+"           Takes assignments NAME=QUERY instead of queries\n"
+"           and prints NAME='result' lines for the shell's\n"
+"           eval (single quotes in results are escaped).\n"
+"           All queries are run in one pass, and nothing\n"
+"           is printed unless all of them succeed. Only\n"
+"           for a single file, without --watch or --jobs.\n"
+"           Example: eval \"$(iniget --export f.ini\n"
+"           PORT={server.port})\"\n"
+"\n",
+"       --dump, --dump0\n"
+"           Prints every key/value pair of FILE in file\n"
+"           order, as \"section<TAB>key<TAB>type<TAB>value\"\n"
+"           lines, where type is string, int or float and\n"
+"           value is printed like a query result. With\n"
+"           --dump0, every field ends with a null byte\n"
+"           instead (values may contain tabs). Takes no\n"
+"           queries, and no --watch, --stats or --jobs.\n"
+"\n",
+"       --diff\n"
+"           Compares the key/value pairs of FILE1 and FILE2\n"
+"           and prints \"+<TAB>section<TAB>key<TAB>type<TAB>\n"
+"           value\" for pairs only in FILE2 and \"~\" lines\n"
+"           with both types and values for changed pairs,\n"
+"           in the order of FILE2, then \"-\" lines for pairs\n"
+"           only in FILE1. Values are compared after typing,\n",
+"           so 1.0 equals 1. Exits with 1 if the files\n"
+"           differ and 2 if the comparison failed. Takes\n"
+"           no queries, and no --watch, --stats or --jobs.\n"
+"\n",
+"       --overlay\n"
+"           Treats the files before -- as layers, each one\n"
+"           overriding the ones before it, and runs the\n"
+"           queries on them as on one merged file. Files\n"
+"           are read from the last one down, and only as\n"
+"           long as some values are missing. Not for\n"
+"           --watch, --export or --jobs. Example: iniget\n"
+"           --overlay base.ini host.ini -- {server.port}\n"
+"\n",
+"       --cache DIR\n"
+"           Stores the results of queries on FILE in DIR,\n"
+"           and prints them without reading FILE while it\n"
+"           (by device, inode, size and modification time)\n"
+"           and the queries are unchanged. Above 16 MiB,\n"
+"           the least recently used results are deleted\n"
+"           down to 12 MiB.\n"
+"           Not for stdin, multiple files, --overlay,\n"
+"           --watch, --export or --jobs.\n"
+"\n",
+"       --cache-hash\n"
+"           With --cache, adds a hash of FILE's content to\n"
+"           the key (FILE is then read on every run).\n"
 "\n",
 "QUERY SYNTAX\n"
 "       Each query is a mathematical expression built\n"
@@ -159,6 +703,28 @@ void help(void)
 "       by the use of '+', and multiplying a string by\n"
 "       a non-negative number is also supported (causes\n"
 "       a string to be repeated N times).\n"
-"\n"
-            );
+"\n",
+"       Aggregate functions sum(), min(), max(), avg(),\n"
+"       count() and join() may be used, if all operands\n"
+"       of a query are inside them. With multiple files,\n"
+"       an aggregate query is printed once after all\n"
+"       files, labeled '*' instead of a file name, and\n"
+"       aggregates the values from all files which\n"
+"       succeeded. It is not printed if no file did, or\n"
+"       if its argument failed in any file. Aggregates\n"
+"       may not be nested, and join() needs one file.\n"
+"\n",
+"       Section and key names may end with a '*' wildcard\n"
+"       (e.g. {backend-*.weight}, {*.host}, {limits.*}),\n"
+"       which references all matching values. A wildcard\n"
+"       must be the whole argument of an aggregate, and\n"
+"       it makes the whole file be read.\n"
+"\n",
+        NULL
+    };
+    const char *const *chunk;
+
+    for (chunk = chunks; *chunk; chunk++) {
+        fputs(*chunk, stdout);
+    }
 }
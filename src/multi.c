@@ -0,0 +1,823 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "multi.h"
+#include "query.h"
+#include "arglist.h"
+#include "aggregate.h"
+#include "batch.h"
+#include "trace.h"
+#include "probes.h"
+#include "alloc.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <glob.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <math.h>
+
+/* In iblock, a row with an integer which a double cannot hold exactly.
+ * It is added to the accumulator on its own, and left out of the column */
+#define ROW_APART 2
+
+/* The outcome of running queries on a single file */
+typedef struct {
+    char *out;    /* captured output (NULL if nothing to print) */
+    size_t len;   /* length of out */
+    int err;      /* return code, like that of runQueries */
+    bool done;    /* the file has been processed */
+} Result;
+
+/* State shared by all workers */
+typedef struct {
+    char *const *paths;
+    size_t npaths;
+    const Query **queries;
+    size_t qcount;
+    bool ordered;
+
+    Result *slots;       /* reorder buffer, file i goes to slot i % nslots */
+    size_t nslots;
+    size_t next;         /* index of the next file to process */
+    size_t printed;      /* the number of files printed so far (ordered only) */
+    int err;             /* first error code (unordered only) */
+    size_t errpos;       /* index of the file that caused err */
+
+    size_t naggs;        /* the number of aggregate functions in all queries */
+    Accum *totals;       /* merged accumulators of all workers */
+    bool *wild;          /* true for aggregates of a wildcard (merged, not gathered) */
+    bool *bad;           /* true for aggregates of which some argument failed to evaluate */
+    size_t nfiles;       /* the number of files which contributed to aggregates */
+    int aggerr;          /* first error while computing gathered rows */
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond; /* signalled whenever a file is done or printed */
+} MultiState;
+
+/* Private state of a single worker */
+typedef struct {
+    Query *local;          /* private copies of queries, sharing everything but args */
+    const Query **queries; /* pointers to local */
+    ValStack *vstack;
+
+    ArgVal *row;           /* values of all aggregate arguments for one file (none if batched) */
+    const Accum **accs;    /* accumulators of wildcard aggregates for one file */
+    double *block;         /* gathered rows, one column of AGG_BLOCK_SIZE per aggregate */
+    unsigned char *iblock; /* same layout as block, 1 for integers, 0 for others, or ROW_APART */
+    size_t rows;           /* the number of rows in block */
+    Batch **batches;       /* bindings of aggregate arguments (NULL if evaluated right away) */
+    Accum *partial;        /* accumulators of this worker */
+    bool *bad;             /* aggregates of which some argument failed to evaluate */
+    size_t nfiles;         /* the number of files gathered by this worker */
+    int err;               /* first error while computing gathered rows */
+} Worker;
+
+static void *multiWorker(void *arg);
+static int workerInit(const MultiState *st, Worker *w);
+static void workerFlush(const MultiState *st, Worker *w);
+static void workerFree(const MultiState *st, Worker *w);
+static void runFile(const MultiState *st, Worker *w, const char *path, Result *res);
+static int printAggregates(const MultiState *st);
+static int pathAdd(char ***paths_ptr, size_t *npaths, size_t *capacity, const char *path);
+static int expandDir(char ***paths_ptr, size_t *npaths, size_t *capacity, const char *dir);
+static int pathCompare(const void *a, const void *b);
+
+int expandPaths(char ***paths_ptr, size_t *npaths, char *const *args, size_t nargs)
+{
+    size_t capacity, i, j;
+    struct stat sb;
+
+    capacity = nargs + 1;
+    if (!(*paths_ptr = xmalloc(capacity * sizeof **paths_ptr))) {
+        info("memory error");
+        return 1;
+    }
+    *npaths = 0;
+
+    for (i = 0; i < nargs; i++) {
+        glob_t g;
+        int err;
+
+        if (strcmp(args[i], "-") == 0) {
+            err = pathAdd(paths_ptr, npaths, &capacity, args[i]);
+        } else if (stat(args[i], &sb) == 0 && S_ISDIR(sb.st_mode)) {
+            err = expandDir(paths_ptr, npaths, &capacity, args[i]);
+        } else if (glob(args[i], 0, NULL, &g) == 0) {
+            for (j = 0, err = 0; j < g.gl_pathc && !err; j++) {
+                err = pathAdd(paths_ptr, npaths, &capacity, g.gl_pathv[j]);
+            }
+            globfree(&g);
+        } else {
+            err = pathAdd(paths_ptr, npaths, &capacity, args[i]);
+        }
+
+        if (err) {
+            for (j = 0; j < *npaths; j++) {
+                xfree((*paths_ptr)[j]);
+            }
+            xfree(*paths_ptr);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int runQueriesMulti(char *const *paths, size_t npaths, const Query **queries, size_t qcount,
+        unsigned nthreads, bool ordered)
+{
+    MultiState st;
+    pthread_t *threads;
+    size_t i;
+    int err;
+
+    if (nthreads == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (ncpu > 0)? ncpu : 1;
+    }
+    if (nthreads > npaths) {
+        nthreads = npaths? npaths : 1;
+    }
+
+    st.paths = paths;
+    st.npaths = npaths;
+    st.queries = queries;
+    st.qcount = qcount;
+    st.ordered = ordered;
+    st.nslots = nthreads * MULTI_REORDER_PER_THREAD;
+    st.next = 0;
+    st.printed = 0;
+    st.err = 0;
+    st.errpos = npaths;
+    st.naggs = 0;
+    st.nfiles = 0;
+    st.aggerr = 0;
+    for (i = 0; i < qcount; i++) {
+        size_t k;
+        for (k = 0; k < queries[i]->aggs->size; k += 2) {
+            /* Joined values would depend on the order of workers */
+            if (queries[i]->op_stack->data[queries[i]->aggs->data[k + 1]] == OP_JOIN) {
+                info("invalid query (join cannot be used with multiple files)");
+                return 3;
+            }
+        }
+        st.naggs += queries[i]->aggs->size / 2;
+    }
+
+    if (!(st.totals = xmalloc((st.naggs + 1) * sizeof *st.totals))) {
+        info("memory error");
+        return 1;
+    }
+    if (!(st.wild = xmalloc((st.naggs + 1) * sizeof *st.wild))) {
+        info("memory error");
+        xfree(st.totals);
+        return 1;
+    }
+    if (!(st.bad = xcalloc(st.naggs + 1, sizeof *st.bad))) {
+        info("memory error");
+        xfree(st.wild);
+        xfree(st.totals);
+        return 1;
+    }
+    for (i = 0; i < st.naggs; i++) {
+        accumInit(st.totals + i);
+    }
+    {
+        size_t k, a;
+        for (i = 0, a = 0; i < qcount; i++) {
+            const Query *const query = queries[i]; /* shortcut */
+            for (k = 0; k < query->aggs->size; k += 2, a++) {
+                int tok = query->op_stack->data[query->aggs->data[k]];
+                st.wild[a] = tok >= 0 && query->set->data[tok].wildcard;
+            }
+        }
+    }
+    if (!(st.slots = xcalloc(st.nslots, sizeof *st.slots))) {
+        info("memory error");
+        xfree(st.bad);
+        xfree(st.wild);
+        xfree(st.totals);
+        return 1;
+    }
+    if (!(threads = xmalloc(nthreads * sizeof *threads))) {
+        info("memory error");
+        xfree(st.slots);
+        xfree(st.bad);
+        xfree(st.wild);
+        xfree(st.totals);
+        return 1;
+    }
+
+    /* Start workers */
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.cond, NULL);
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(threads + i, NULL, multiWorker, &st)) {
+            info("failed to create thread");
+            break;
+        }
+    }
+    nthreads = i;
+    if (nthreads == 0) {
+        pthread_cond_destroy(&st.cond);
+        pthread_mutex_destroy(&st.lock);
+        xfree(threads);
+        xfree(st.slots);
+        xfree(st.bad);
+        xfree(st.wild);
+        xfree(st.totals);
+        return 2;
+    }
+
+    /* Print results in order, as they become available */
+    err = 0;
+    if (ordered) {
+        for (i = 0; i < npaths; i++) {
+            Result *const res = st.slots + i % st.nslots; /* shortcut */
+
+            pthread_mutex_lock(&st.lock);
+            while (!res->done) {
+                pthread_cond_wait(&st.cond, &st.lock);
+            }
+            pthread_mutex_unlock(&st.lock);
+
+            if (res->out) {
+                traceBegin("output", "%s", paths[i]);
+                fwrite(res->out, 1, res->len, stdout);
+                traceEnd();
+                free(res->out);
+            }
+            if (res->err && !err) {
+                err = res->err;
+            }
+
+            /* Free the slot for another file */
+            pthread_mutex_lock(&st.lock);
+            res->out = NULL;
+            res->done = false;
+            st.printed++;
+            pthread_cond_broadcast(&st.cond);
+            pthread_mutex_unlock(&st.lock);
+        }
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (!ordered) {
+        err = st.err;
+    }
+    if (!err) {
+        err = st.aggerr;
+    }
+
+    /* Aggregates are printed last, once all files are done */
+    if (st.naggs) {
+        int aggerr = printAggregates(&st);
+        if (!err) {
+            err = aggerr;
+        }
+    }
+    if (fflush(stdout) || ferror(stdout)) {
+        info("failed to write output");
+        err = err? err : 5;
+    }
+
+    /* Cleanup */
+    pthread_cond_destroy(&st.cond);
+    pthread_mutex_destroy(&st.lock);
+    xfree(threads);
+    xfree(st.slots);
+    xfree(st.bad);
+    xfree(st.wild);
+    xfree(st.totals);
+
+    return err;
+}
+
+static void *multiWorker(void *arg)
+{
+    MultiState *const st = arg;
+    Worker w;
+    bool ok;
+
+    /* Keep consuming files even without memory, so that the printing thread never hangs */
+    ok = !workerInit(st, &w);
+    traceThreadName("file worker");
+
+    for (;;) {
+        Result res, *slot;
+        size_t idx;
+
+        /* Fetch the next file, without running too far ahead */
+        pthread_mutex_lock(&st->lock);
+        while (st->ordered && st->next < st->npaths && st->next >= st->printed + st->nslots) {
+            pthread_cond_wait(&st->cond, &st->lock);
+        }
+        if (st->next == st->npaths) {
+            pthread_mutex_unlock(&st->lock);
+            break;
+        }
+        idx = st->next++;
+        pthread_mutex_unlock(&st->lock);
+
+        if (ok) {
+            traceBegin("file", "%s", st->paths[idx]);
+            runFile(st, &w, st->paths[idx], &res);
+            traceEnd();
+        } else {
+            res.out = NULL;
+            res.len = 0;
+            res.err = 1;
+        }
+
+        if (st->ordered) {
+            /* Hand over to the printing thread */
+            slot = st->slots + idx % st->nslots;
+            pthread_mutex_lock(&st->lock);
+            slot->out = res.out;
+            slot->len = res.len;
+            slot->err = res.err;
+            slot->done = true;
+            pthread_cond_broadcast(&st->cond);
+            pthread_mutex_unlock(&st->lock);
+        } else {
+            /* Print right away */
+            pthread_mutex_lock(&st->lock);
+            if (res.out) {
+                traceBegin("output", "%s", st->paths[idx]);
+                fwrite(res.out, 1, res.len, stdout);
+                traceEnd();
+                free(res.out);
+            }
+            if (res.err && idx < st->errpos) {
+                st->err = res.err;
+                st->errpos = idx;
+            }
+            pthread_mutex_unlock(&st->lock);
+        }
+    }
+
+    if (ok) {
+        size_t i;
+
+        /* Merge partial accumulators */
+        workerFlush(st, &w);
+        pthread_mutex_lock(&st->lock);
+        for (i = 0; i < st->naggs; i++) {
+            accumMerge(st->totals + i, w.partial + i);
+            st->bad[i] = st->bad[i] || w.bad[i];
+        }
+        st->nfiles += w.nfiles;
+        if (w.err && !st->aggerr) {
+            st->aggerr = w.err;
+        }
+        pthread_mutex_unlock(&st->lock);
+
+        workerFree(st, &w);
+    }
+
+    return NULL;
+}
+
+/* Returns 0 on success and 1 on memory error */
+static int workerInit(const MultiState *st, Worker *w)
+{
+    size_t i, k, a;
+
+    memset(w, 0, sizeof *w);
+
+    if (!(w->local = xmalloc((st->qcount + 1) * sizeof *w->local))
+            || !(w->queries = xmalloc((st->qcount + 1) * sizeof *w->queries))
+            || !(w->row = xcalloc(st->naggs + 1, sizeof *w->row))
+            || !(w->accs = xmalloc((st->naggs + 1) * sizeof *w->accs))
+            || !(w->block = xmalloc((st->naggs * AGG_BLOCK_SIZE + 1) * sizeof *w->block))
+            || !(w->iblock = xmalloc((st->naggs * AGG_BLOCK_SIZE + 1) * sizeof *w->iblock))
+            || !(w->batches = xcalloc(st->naggs + 1, sizeof *w->batches))
+            || !(w->partial = xmalloc((st->naggs + 1) * sizeof *w->partial))
+            || !(w->bad = xcalloc(st->naggs + 1, sizeof *w->bad))
+            || !(w->vstack = valstackCreate())) {
+        info("memory error");
+        workerFree(st, w);
+        return 1;
+    }
+
+    /* Compiled queries are shared, but values must be bound separately */
+    for (i = 0; i < st->qcount; i++) {
+        w->local[i] = *st->queries[i];
+        w->local[i].args = NULL;
+    }
+    for (i = 0; i < st->qcount; i++) {
+        if (!(w->local[i].args = queryArglistCreate(st->queries[i]))) {
+            workerFree(st, w);
+            return 1;
+        }
+        w->queries[i] = w->local + i;
+    }
+
+    /* Arguments are evaluated in batches, unless an error could
+     * only be found then, after the output of the file is printed */
+    for (i = 0, a = 0; i < st->qcount; i++) {
+        const Query *const query = st->queries[i]; /* shortcut */
+        for (k = 0; k < query->aggs->size; k += 2, a++) {
+            int err;
+
+            if (st->wild[a]) {
+                continue;
+            }
+            err = batchCreate(w->batches + a, query, query->aggs->data[k],
+                    query->aggs->data[k + 1], AGG_BLOCK_SIZE);
+            if (err == 3) {
+                w->batches[a] = NULL;
+            } else if (err) {
+                workerFree(st, w);
+                return 1;
+            } else if (w->batches[a]->late_errors) {
+                batchFree(w->batches[a]);
+                w->batches[a] = NULL;
+            }
+        }
+    }
+
+    for (i = 0; i < st->naggs; i++) {
+        accumInit(w->partial + i);
+    }
+
+    return 0;
+}
+
+/* Computes batched values of gathered rows and reduces
+ * the rows into partial accumulators */
+static void workerFlush(const MultiState *st, Worker *w)
+{
+    size_t i, k, a, r;
+
+    for (i = 0, a = 0; i < st->qcount; i++) {
+        const Query *const query = w->queries[i]; /* shortcut */
+
+        for (k = 0; k < query->aggs->size; k += 2, a++) {
+            Batch *const batch = w->batches[a]; /* shortcut */
+            double *const column = w->block + a * AGG_BLOCK_SIZE; /* shortcut */
+            unsigned char *const icolumn = w->iblock + a * AGG_BLOCK_SIZE; /* shortcut */
+            size_t m;
+            int err;
+
+            if (st->wild[a]) {
+                continue;
+            }
+            if (batch && w->rows) {
+                if (query->op_stack->data[query->aggs->data[k + 1]] == OP_CNT) {
+                    /* The argument is valid, nothing else matters */
+                    for (r = 0; r < w->rows; r++) {
+                        column[r] = batch->mask[r]? column[r] : 1;
+                        icolumn[r] = batch->mask[r]? icolumn[r] : 1;
+                    }
+                } else {
+                    traceBegin("batchEval", "query %lu, %lu rows",
+                            (unsigned long)i + 1, (unsigned long)w->rows);
+                    err = batchEval(batch, w->rows, column, icolumn);
+                    traceEnd();
+                    if (err) {
+                        w->bad[a] = true;
+                        if (!w->err) {
+                            w->err = err;
+                        }
+                    }
+
+                    /* Rows flagged while binding already have a value,
+                     * the others need exact integer arithmetic */
+                    for (r = 0; r < w->rows && !err; r++) {
+                        ArgVal result;
+
+                        if (batch->mask[r] != BATCH_INEXACT) {
+                            continue;
+                        }
+                        if ((err = batchRebind(batch, r, query->args))
+                                || (err = evalQueryRange(query, w->vstack, query->aggs->data[k],
+                                        query->aggs->data[k + 1] + 1, NULL, &result))) {
+                            info("failed to evaluate query %lu", (unsigned long)i + 1);
+                            w->bad[a] = true;
+                            if (!w->err) {
+                                w->err = err;
+                            }
+                            break;
+                        }
+                        if (result.type == ARGVAL_TYPE_INT && fabs(ARGVAL_NUMBER(result)) >= BATCH_EXACT_LIMIT) {
+                            accumAdd(w->partial + a, &result);
+                            icolumn[r] = ROW_APART;
+                        } else {
+                            column[r] = ARGVAL_NUMBER(result);
+                            icolumn[r] = result.type == ARGVAL_TYPE_INT;
+                        }
+                    }
+                }
+            }
+
+            /* Rows added on their own are left out */
+            for (r = 0, m = 0; r < w->rows; r++) {
+                if (icolumn[r] != ROW_APART) {
+                    column[m] = column[r];
+                    icolumn[m++] = icolumn[r];
+                }
+            }
+            accumAddColumn(w->partial + a, column, icolumn, m);
+        }
+    }
+    w->rows = 0;
+}
+
+static void workerFree(const MultiState *st, Worker *w)
+{
+    size_t i;
+
+    for (i = 0; w->local && i < st->qcount; i++) {
+        if (w->local[i].args) {
+            arglistFree(w->local[i].args);
+        }
+    }
+    if (w->vstack) {
+        valstackFree(w->vstack);
+    }
+    xfree(w->local);
+    xfree(w->queries);
+    xfree(w->row);
+    xfree(w->accs);
+    xfree(w->block);
+    xfree(w->iblock);
+    for (i = 0; w->batches && i < st->naggs; i++) {
+        if (w->batches[i]) {
+            batchFree(w->batches[i]);
+        }
+    }
+    xfree(w->batches);
+    xfree(w->partial);
+    xfree(w->bad);
+}
+
+/* Runs queries on one file and captures the output in res */
+static void runFile(const MultiState *st, Worker *w, const char *path, Result *res)
+{
+    const Query **const queries = w->queries; /* shortcut */
+    FILE *input, *out;
+    size_t i, k, a;
+
+    res->out = NULL;
+    res->len = 0;
+
+    /* Scan the file */
+    if (strcmp(path, "-") == 0) {
+        input = stdin;
+    } else if (!(input = fopen(path, "r"))) {
+        info("%s: failed to open file", path);
+        res->err = 5;
+        return;
+    }
+    PROBE_FILE_OPEN(path);
+    res->err = bindQueries(input, queries, st->qcount);
+    if (input != stdin) {
+        fclose(input);
+    }
+    if (res->err) {
+        if (res->err == 4) {
+            flockfile(stderr);
+            info("%s:", path);
+            reportMissing(queries, st->qcount);
+            funlockfile(stderr);
+        } else {
+            info("%s: failed to read file", path);
+        }
+        return;
+    }
+
+    /* Compute and capture the results (the buffer is allocated
+     * by the C library, so it is released with plain free) */
+    if (!(out = open_memstream(&res->out, &res->len))) {
+        info("memory error");
+        res->err = 1;
+        return;
+    }
+    for (i = 0, a = 0; i < st->qcount; i++) {
+        const Query *const query = queries[i]; /* shortcut */
+        ArgVal result;
+
+        /* Evaluate aggregate arguments (with their aggregate function,
+         * so that the value is checked and converted to a number) */
+        for (k = 0; k < query->aggs->size; k += 2, a++) {
+            /* All values of a wildcard are already accumulated */
+            if (st->wild[a]) {
+                w->accs[a] = query->args->accs + query->op_stack->data[query->aggs->data[k]];
+                continue;
+            }
+
+            /* Values which can be computed in a batch are kept for later */
+            if (w->batches[a] && !batchBind(w->batches[a], w->rows, query->args)) {
+                w->row[a].type = ARGVAL_TYPE_NONE;
+                continue;
+            }
+            if ((res->err = evalQueryRange(query, w->vstack, query->aggs->data[k],
+                            query->aggs->data[k + 1] + 1, NULL, w->row + a))) {
+                w->bad[a] = true;
+                break;
+            }
+        }
+        if (res->err) {
+            break;
+        }
+        if (query->aggs->size) {
+            continue;
+        }
+
+        traceBegin("evalQuery", "query %lu", (unsigned long)i + 1);
+        PROBE_EVAL_START(i + 1);
+        res->err = evalQuery(query, w->vstack, &result);
+        PROBE_EVAL_END(i + 1, res->err);
+        traceEnd();
+        if (res->err) {
+            break;
+        }
+
+        fprintf(out, "%s\t", path);
+        argValPrint(out, &result);
+        putc('\n', out);
+        if (result.type == ARGVAL_TYPE_STRING && result.is_temporary) {
+            xfree(result.value.s);
+        }
+    }
+    fclose(out);
+
+    /* All or nothing */
+    if (res->err) {
+        info("%s: failed to evaluate query %lu", path, (unsigned long)i + 1);
+        free(res->out);
+        res->out = NULL;
+        res->len = 0;
+        return;
+    }
+
+    /* Gather values of aggregate arguments */
+    if (st->naggs) {
+        w->nfiles++;
+        for (a = 0; a < st->naggs; a++) {
+            const size_t pos = a * AGG_BLOCK_SIZE + w->rows; /* shortcut */
+
+            if (st->wild[a]) {
+                accumMerge(w->partial + a, w->accs[a]);
+            } else if (w->row[a].type == ARGVAL_TYPE_NONE) {
+                /* Computed later, in a batch */
+                w->iblock[pos] = 0;
+            } else if (w->row[a].type == ARGVAL_TYPE_INT && fabs(ARGVAL_NUMBER(w->row[a])) >= BATCH_EXACT_LIMIT) {
+                accumAdd(w->partial + a, w->row + a);
+                w->iblock[pos] = ROW_APART;
+            } else {
+                w->block[pos] = ARGVAL_NUMBER(w->row[a]);
+                w->iblock[pos] = w->row[a].type == ARGVAL_TYPE_INT;
+            }
+        }
+        if (++w->rows == AGG_BLOCK_SIZE) {
+            workerFlush(st, w);
+        }
+    }
+}
+
+/* Computes and prints the results of aggregate queries, each prefixed
+ * with MULTI_AGGREGATE_LABEL and a tab. Nothing is printed for a query
+ * which no file contributed to, or of which an aggregate argument failed
+ * to evaluate in some file. Returns 0 on success or an error code like
+ * that of runQueries */
+static int printAggregates(const MultiState *st)
+{
+    ValStack *vstack;
+    ArgVal *aggvals;
+    size_t i, k, a;
+    bool bad, failed;
+    int err;
+
+    if (!(vstack = valstackCreate())) {
+        return 1;
+    }
+    if (!(aggvals = xmalloc((st->naggs + 1) * sizeof *aggvals))) {
+        info("memory error");
+        valstackFree(vstack);
+        return 1;
+    }
+
+    err = 0;
+    failed = false;
+    for (i = 0, a = 0; i < st->qcount && !err; i++) {
+        const Query *const query = st->queries[i]; /* shortcut */
+        ArgVal result;
+
+        if (!query->aggs->size) {
+            continue;
+        }
+
+        /* A partial result would pass for a complete one */
+        for (k = 0, bad = !st->nfiles; k < query->aggs->size; k += 2) {
+            bad = bad || st->bad[a + k / 2];
+        }
+        if (bad) {
+            info("failed to aggregate query %lu", (unsigned long)i + 1);
+            a += query->aggs->size / 2;
+            failed = true;
+            continue;
+        }
+
+        /* Final values of all aggregates of this query */
+        for (k = 0; k < query->aggs->size && !err; k += 2, a++) {
+            int op = query->op_stack->data[query->aggs->data[k + 1]];
+            err = accumResult(st->totals + a, op, aggvals + k / 2);
+        }
+        if (err || (err = evalQueryRange(query, vstack, 0, query->op_stack->size, aggvals, &result))) {
+            break;
+        }
+
+        fputs(MULTI_AGGREGATE_LABEL "\t", stdout);
+        argValPrint(stdout, &result);
+        putchar('\n');
+        if (result.type == ARGVAL_TYPE_STRING && result.is_temporary) {
+            xfree(result.value.s);
+        }
+    }
+
+    xfree(aggvals);
+    valstackFree(vstack);
+
+    return (err || !failed)? err : 3;
+}
+
+/* Returns 0 on success and 1 on memory error */
+static int pathAdd(char ***paths_ptr, size_t *npaths, size_t *capacity, const char *path)
+{
+    char *new;
+
+    /* Increase capacity, if needed */
+    if (*npaths == *capacity) {
+        *capacity *= 2;
+        if (!(*paths_ptr = xrealloc(*paths_ptr, *capacity * sizeof **paths_ptr))) {
+            info("memory error");
+            return 1;
+        }
+    }
+
+    if (!(new = xmalloc((strlen(path) + 1) * sizeof *new))) {
+        info("memory error");
+        return 1;
+    }
+    strcpy(new, path);
+    (*paths_ptr)[(*npaths)++] = new;
+
+    return 0;
+}
+
+/* Returns 0 on success and 1 on memory error */
+static int expandDir(char ***paths_ptr, size_t *npaths, size_t *capacity, const char *dir)
+{
+    DIR *d;
+    struct dirent *ent;
+    size_t first, dlen;
+    char *path;
+
+    if (!(d = opendir(dir))) {
+        info("failed to open directory '%s'", dir);
+        return 0;
+    }
+
+    first = *npaths;
+    dlen = strlen(dir);
+    while ((ent = readdir(d))) {
+        struct stat sb;
+
+        if (!(path = xmalloc((dlen + strlen(ent->d_name) + 2) * sizeof *path))) {
+            info("memory error");
+            closedir(d);
+            return 1;
+        }
+        strcpy(path, dir);
+        if (dlen && dir[dlen - 1] != '/') {
+            strcat(path, "/");
+        }
+        strcat(path, ent->d_name);
+
+        if (stat(path, &sb) == 0 && S_ISREG(sb.st_mode) && pathAdd(paths_ptr, npaths, capacity, path)) {
+            xfree(path);
+            closedir(d);
+            return 1;
+        }
+        xfree(path);
+    }
+    closedir(d);
+
+    /* Directory order is arbitrary, sort it for stable output */
+    qsort(*paths_ptr + first, *npaths - first, sizeof **paths_ptr, pathCompare);
+
+    return 0;
+}
+
+static int pathCompare(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
@@ -0,0 +1,90 @@
+/** @file
+ * Running the same queries on many files at once.
+ */
+
+#ifndef MULTI_H
+#define MULTI_H
+
+#include "query.h"
+#include <stdlib.h>
+#include <stdbool.h>
+
+
+/********************************************************
+ *                     CONSTANTS                        *
+ ********************************************************/
+
+/** The number of finished files per worker thread that may wait
+ * for their turn to be printed (the size of the reorder buffer). */
+#define MULTI_REORDER_PER_THREAD 4
+
+/** The label which takes the place of the file name in the results of
+ * aggregate queries, which are computed over all files. */
+#define MULTI_AGGREGATE_LABEL "*"
+
+
+/********************************************************
+ *                     FUNCTIONS                        *
+ ********************************************************/
+
+/** Expands a list of file arguments into a list of paths.
+ *
+ * Each argument is treated as follows:
+ * - "-" is kept as-is (stdin),
+ * - a directory is replaced by all regular files directly inside
+ *   it, sorted by name,
+ * - anything else is treated as a glob pattern; patterns which
+ *   match nothing are kept as-is (and will fail to open later).
+ *
+ * @param[out] paths_ptr Address of the output array. Every
+ * element, and the array itself, must be freed by the caller.
+ * @param[out] npaths Number of elements in @p paths_ptr.
+ * @param[in] args The file arguments.
+ * @param[in] nargs The number of elements in @p args.
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error (malloc/realloc)
+ */
+int expandPaths(char ***paths_ptr, size_t *npaths, char *const *args, size_t nargs);
+
+/** Runs a list of queries on each file in a list, in parallel.
+ *
+ * Queries are compiled only once and shared by all threads
+ * (each thread binds values into its own arglists). Every file
+ * is scanned exactly like by @ref runQueries, and each result
+ * is printed in format "FILE<TAB>result". Files are independent:
+ * an error in one file is reported on stderr and nothing is
+ * printed for it, but the remaining files are still processed.
+ *
+ * The arguments of aggregate functions are only checked for every
+ * file, and their values are bound into a @ref Batch instead, which
+ * computes them for up to @ref AGG_BLOCK_SIZE files at once.
+ * Aggregate queries are printed once, after the results of all files,
+ * in format "*<TAB>result" (see @ref MULTI_AGGREGATE_LABEL). Files
+ * which fail are left out, and nothing is printed for a query if no
+ * file is left, or if one of its aggregate arguments failed to
+ * evaluate in some file (the result would silently miss a value).
+ *
+ * By default, results are printed in the order of @p paths. Workers
+ * may run ahead of the first unprinted file by no more than
+ * @ref MULTI_REORDER_PER_THREAD files each, so memory use is
+ * bounded no matter how many files there are.
+ *
+ * @param[in] paths The files to run the queries on ("-" for stdin).
+ * @param[in] npaths The number of elements in @p paths.
+ * @param[in] queries An ordered list of queries to run.
+ * @param[in] qcount The number of elements in @p queries.
+ * @param[in] nthreads The number of worker threads (0 means one per CPU).
+ * @param[in] ordered If @c false, results of each file are printed as
+ * soon as it is finished, instead of in the order of @p paths.
+ *
+ * @returns
+ * The first non-zero code (in order of @p paths) that @ref runQueries
+ * would return for a file, or 5 if a file failed to open, or if the
+ * output could not be written. 0 means all files succeeded.
+ */
+int runQueriesMulti(char *const *paths, size_t npaths, const Query **queries, size_t qcount,
+        unsigned nthreads, bool ordered);
+
+#endif /* MULTI_H */
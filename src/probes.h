@@ -0,0 +1,58 @@
+/** @file
+ * USDT (user-level statically defined tracing) probes.
+ *
+ * The probes are only compiled in if @c USDT_PROBES is defined (see
+ * the @c usdt target of the Makefile), which requires <sys/sdt.h>
+ * from SystemTap. Each probe is then a single nop instruction until
+ * a tracer such as bpftrace attaches to it, for example:
+ *
+ *     bpftrace -e 'usdt:./iniget:iniget:eval_end { @[arg0] = count(); }'
+ *
+ * Otherwise the macros expand to no-ops. All probes belong to the
+ * provider "iniget". Query indices are 1-based, like in the output
+ * of --watch.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#ifdef USDT_PROBES
+
+#include <sys/sdt.h>
+
+/** A file is opened for scanning (@p path is a string). */
+#define PROBE_FILE_OPEN(path) \
+    DTRACE_PROBE1(iniget, file_open, (path))
+
+/** A section header is read (@p name is a string). */
+#define PROBE_SECTION(name) \
+    DTRACE_PROBE1(iniget, section, (name))
+
+/** A value is bound to query @p query (@p section and @p key are strings). */
+#define PROBE_BIND(query, section, key) \
+    DTRACE_PROBE3(iniget, bind, (query), (section), (key))
+
+/** Evaluation of query @p query starts. */
+#define PROBE_EVAL_START(query) \
+    DTRACE_PROBE1(iniget, eval_start, (query))
+
+/** Evaluation of query @p query ends with return code @p err of evalQuery. */
+#define PROBE_EVAL_END(query, err) \
+    DTRACE_PROBE2(iniget, eval_end, (query), (err))
+
+/** The program exits with @p status. */
+#define PROBE_EXIT(status) \
+    DTRACE_PROBE1(iniget, exit, (status))
+
+#else
+
+#define PROBE_FILE_OPEN(path)            ((void)0)
+#define PROBE_SECTION(name)              ((void)0)
+#define PROBE_BIND(query, section, key)  ((void)0)
+#define PROBE_EVAL_START(query)          ((void)0)
+#define PROBE_EVAL_END(query, err)       ((void)0)
+#define PROBE_EXIT(status)               ((void)0)
+
+#endif /* USDT_PROBES */
+
+#endif /* PROBES_H */
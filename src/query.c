@@ -1,5 +1,11 @@
 #include "query.h"
+#include "buffer.h"
 #include "arglist.h"
+#include "aggregate.h"
+#include "stats.h"
+#include "trace.h"
+#include "probes.h"
+#include "alloc.h"
 #include "error.h"
 #include <stdlib.h>
 #include <string.h>
@@ -18,7 +24,13 @@ const OpAssoc opAssoc[OP_COUNT] = {
     /* OP_MOD  */ OP_ASSOC_LEFT,
     /* OP_LPR  */ OP_ASSOC_NA,
     /* OP_RPR  */ OP_ASSOC_NA,
-    /* OP_POW  */ OP_ASSOC_RIGHT
+    /* OP_POW  */ OP_ASSOC_RIGHT,
+    /* OP_SUM  */ OP_ASSOC_NA,
+    /* OP_MIN  */ OP_ASSOC_NA,
+    /* OP_MAX  */ OP_ASSOC_NA,
+    /* OP_AVG  */ OP_ASSOC_NA,
+    /* OP_CNT  */ OP_ASSOC_NA,
+    /* OP_JOIN */ OP_ASSOC_NA
 };
 
 /* Define operator precedence */
@@ -31,9 +43,41 @@ const int opPrec[OP_COUNT] = {
     /* OP_MOD  */ 2,
     /* OP_LPR  */ -1, /* non-applicable */
     /* OP_RPR  */ -1, /* non-applicable */
-    /* OP_POW  */ 3
+    /* OP_POW  */ 3,
+    /* OP_SUM  */ -1, /* non-applicable */
+    /* OP_MIN  */ -1, /* non-applicable */
+    /* OP_MAX  */ -1, /* non-applicable */
+    /* OP_AVG  */ -1, /* non-applicable */
+    /* OP_CNT  */ -1, /* non-applicable */
+    /* OP_JOIN */ -1  /* non-applicable */
 };
 
+/* Names of functions, indexed like opAssoc */
+static const char *const opNames[OP_COUNT] = {
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+    "sum", "min", "max", "avg", "count", "join"
+};
+
+/* The section/key pairs which matched wildcard references, with the
+ * layer each was first found in (an open-addressing hash set) */
+typedef struct {
+    char **names;         /* "section\0key" strings, NULL for a free slot */
+    size_t *layers;
+    size_t count, size;   /* size is 0 or a power of 2 */
+} Shadow;
+
+static int bindLayer(FILE *file, const Query **queries, size_t qcount, size_t *matches, bool all,
+        Shadow *shadow, size_t layer);
+static int shadowAdd(Shadow *shadow, const char *section, const char *key, size_t layer, size_t *first);
+static size_t shadowSlot(const Shadow *shadow, const char *section, const char *key);
+static void shadowFree(Shadow *shadow);
+static int getLineHead(FILE *file, char **buf_ptr, size_t *bufsize);
+static int readValue(FILE *file, ArgVal *value, size_t *len);
+static int skipValue(FILE *file, bool *valid, size_t *len);
+static const char *extractKey(const char *i, IniToken *ret);
+static int intOperation(int op, long a, long b, long *result);
+static bool mulOverflows(long a, long b);
+
 int parseQueryString(Query **query_ptr, const char *str)
 {
     Query *new;
@@ -46,7 +90,7 @@ int parseQueryString(Query **query_ptr, const char *str)
     }
 
     /* Allocate a new query */
-    if (!(new = malloc(sizeof *new))) {
+    if (!(new = xmalloc(sizeof *new))) {
         info("memory error");
         return 1;
     }
@@ -55,9 +99,9 @@ int parseQueryString(Query **query_ptr, const char *str)
      * This is necessary, because tokenizeQueryString
      * needs a mutable string.
      */
-    if (!(str_cpy = malloc((strlen(str) + 1) * sizeof *str))) {
+    if (!(str_cpy = xmalloc((strlen(str) + 1) * sizeof *str))) {
         info("memory error");
-        free(new);
+        xfree(new);
         return 1;
     }
     strcpy(str_cpy, str);
@@ -66,24 +110,60 @@ int parseQueryString(Query **query_ptr, const char *str)
     {
         Stack *tokens_infix, *tokens_postfix;
         DataSet *set;
+        int err;
 
         /* Pass-through 1: tokenize, validate and build DataSet */
-        if (tokenizeQueryString(&tokens_infix, &set, str_cpy) < 0) {
-            free(new);
-            free(str_cpy);
+        traceBegin("tokenizeQueryString", NULL);
+        err = tokenizeQueryString(&tokens_infix, &set, str_cpy);
+        traceEnd();
+        if (err < 0) {
+            xfree(new);
+            xfree(str_cpy);
             return 3;
         }
 
         /* Pass-through 2: convert infix to postfix */
-        if (infixPostfix(&tokens_postfix, tokens_infix)) {
+        traceBegin("infixPostfix", NULL);
+        err = infixPostfix(&tokens_postfix, tokens_infix);
+        traceEnd();
+        if (err) {
             STAMP();
             error("infixPostfix failed");
             stackFree(tokens_infix);
-            free(new);
-            free(str_cpy);
+            xfree(new);
+            xfree(str_cpy);
             return 2;
         }
 
+        /* Pass-through 3: locate aggregate functions */
+        switch (findAggregates(&new->aggs, tokens_postfix, set)) {
+            case 0:
+                break;
+            case 1:
+                stackFree(tokens_infix);
+                stackFree(tokens_postfix);
+                datasetFree(set);
+                xfree(new);
+                xfree(str_cpy);
+                return 1;
+            case 3:
+                stackFree(tokens_infix);
+                stackFree(tokens_postfix);
+                datasetFree(set);
+                xfree(new);
+                xfree(str_cpy);
+                return 3;
+            default:
+                STAMP();
+                error("findAggregates failed");
+                stackFree(tokens_infix);
+                stackFree(tokens_postfix);
+                datasetFree(set);
+                xfree(new);
+                xfree(str_cpy);
+                return 2;
+        }
+
         /* Store the results in new query */
         new->set = set;
         new->op_stack = tokens_postfix;
@@ -92,10 +172,12 @@ int parseQueryString(Query **query_ptr, const char *str)
     }
 
     /* Create an adequately-sized arglist */
-    if (!(new->args = arglistCreate(new->set->size))) {
-        info("memory error");
-        free(new);
-        free(str_cpy);
+    if (!(new->args = queryArglistCreate(new))) {
+        datasetFree(new->set);
+        stackFree(new->op_stack);
+        stackFree(new->aggs);
+        xfree(new);
+        xfree(str_cpy);
         return 1;
     }
 
@@ -103,7 +185,7 @@ int parseQueryString(Query **query_ptr, const char *str)
     *query_ptr = new;
 
     /* Cleanup */
-    free(str_cpy);
+    xfree(str_cpy);
 
     return 0;
 }
@@ -119,7 +201,8 @@ int tokenizeQueryString(Stack **tokens_ptr, DataSet **set_ptr, char *str)
         VALUE,  /* a brace-enclosed {operand} */
         OP,     /* an operator */
         LPR,    /* left parenthesis */
-        RPR    /* right parenthesis */
+        RPR,    /* right parenthesis */
+        FUNC    /* a function name */
     } cur_tok, last_tok; /* the type of the current and last read token */
 
     /* Allocate necessary space */
@@ -168,6 +251,9 @@ int tokenizeQueryString(Stack **tokens_ptr, DataSet **set_ptr, char *str)
         /* Skip to the beginning of next token */
         while (isspace(*i))
             i++;
+        if (!*i) {
+            break;
+        }
 
         /* Determine and parse cur_token */
         last_tok = cur_tok;
@@ -188,6 +274,10 @@ int tokenizeQueryString(Stack **tokens_ptr, DataSet **set_ptr, char *str)
                     /* Implicit multiplication */
                     SPUSH(tokens, OP_MUL);
                     break;
+                case FUNC:
+                    info("invalid query (missing '(' after function name at pos %ld)", i - str + 1);
+                    CLEANUP();
+                    return -2;
                 default:
                     STAMP();
                     error("invalid last_tok %d", last_tok);
@@ -199,7 +289,13 @@ int tokenizeQueryString(Stack **tokens_ptr, DataSet **set_ptr, char *str)
             j = i++;
             period = NULL;
             while (*i && *i != '}') {
-                if (*i == '.') {
+                if (*i == '*') {
+                    if (i[1] != '.' && i[1] != '}') {
+                        info("invalid query (wildcard not at the end of a name at pos %ld)", i - str + 1);
+                        CLEANUP();
+                        return -2;
+                    }
+                } else if (*i == '.') {
                     if (!period) {
                         period = i;
                     } else {
@@ -235,14 +331,14 @@ int tokenizeQueryString(Stack **tokens_ptr, DataSet **set_ptr, char *str)
             }
 
             /* Extract section and key subcomponents */
-            if (!(sec = malloc(ssec * sizeof *sec))) {
+            if (!(sec = xmalloc(ssec * sizeof *sec))) {
                 info("memory error");
                 CLEANUP();
                 return -1;
             }
-            if (!(key = malloc(skey * sizeof *key))) {
+            if (!(key = xmalloc(skey * sizeof *key))) {
                 info("memory error");
-                free(sec);
+                xfree(sec);
                 CLEANUP();
                 return -1;
             }
@@ -253,8 +349,8 @@ int tokenizeQueryString(Stack **tokens_ptr, DataSet **set_ptr, char *str)
 
             /* Get index in dataset */
             if ((idx = datasetAdd(set, sec, key)) < 0) {
-                free(sec);
-                free(key);
+                xfree(sec);
+                xfree(key);
                 switch (idx) {
                     case -1:
                         CLEANUP();
@@ -273,8 +369,8 @@ int tokenizeQueryString(Stack **tokens_ptr, DataSet **set_ptr, char *str)
             }
 
             /* Cleanup */
-            free(sec);
-            free(key);
+            xfree(sec);
+            xfree(key);
 
             /* Push index to the tokens stack */
             SPUSH(tokens, idx);
@@ -286,7 +382,7 @@ int tokenizeQueryString(Stack **tokens_ptr, DataSet **set_ptr, char *str)
 
             /* Catch syntax errors */
             switch (last_tok) {
-                case BEGIN: case OP: case LPR:
+                case BEGIN: case OP: case LPR: case FUNC:
                     /* Gracefully break */
                     break;
                 case VALUE: case RPR:
@@ -322,6 +418,10 @@ int tokenizeQueryString(Stack **tokens_ptr, DataSet **set_ptr, char *str)
                     info("invalid query (missing expression inside parentheses at pos %ld)", i - str + 1);
                     CLEANUP();
                     return -3;
+                case FUNC:
+                    info("invalid query (missing '(' after function name at pos %ld)", i - str + 1);
+                    CLEANUP();
+                    return -2;
                 default:
                     STAMP();
                     error("invalid last_tok %d", last_tok);
@@ -368,6 +468,10 @@ int tokenizeQueryString(Stack **tokens_ptr, DataSet **set_ptr, char *str)
                     info("invalid query (missing operand between opening parenthesis and operator at pos %ld)", i - str + 1);
                     CLEANUP();
                     return -3;
+                case FUNC:
+                    info("invalid query (missing '(' after function name at pos %ld)", i - str + 1);
+                    CLEANUP();
+                    return -2;
                 default:
                     STAMP();
                     error("invalid last_tok %d", last_tok);
@@ -390,6 +494,48 @@ int tokenizeQueryString(Stack **tokens_ptr, DataSet **set_ptr, char *str)
             }
 
             i++;
+        } else if (isalpha(*i)) {
+            int op;
+
+            cur_tok = FUNC;
+
+            /* Catch syntax errors */
+            switch (last_tok) {
+                case BEGIN: case OP: case LPR:
+                    /* Gracefully break */
+                    break;
+                case VALUE: case RPR:
+                    /* Implicit multiplication */
+                    SPUSH(tokens, OP_MUL);
+                    break;
+                case FUNC:
+                    info("invalid query (missing '(' after function name at pos %ld)", i - str + 1);
+                    CLEANUP();
+                    return -2;
+                default:
+                    STAMP();
+                    error("invalid last_tok %d", last_tok);
+                    CLEANUP();
+                    return -3;
+            }
+
+            /* Find the function by name */
+            j = i;
+            while (isalpha(*i))
+                i++;
+            for (op = OP_SUM; op > -OP_COUNT; op--) {
+                if (opNames[-op] && strlen(opNames[-op]) == (size_t)(i - j)
+                        && strncmp(opNames[-op], j, i - j) == 0) {
+                    break;
+                }
+            }
+            if (op == -OP_COUNT) {
+                info("invalid query (unknown function '%.*s' at pos %ld)", (int)(i - j), j, j - str + 1);
+                CLEANUP();
+                return -2;
+            }
+
+            SPUSH(tokens, op);
         } else {
             info("invalid query (illegal character '%c' at pos %ld)", *i, i - str + 1);
             CLEANUP();
@@ -397,6 +543,29 @@ int tokenizeQueryString(Stack **tokens_ptr, DataSet **set_ptr, char *str)
         }
     }
 
+    /* Catch errors at the end of the query */
+    switch (cur_tok) {
+        case BEGIN:
+            info("invalid query");
+            CLEANUP();
+            return -2;
+        case OP: case LPR:
+            info("invalid query (missing operand at the end)");
+            CLEANUP();
+            return -2;
+        case FUNC:
+            info("invalid query (missing '(' after function name at the end)");
+            CLEANUP();
+            return -2;
+        default:
+            break;
+    }
+    if (parens->size) {
+        info("invalid query (unbalanced parentheses)");
+        CLEANUP();
+        return -2;
+    }
+
     /* Export results */
     *tokens_ptr = tokens;
     *set_ptr = set;
@@ -496,7 +665,9 @@ int infixPostfix(Stack **postfix_ptr, const Stack *infix)
                     SPUSH(ops, tok);
 
                     break;
-                case OP_LPR:
+                case OP_LPR: /* fallthrough */
+                case OP_SUM: case OP_MIN: case OP_MAX: /* fallthrough */
+                case OP_AVG: case OP_CNT: case OP_JOIN:
                     SPUSH(ops, tok);
                     break;
                 case OP_RPR:
@@ -524,6 +695,13 @@ int infixPostfix(Stack **postfix_ptr, const Stack *infix)
                     /* Discard the left parenthesis */
                     stackPop(ops);
 
+                    /* Parentheses of a function call end with the function */
+                    top = stackPeek(ops);
+                    if (OP_IS_AGGREGATE(top)) {
+                        stackPop(ops);
+                        SPUSH(new, top);
+                    }
+
                     break;
                 default:
                     STAMP();
@@ -559,6 +737,133 @@ int infixPostfix(Stack **postfix_ptr, const Stack *infix)
     return 0;
 }
 
+int findAggregates(Stack **aggs_ptr, const Stack *postfix, const DataSet *set)
+{
+    Stack *aggs;
+    bool outside; /* true if some operand is outside of all aggregates */
+    size_t i;
+
+    if (!postfix || !set) {
+        STAMP();
+        error("postfix or set is NULL");
+        return 2;
+    }
+
+    /* A wildcard is a list of values, which only an aggregate function
+     * can reduce to one. In postfix order, the function which takes the
+     * operand as its whole argument directly follows it. */
+    for (i = 0; i < postfix->size; i++) {
+        int tok = postfix->data[i];
+
+        if (tok >= 0 && (size_t)tok < set->size && set->data[tok].wildcard
+                && (i + 1 == postfix->size || !OP_IS_AGGREGATE(postfix->data[i + 1]))) {
+            info("invalid query (wildcard {%s%s%s} must be the only argument of an aggregate function)",
+                    set->data[tok].section, (*set->data[tok].section)? "." : "", set->data[tok].key);
+            return 3;
+        }
+    }
+
+    if (!(aggs = stackCreate())) {
+        return 1;
+    }
+
+    /* Walk backwards, so that each function is found before its argument */
+    outside = false;
+    i = postfix->size;
+    while (i-- > 0) {
+        int tok = postfix->data[i];
+
+        if (OP_IS_AGGREGATE(tok)) {
+            size_t need = 1; /* the number of operands yet to be found */
+            size_t j = i;
+
+            /* Find where the argument begins */
+            while (need && j-- > 0) {
+                if (postfix->data[j] >= 0) {
+                    need--;
+                } else if (OP_IS_AGGREGATE(postfix->data[j])) {
+                    info("invalid query (aggregate functions cannot be nested)");
+                    stackFree(aggs);
+                    return 3;
+                } else {
+                    need++;
+                }
+            }
+            if (need) {
+                STAMP();
+                error("aggregate function without argument");
+                stackFree(aggs);
+                return 2;
+            }
+
+            /* Stored backwards, reversed below */
+            if (stackPush(aggs, i) || stackPush(aggs, j)) {
+                stackFree(aggs);
+                return 1;
+            }
+
+            /* Skip the argument */
+            i = j;
+        } else if (tok >= 0) {
+            outside = true;
+        }
+    }
+
+    /* An operand outside of any aggregate would have to be taken
+     * from a single file, which makes no sense with multiple files */
+    if (aggs->size && outside) {
+        info("invalid query (values must be inside aggregate functions, if any are used)");
+        stackFree(aggs);
+        return 3;
+    }
+
+    /* Restore the order of appearance */
+    for (i = 0; i < aggs->size / 2; i++) {
+        int tmp = aggs->data[i];
+        aggs->data[i] = aggs->data[aggs->size - 1 - i];
+        aggs->data[aggs->size - 1 - i] = tmp;
+    }
+
+    *aggs_ptr = aggs;
+
+    return 0;
+}
+
+ArgList *queryArglistCreate(const Query *query)
+{
+    ArgList *args;
+    size_t i;
+
+    if (!(args = arglistCreate(query->set->size))) {
+        return NULL;
+    }
+
+    /* Shortcut: accumulators are only needed for wildcards */
+    for (i = 0; i < query->set->size && !query->set->data[i].wildcard; i++)
+        ;
+    if (i == query->set->size) {
+        return args;
+    }
+
+    if (!(args->accs = xmalloc(args->size * sizeof *args->accs))) {
+        info("memory error");
+        arglistFree(args);
+        return NULL;
+    }
+    for (i = 0; i < args->size; i++) {
+        accumInit(args->accs + i);
+    }
+
+    /* Only build joined strings where they are needed */
+    for (i = 0; i + 1 < query->op_stack->size; i++) {
+        if (query->op_stack->data[i] >= 0 && query->op_stack->data[i + 1] == OP_JOIN) {
+            args->accs[query->op_stack->data[i]].build_join = true;
+        }
+    }
+
+    return args;
+}
+
 void queryFree(Query *query)
 {
     if (!query) {
@@ -570,59 +875,141 @@ void queryFree(Query *query)
     datasetFree(query->set);
     arglistFree(query->args);
     stackFree(query->op_stack);
-    free(query);
+    stackFree(query->aggs);
+    xfree(query);
 }
 
 int runQueries(FILE *file, const Query **queries, size_t qcount)
+{
+    return runLayers(&file, 1, queries, qcount);
+}
+
+int runLayers(FILE *const *files, size_t nfiles, const Query **queries, size_t qcount)
+{
+    int err;
+
+    if ((err = bindLayers(files, nfiles, queries, qcount))) {
+        if (err == 4) {
+            reportMissing(queries, qcount);
+        }
+        return err;
+    }
+
+    /* All queries' arglists are populated, so
+     * run computations and print the results. */
+    return printQueries(queries, qcount);
+}
+
+int bindQueries(FILE *file, const Query **queries, size_t qcount)
+{
+    return bindLayers(&file, 1, queries, qcount);
+}
+
+int bindLayers(FILE *const *files, size_t nfiles, const Query **queries, size_t qcount)
+{
+    size_t matches; /* The number of yet-to-be-found section/value pairs */
+    bool   all;     /* True if every file must be read (for wildcards) */
+    Shadow shadow;  /* The pairs matched by wildcards so far */
+    size_t i, k;
+    int    err;
+
+    /* Reset all query args to BLANK and count expected matches*/
+    matches = 0;
+    all = false;
+    for (i = 0; i < qcount; i++) {
+        size_t j;
+        arglistClear(queries[i]->args);
+        for (j = 0; j < queries[i]->set->size; j++) {
+            if (queries[i]->set->data[j].wildcard) {
+                all = true;
+            } else {
+                matches++;
+            }
+        }
+    }
+
+    /* Layers are read from the highest priority down, and only as long as
+     * some values are still missing. A pair in a higher layer hides the
+     * same pair in lower ones from wildcards (references are bound once) */
+    shadow.names = NULL;
+    shadow.layers = NULL;
+    shadow.count = shadow.size = 0;
+    err = 0;
+    for (k = 0; k < nfiles && !err && (matches || all); k++) {
+        err = bindLayer(files[nfiles - 1 - k], queries, qcount, &matches, all,
+                (nfiles > 1 && all)? &shadow : NULL, k);
+    }
+    shadowFree(&shadow);
+    if (err) {
+        return err;
+    }
+
+    return matches? 4 : 0;
+}
+
+/* Binds the values of one layer (see bindLayers), with the number of missing
+ * values in matches. If shadow is not NULL, pairs matching wildcards are
+ * recorded in it, and skipped if a higher layer than this one defined them.
+ * Returns the same as bindQueries, but 0 if values are missing */
+static int bindLayer(FILE *file, const Query **queries, size_t qcount, size_t *matches, bool all,
+        Shadow *shadow, size_t layer)
 {
     char  *line;    /* Stores an entire line from file */
     size_t lsize;   /* Remembers the line size */
+    int    head;    /* The return code of getLineHead */
     bool   eof;     /* True if EOF was read */
     char  *section; /* Remembers the current section */
     size_t ssize;   /* Remembers the section size */
-    size_t matches; /* The number of yet-to-be-found section/value pairs */
     size_t i;
+    unsigned long nbytes, nlines, nkeys, nbound; /* counters for stats */
+    StatsTimer scan_timer; /* split into scan and bind laps */
+    unsigned long mark; /* The offset at which the next trace chunk begins */
 
     /* Allocate initial line and section buffers */
     lsize = 256; /* Arbitrary non-zero initial size */
-    if (!(line = malloc(lsize * sizeof *line))) {
+    if (!(line = xmalloc(lsize * sizeof *line))) {
         info("memory error");
         return 1;
     }
     ssize = 256; /* Arbitrary non-zero initial size */
-    if (!(section = malloc(ssize * sizeof *section))) {
+    if (!(section = xmalloc(ssize * sizeof *section))) {
         info("memory error");
-        free(line);
+        xfree(line);
         return 1;
     }
     section[0] = '\0'; /* Initialize section to none ("global scope") */
 
-    /* Reset all query args to BLANK and count expected matches*/
-    matches = 0;
-    for (i = 0; i < qcount; i++) {
-        arglistClear(queries[i]->args);
-        matches += queries[i]->args->size;
-    }
-
     /* Temporary convenience macro */
 #define CLEANUP() do { \
-                    free(line); \
-                    free(section); \
+                    xfree(line); \
+                    xfree(section); \
+                    traceEnd(); \
+                    traceEnd(); \
                 } while (0)
 
+    statsStartCounted(&scan_timer);
+    traceBegin("scan", NULL);
+    traceBegin("scan chunk", "bytes from 0");
+    mark = TRACE_CHUNK_SIZE;
+    nbytes = nlines = nkeys = nbound = 0;
     eof = false;
     do {
         IniToken tok;
-
-        /* Fetch next line */
-        switch (getLine(file, &line, &lsize)) {
-            case 0:
+        bool pending;   /* True if the value of the line is not read yet */
+        bool taken;     /* True if an arglist took over the value */
+        int hidden;     /* 1 if a higher layer has the pair, 0 if not, -1 if unknown */
+        size_t rest;    /* The number of bytes read after the line head */
+
+        /* Fetch next line, up to the value of a key/value pair */
+        switch ((head = getLineHead(file, &line, &lsize))) {
+            case 0: case 3:
                 break;
             case 1:
+                CLEANUP();
                 return 1;
             case 2:
                 STAMP();
-                error("getLine internal error");
+                error("getLineHead internal error");
                 CLEANUP();
                 return 2;
             case EOF:
@@ -630,16 +1017,32 @@ int runQueries(FILE *file, const Query **queries, size_t qcount)
                 break;
             default:
                 STAMP();
-                error("unmatched return code of getLine");
+                error("unmatched return code of getLineHead");
                 CLEANUP();
                 return 2;
         }
+        nlines++;
+        if (stats.enabled || tracing) {
+            nbytes += strlen(line) + (head == 0);
+        }
+        if (tracing && nbytes >= mark) {
+            traceEnd();
+            traceBegin("scan chunk", "bytes from %lu", nbytes);
+            mark = nbytes + TRACE_CHUNK_SIZE;
+        }
 
-        /* Parse INI line */
-        tok = iniExtractFromLine(line);
+        /* Parse INI line. The value of a key/value pair is only read if it is
+         * referenced, the rest of any other line is of no interest. */
+        tok = (head == 3)? iniExtractFromHead(line) : iniExtractFromLine(line);
+        pending = tok.type == INI_LINE_KVPAIR && tok.content.kvpair.value.type == ARGVAL_TYPE_NONE;
+        if (head == 3 && !pending && tok.type != INI_LINE_ERROR) {
+            bool valid;
+            eof = skipValue(file, &valid, &rest) == EOF;
+            nbytes += rest + !eof;
+        }
         switch (tok.type) {
             case INI_LINE_ERROR:
-                free(line);
+                CLEANUP();
                 return 1;
             case INI_LINE_INTERROR:
                 STAMP();
@@ -650,50 +1053,107 @@ int runQueries(FILE *file, const Query **queries, size_t qcount)
                 /* Update section string */
                 if (ssize < strlen(tok.content.section) + 1) {
                     ssize *= 2;
-                    if (!(section = realloc(section, ssize * sizeof *section))) {
+                    if (!(section = xrealloc(section, ssize * sizeof *section))) {
                         info("memory error");
                         CLEANUP();
                         return 1;
                     }
                 }
                 strcpy(section, tok.content.section);
-                free(tok.content.section);
+                xfree(tok.content.section);
+                PROBE_SECTION(section);
                 break;
             case INI_LINE_KVPAIR:
+                nkeys++;
+                statsSplit(&scan_timer, STATS_SCAN);
+
                 /* Populate matched query parameters with value */
+                taken = false;
+                hidden = shadow? -1 : 0;
                 for (i = 0; i < qcount; i++) {
                     size_t j;
                     for (j = 0; j < queries[i]->set->size; j++) {
                         /* Cache deeply nested variables */
-                        char *sec = queries[i]->set->data[j].section;
-                        char *key = queries[i]->set->data[j].key;
-
-                        /* Copy in-file value into all matched indices in arglists */
-                        if (strcmp(section, sec) == 0
-                                && strcmp(tok.content.kvpair.key, key) == 0
-                                && queries[i]->args->data[j].type == ARGVAL_TYPE_NONE) {
-
-                            queries[i]->args->data[j] = tok.content.kvpair.value;
+                        const Data *const data = queries[i]->set->data + j;
+                        ArgVal *const value = &tok.content.kvpair.value;
 
-                            /* If the value type is string, deepcopy it */
-                            if (tok.content.kvpair.value.type == ARGVAL_TYPE_STRING) {
-                                char *buf;
-                                if (!(buf = malloc((strlen(tok.content.kvpair.value.value.s) + 1) * sizeof *buf))) {
-                                    info("memory error");
+                        if (data->wildcard) {
+                            if (!dataMatches(data, section, tok.content.kvpair.key)) {
+                                continue;
+                            }
+                            if (hidden < 0) {
+                                size_t first;
+                                if (shadowAdd(shadow, section, tok.content.kvpair.key, layer, &first)) {
+                                    xfree(tok.content.kvpair.key);
                                     CLEANUP();
                                     return 1;
                                 }
-                                strcpy(buf, tok.content.kvpair.value.value.s);
-                                queries[i]->args->data[j].value.s = buf;
+                                hidden = first < layer;
+                            }
+                            if (hidden) {
+                                continue;
+                            }
+                        } else if (queries[i]->args->types[j] != ARGVAL_TYPE_NONE
+                                || !dataMatches(data, section, tok.content.kvpair.key)) {
+                            continue;
+                        }
+
+                        /* The value is read once it is needed (reading is scan time) */
+                        if (pending) {
+                            int ret;
+                            statsSplit(&scan_timer, STATS_BIND);
+                            ret = readValue(file, value, &rest);
+                            statsSplit(&scan_timer, STATS_SCAN);
+                            if (ret == 1) {
+                                xfree(tok.content.kvpair.key);
+                                CLEANUP();
+                                return 1;
+                            }
+                            eof = ret == EOF;
+                            nbytes += rest + !eof;
+                            pending = false;
+                        }
+
+                        /* Stream wildcard matches into their accumulators, and copy
+                         * in-file value into all matched indices in arglists (the
+                         * first one takes the value over) */
+                        if (data->wildcard? accumAdd(queries[i]->args->accs + j, value)
+                                : taken? arglistSet(queries[i]->args, j, value)
+                                : arglistTake(queries[i]->args, j, value)) {
+                            xfree(tok.content.kvpair.key);
+                            if (value->type == ARGVAL_TYPE_STRING && !taken) {
+                                xfree(value->value.s);
                             }
+                            CLEANUP();
+                            return 1;
+                        }
 
-                            matches--;
+                        PROBE_BIND(i + 1, section, tok.content.kvpair.key);
+                        nbound++;
+                        if (!data->wildcard) {
+                            taken = true;
+                            (*matches)--;
                         }
                     }
                 }
-                free(tok.content.kvpair.key);
-                if (tok.content.kvpair.value.type == ARGVAL_TYPE_STRING) {
-                    free(tok.content.kvpair.value.value.s);
+
+                statsSplit(&scan_timer, STATS_BIND);
+
+                /* Skip the value if nothing needs it (it must still be there) */
+                if (pending) {
+                    bool valid;
+                    eof = skipValue(file, &valid, &rest) == EOF;
+                    nbytes += rest + !eof;
+                    if (!valid) {
+                        info("error found in file (no value after key name)");
+                        xfree(tok.content.kvpair.key);
+                        CLEANUP();
+                        return 1;
+                    }
+                }
+                xfree(tok.content.kvpair.key);
+                if (tok.content.kvpair.value.type == ARGVAL_TYPE_STRING && !taken) {
+                    xfree(tok.content.kvpair.value.value.s);
                 }
                 break;
             case INI_LINE_BLANK:
@@ -706,37 +1166,47 @@ int runQueries(FILE *file, const Query **queries, size_t qcount)
         }
 
         /* If all matches were found, stop reading */
-        if (matches == 0) {
+        if (*matches == 0 && !all && !eof) {
             eof = true;
+            if (stats.enabled) {
+                stats.exit_offset = nbytes;
+            }
         }
 
     } while (!eof);
 
-    /* Report not found values */
-    if (matches) {
-        info("failed to find the following values:");
-        for (i = 0; i < qcount; i++) {
-            size_t j;
-            for (j = 0; j < queries[i]->args->size; j++) {
-                const Data *const data = queries[i]->set->data + j; /* cache */
+    /* Cleanup */
+    xfree(line);
+    xfree(section);
+#undef CLEANUP
 
-                if (queries[i]->args->data[j].type == ARGVAL_TYPE_NONE) {
-                    fprintf(stderr, "->\t%s%s%s\n", data->section, (*data->section)? "." : "", data->key);
-                }
-            }
-        }
-        CLEANUP();
-        return 4;
+    traceEnd();
+    traceEnd();
+    statsStop(&scan_timer, STATS_SCAN);
+    if (stats.enabled) {
+        stats.bytes += nbytes;
+        stats.lines += nlines;
+        stats.key_lines += nkeys;
+        stats.matches += nbound;
     }
 
-    /* Cleanup */
-    free(line);
-    free(section);
-#undef CLEANUP
+    return 0;
+}
 
-    /* All queries' arglists are populated, so
-     * run computations and print the results. */
-    return printQueries(queries, qcount);
+void reportMissing(const Query **queries, size_t qcount)
+{
+    size_t i, j;
+
+    info("failed to find the following values:");
+    for (i = 0; i < qcount; i++) {
+        for (j = 0; j < queries[i]->args->size; j++) {
+            const Data *const data = queries[i]->set->data + j; /* cache */
+
+            if (queries[i]->args->types[j] == ARGVAL_TYPE_NONE && !data->wildcard) {
+                fprintf(stderr, "->\t%s%s%s\n", data->section, (*data->section)? "." : "", data->key);
+            }
+        }
+    }
 }
 
 int getLine(FILE *file, char **buf_ptr, size_t *bufsize)
@@ -758,7 +1228,7 @@ int getLine(FILE *file, char **buf_ptr, size_t *bufsize)
         /* Enlarge buffer if needed */
         if (pos == *bufsize - 1) {
             *bufsize *= 2;
-            if (!(*buf_ptr = realloc(*buf_ptr, *bufsize * sizeof **buf_ptr))) {
+            if (!(*buf_ptr = xrealloc(*buf_ptr, *bufsize * sizeof **buf_ptr))) {
                 info("memory error");
                 return 1;
             }
@@ -805,7 +1275,7 @@ IniToken iniExtractFromLine(const char *line)
         }
 
         /* Store the section name in a new buffer */
-        if (!(ret.content.section = malloc((i - j + 1) * sizeof *ret.content.section))) {
+        if (!(ret.content.section = xmalloc((i - j + 1) * sizeof *ret.content.section))) {
             info("memory error");
             ret.type = INI_LINE_ERROR;
             return ret;
@@ -813,68 +1283,27 @@ IniToken iniExtractFromLine(const char *line)
         strncpy(ret.content.section, j, i - j + 1);
         ret.content.section[i - j] = '\0';
     } else if (isalnum(*i) || *i == '_' || *i == '-') {
-        char *val; /* Storage for the value part */
-
         ret.type = INI_LINE_KVPAIR;
-
-        /* Find end of the key part */
-        j = i;
-        while (*i && !isspace(*i) && *i != '=')
-            i++;
-        if (!*i) {
-            info("error found in file (no value after key name)");
-            ret.type = INI_LINE_ERROR;
-            return ret;
-        }
-
-        /* Store the key part in a new buffer */
-        if (!(ret.content.kvpair.key = malloc((i - j + 1) * sizeof *ret.content.kvpair.key))) {
-            info("memory error");
-            ret.type = INI_LINE_ERROR;
-            return ret;
-        }
-        strncpy(ret.content.kvpair.key, j, i - j + 1);
-        ret.content.kvpair.key[i - j] = '\0';
-
-        /* Search for '=' delimiter */
-        while (*i && *i != '=')
-            i++;
-        if (*i != '=') {
-            info("error found in file (no value after key name)");
-            ret.type = INI_LINE_ERROR;
+        if (!(i = extractKey(i, &ret))) {
             return ret;
         }
 
         /* Skip whitespace */
-        ++i;
         while (*i && isspace(*i))
             i++;
         if (!*i) {
             info("error found in file (no value after key name)");
+            xfree(ret.content.kvpair.key);
             ret.type = INI_LINE_ERROR;
             return ret;
         }
 
-        /* Find end of the value part */
-        j = i;
-        while (*i++)
-            ;
-
-        /* Store the value part in a new buffer */
-        if (!(val = malloc((i - j + 1) * sizeof *val))) {
-            info("memory error");
-            ret.type = INI_LINE_ERROR;
-            return ret;
-        }
-        strncpy(val, j, i - j + 1);
-        val[i - j] = '\0';
-
         /* Determine type of the value */
-        ret.content.kvpair.value = argValGetFromString(val);
+        ret.content.kvpair.value = argValFromRange(i, i + strlen(i));
         if (ret.content.kvpair.value.type == ARGVAL_TYPE_NONE) {
+            xfree(ret.content.kvpair.key);
             ret.type = INI_LINE_ERROR;
         }
-        free(val);
     } else if (*i == ';' || !*i) {
         ret.type = INI_LINE_BLANK;
     } else {
@@ -885,233 +1314,703 @@ IniToken iniExtractFromLine(const char *line)
     return ret;
 }
 
-int printQueries(const Query **queries, size_t qcount)
+IniToken iniExtractFromHead(const char *head)
 {
-    ValStack *vstack; /* evaluation stack */
-    size_t i, j;
+    const size_t len = strlen(head);
+    const char *i;
+    IniToken ret;
 
-    if (!(vstack = valstackCreate())) {
-        info("memory error");
-        return 1;
+    /* Only a key/value pair is not complete at its first '=' */
+    i = head;
+    while (isspace(*i))
+        i++;
+    if (len == 0 || head[len - 1] != '=' || !(isalnum(*i) || *i == '_' || *i == '-')) {
+        return iniExtractFromLine(head);
     }
 
-    for (i = 0; i < qcount; i++) {
-        const Query *const query = queries[i]; /* shortcut */
-        const Stack *const op_stack = query->op_stack; /* shortcut */
-        ArgVal result;
+    ret.type = INI_LINE_KVPAIR;
+    if (extractKey(i, &ret)) {
+        ret.content.kvpair.value.type = ARGVAL_TYPE_NONE;
+    }
 
-        for (j = 0; j < op_stack->size; j++) {
-            int idx, err;
+    return ret;
+}
 
-            idx = op_stack->data[j];
+bool iniValueValid(const char *beg, const char *end)
+{
+    while (beg < end && *beg && isspace(*beg))
+        beg++;
+    if (beg == end || !*beg) {
+        info("error found in file (no value after key name)");
+        return false;
+    }
 
-            if (idx >= 0) {
-                ArgVal val;
+    return true;
+}
 
-                if (idx >= (int)query->set->size) {
-                    STAMP();
-                    error("op_stack index (%d) out of DataSet range (%d)", idx, query->set->size);
-                    valstackFree(vstack);
-                    return 2;
-                }
+int evalQuery(const Query *query, ValStack *vstack, ArgVal *result)
+{
+    return evalQueryRange(query, vstack, 0, query->op_stack->size, NULL, result);
+}
 
-                /* Push value onto the vstack */
-                val = query->args->data[idx];
-                if ((err = valstackPush(vstack, val))) {
-                    STAMP();
-                    error("failed to push value onto vstack");
-                    valstackFree(vstack);
-                    return (err == 1)? 1 : 2;
-                }
-            } else {
-                /* Pop 2 operands and push operation result */
-                ArgVal i1, i2, i3;
+int evalQueryRange(const Query *query, ValStack *vstack, size_t beg, size_t end,
+        const ArgVal *aggvals, ArgVal *result)
+{
+    const Stack *const op_stack = query->op_stack; /* shortcut */
+    size_t j, k;
+
+    /* Skip aggregates which are outside of the range */
+    for (k = 0; k < query->aggs->size && query->aggs->data[k] < (int)beg; k += 2)
+        ;
+
+    for (j = beg; j < end; j++) {
+        int idx, err;
+
+        idx = op_stack->data[j];
+
+        if (aggvals && k < query->aggs->size && (int)j == query->aggs->data[k]) {
+            /* Substitute the whole aggregate with its final value */
+            ArgVal val = aggvals[k / 2];
+            val.is_temporary = false;
+            if ((err = valstackPush(vstack, val))) {
+                valstackClear(vstack);
+                return (err == 1)? 1 : 2;
+            }
+            j = query->aggs->data[k + 1];
+            k += 2;
+        } else if (idx >= 0 && (size_t)idx < query->set->size && query->set->data[idx].wildcard) {
+            /* Aggregate of a wildcard (always directly followed by the function) */
+            ArgVal val;
+
+            if (j + 1 >= end || !query->args->accs) {
+                STAMP();
+                error("wildcard outside of an aggregate function");
+                valstackClear(vstack);
+                return 2;
+            }
+            if ((err = accumResult(query->args->accs + idx, op_stack->data[++j], &val))) {
+                valstackClear(vstack);
+                return err;
+            }
+            if ((err = valstackPush(vstack, val))) {
+                valstackClear(vstack);
+                return (err == 1)? 1 : 2;
+            }
+        } else if (OP_IS_AGGREGATE(idx)) {
+            /* Aggregate of a single value */
+            ArgVal val = valstackPop(vstack);
 
-                i2 = valstackPop(vstack);
-                if (i2.type == ARGVAL_TYPE_NONE) {
+            switch (val.type) {
+                case ARGVAL_TYPE_FLOAT: case ARGVAL_TYPE_INT:
+                    break;
+                case ARGVAL_TYPE_STRING:
+                    if (idx != OP_CNT && idx != OP_JOIN) {
+                        info("illegal operation (cannot aggregate a string with %s)", opNames[-idx]);
+                        if (val.is_temporary) {
+                            xfree(val.value.s);
+                        }
+                        valstackClear(vstack);
+                        return 3;
+                    }
+                    break;
+                default:
                     STAMP();
-                    error("failed to pop from vstack (%.0d)", i2.value.f);
-                    valstackFree(vstack);
+                    error("failed to pop from vstack (%.0d)", val.value.f);
+                    valstackClear(vstack);
                     return 2;
+            }
+            if (idx == OP_CNT) {
+                if (val.type == ARGVAL_TYPE_STRING && val.is_temporary) {
+                    xfree(val.value.s);
                 }
+                val.type = ARGVAL_TYPE_INT;
+                val.value.i = 1;
+            } else if (idx == OP_JOIN && val.type != ARGVAL_TYPE_STRING) {
+                char buf[ARGVAL_NUMBER_SIZE];
 
-                i1 = valstackPop(vstack);
-                if (i1.type == ARGVAL_TYPE_NONE) {
-                    STAMP();
-                    error("failed to pop from vstack (%.0d)", i1.value.f);
-                    valstackFree(vstack);
-                    return 2;
+                argValFormatNumber(buf, &val);
+                if (!(val.value.s = xmalloc((strlen(buf) + 1) * sizeof *val.value.s))) {
+                    info("memory error");
+                    valstackClear(vstack);
+                    return 1;
                 }
+                strcpy(val.value.s, buf);
+                val.type = ARGVAL_TYPE_STRING;
+                val.is_temporary = true;
+            }
+            if ((err = valstackPush(vstack, val))) {
+                valstackClear(vstack);
+                return (err == 1)? 1 : 2;
+            }
+        } else if (idx >= 0) {
+            ArgVal val;
 
-                /* Perform operation */
-                if (i1.type == ARGVAL_TYPE_FLOAT && i2.type == ARGVAL_TYPE_FLOAT) {
-                    i3.type = ARGVAL_TYPE_FLOAT;
-                    switch (idx) {
-                        case OP_ADD:
-                            i3.value.f = i1.value.f + i2.value.f;
-                            break;
-                        case OP_SUB:
-                            i3.value.f = i1.value.f - i2.value.f;
-                            break;
-                        case OP_MUL:
-                            i3.value.f = i1.value.f * i2.value.f;
-                            break;
-                        case OP_DIV:
-                            if (i2.value.f == 0) {
-                                info("cannot divide by 0");
-                                valstackFree(vstack);
-                                return 3;
-                            }
-                            i3.value.f = i1.value.f / i2.value.f;
-                            break;
-                        case OP_MOD:
-                            i3.value.f = fmod(i1.value.f, i2.value.f);
-                            break;
-                        case OP_POW:
-                            i3.value.f = pow(i1.value.f, i2.value.f);
-                            break;
-                        default:
-                            STAMP();
-                            error("unmatched operator index (%d)", idx);
-                            valstackFree(vstack);
-                            return 2;
-                    }
-                } else if (i1.type == ARGVAL_TYPE_STRING && i2.type == ARGVAL_TYPE_STRING) {
-                    size_t s1, s3;
-                    i3.type = ARGVAL_TYPE_STRING;
-                    switch (idx) {
-                        case OP_ADD:
-                            s1 = strlen(i1.value.s);
-                            s3 = s1 + strlen(i2.value.s);
-                            if (!(i3.value.s = malloc((s3 + 1) * sizeof *i3.value.s))) {
-                                info("memory error");
-                                valstackFree(vstack);
-                                return 1;
-                            }
-                            strcpy(i3.value.s, i1.value.s);
-                            strcpy(i3.value.s + s1, i2.value.s);
-                            i3.is_temporary = true;
-                            break;
-                        case OP_SUB: case OP_MUL: case OP_DIV: /* fallthrough */
-                        case OP_MOD: case OP_POW:
-                            info("illegal operation on two strings");
-                            valstackFree(vstack);
-                            return 3;
-                        default:
-                            STAMP();
-                            error("unmatched operator index (%d)", idx);
-                            valstackFree(vstack);
-                            return 2;
-                    }
-                } else if ((i1.type == ARGVAL_TYPE_STRING && i2.type == ARGVAL_TYPE_FLOAT)
-                        || (i1.type == ARGVAL_TYPE_FLOAT && i2.type == ARGVAL_TYPE_STRING)) {
-
-                    size_t s1, s3;
-                    const char *str;
-                    double num_f;
-                    size_t num, k;
-
-                    switch (idx) {
-                        case OP_MUL:
-                            /* Support Python-like string multiplication */
-                            i3.type = ARGVAL_TYPE_STRING;
-                            i3.is_temporary = true;
-
-                            if (i1.type == ARGVAL_TYPE_STRING) {
-                                str = i1.value.s;
-                                num_f = i2.value.f;
-                            } else {
-                                str = i2.value.s;
-                                num_f = i1.value.f;
-                            }
+            if (idx >= (int)query->set->size) {
+                STAMP();
+                error("op_stack index (%d) out of DataSet range (%d)", idx, query->set->size);
+                valstackClear(vstack);
+                return 2;
+            }
 
-                            s1 = strlen(str);
-
-                            /* Prevent integer overflow */
-                            if (i2.value.f > (double)ULONG_MAX) {
-                                info("cannot multiply a string by %.0g (factor too large)", i2.value.f);
-                                valstackFree(vstack);
-                                return 3;
-                            } else if (i2.value.f > (double)ULONG_MAX / s1 - 1) {
-                                info("cannot multiply a string by %.0g (resulting string too long)", i2.value.f);
-                                valstackFree(vstack);
-                                return 3;
-                            }
-                            num = (size_t)num_f;
+            /* Push value onto the vstack */
+            val = arglistGet(query->args, idx);
+            if ((err = valstackPush(vstack, val))) {
+                STAMP();
+                error("failed to push value onto vstack");
+                valstackClear(vstack);
+                return (err == 1)? 1 : 2;
+            }
+        } else {
+            /* Pop 2 operands and push operation result */
+            ArgVal i1, i2, i3;
 
-                            s3 = s1 * num;
+            i2 = valstackPop(vstack);
+            if (i2.type == ARGVAL_TYPE_NONE) {
+                STAMP();
+                error("failed to pop from vstack (%.0d)", i2.value.f);
+                valstackClear(vstack);
+                return 2;
+            }
 
-                            if (!(i3.value.s = malloc((s3 + 1) * sizeof *i3.value.s))) {
-                                info("memory error");
-                                valstackFree(vstack);
-                                return 1;
-                            }
-                            for (k = 0; k < num; k++) {
-                                strcpy(i3.value.s + (k * s1), str);
-                            }
-                            i3.value.s[s3] = '\0';
-                            break;
-                        case OP_ADD: case OP_SUB: case OP_DIV: /* fallthrough */
-                        case OP_MOD: case OP_POW:
-                            info("illegal operation on a string and a number");
-                            valstackFree(vstack);
-                            return 3;
-                        default:
-                            STAMP();
-                            error("unmatched operator index (%d)", idx);
-                            valstackFree(vstack);
-                            return 2;
-                    }
-                } else {
-                    info("illegal operation involving a %s and a %s",
-                            (i1.type == ARGVAL_TYPE_STRING)? "string" : "number",
-                            (i2.type == ARGVAL_TYPE_STRING)? "string" : "number");
-                    valstackFree(vstack);
-                    return 3;
-                }
+            i1 = valstackPop(vstack);
+            if (i1.type == ARGVAL_TYPE_NONE) {
+                STAMP();
+                error("failed to pop from vstack (%.0d)", i1.value.f);
+                valstackClear(vstack);
+                return 2;
+            }
+
+            /* Temporary convenience macro */
+#define FAIL(X) do { \
+                    if (i1.type == ARGVAL_TYPE_STRING && i1.is_temporary) \
+                        xfree(i1.value.s); \
+                    if (i2.type == ARGVAL_TYPE_STRING && i2.is_temporary) \
+                        xfree(i2.value.s); \
+                    valstackClear(vstack); \
+                    return (X); \
+                } while (0)
 
-                /* Free temporary strings */
-                if (i1.type == ARGVAL_TYPE_STRING && i1.is_temporary) {
-                    free(i1.value.s);
+            /* Perform operation (exactly on two integers, as long as the
+             * result fits, otherwise the integers are converted to floats) */
+            if (i1.type == ARGVAL_TYPE_INT && i2.type == ARGVAL_TYPE_INT
+                    && intOperation(idx, i1.value.i, i2.value.i, &i3.value.i) == 0) {
+                i3.type = ARGVAL_TYPE_INT;
+            } else if (ARGVAL_IS_NUMBER(i1) && ARGVAL_IS_NUMBER(i2)) {
+                i1.value.f = ARGVAL_NUMBER(i1);
+                i2.value.f = ARGVAL_NUMBER(i2);
+                i3.type = ARGVAL_TYPE_FLOAT;
+                switch (idx) {
+                    case OP_ADD:
+                        i3.value.f = i1.value.f + i2.value.f;
+                        break;
+                    case OP_SUB:
+                        i3.value.f = i1.value.f - i2.value.f;
+                        break;
+                    case OP_MUL:
+                        i3.value.f = i1.value.f * i2.value.f;
+                        break;
+                    case OP_DIV:
+                        if (i2.value.f == 0) {
+                            info("cannot divide by 0");
+                            FAIL(3);
+                        }
+                        i3.value.f = i1.value.f / i2.value.f;
+                        break;
+                    case OP_MOD:
+                        i3.value.f = fmod(i1.value.f, i2.value.f);
+                        break;
+                    case OP_POW:
+                        i3.value.f = pow(i1.value.f, i2.value.f);
+                        break;
+                    default:
+                        STAMP();
+                        error("unmatched operator index (%d)", idx);
+                        FAIL(2);
                 }
-                if (i2.type == ARGVAL_TYPE_STRING && i2.is_temporary) {
-                    free(i2.value.s);
+            } else if (i1.type == ARGVAL_TYPE_STRING && i2.type == ARGVAL_TYPE_STRING) {
+                size_t s1, s3;
+                i3.type = ARGVAL_TYPE_STRING;
+                switch (idx) {
+                    case OP_ADD:
+                        s1 = strlen(i1.value.s);
+                        s3 = s1 + strlen(i2.value.s);
+                        if (!(i3.value.s = xmalloc((s3 + 1) * sizeof *i3.value.s))) {
+                            info("memory error");
+                            FAIL(1);
+                        }
+                        strcpy(i3.value.s, i1.value.s);
+                        strcpy(i3.value.s + s1, i2.value.s);
+                        i3.is_temporary = true;
+                        break;
+                    case OP_SUB: case OP_MUL: case OP_DIV: /* fallthrough */
+                    case OP_MOD: case OP_POW:
+                        info("illegal operation on two strings");
+                        FAIL(3);
+                    default:
+                        STAMP();
+                        error("unmatched operator index (%d)", idx);
+                        FAIL(2);
                 }
+            } else if ((i1.type == ARGVAL_TYPE_STRING && ARGVAL_IS_NUMBER(i2))
+                    || (ARGVAL_IS_NUMBER(i1) && i2.type == ARGVAL_TYPE_STRING)) {
 
-                /* Push the new value */
-                if (valstackPush(vstack, i3)) {
-                    info("memory error");
-                    valstackFree(vstack);
-                    return 1;
+                size_t s1, s3;
+                const char *str;
+                double num_f;
+                size_t num, k;
+
+                switch (idx) {
+                    case OP_MUL:
+                        /* Support Python-like string multiplication */
+                        i3.type = ARGVAL_TYPE_STRING;
+                        i3.is_temporary = true;
+
+                        if (i1.type == ARGVAL_TYPE_STRING) {
+                            str = i1.value.s;
+                            num_f = ARGVAL_NUMBER(i2);
+                        } else {
+                            str = i2.value.s;
+                            num_f = ARGVAL_NUMBER(i1);
+                        }
+
+                        s1 = strlen(str);
+
+                        /* Prevent integer overflow */
+                        if (num_f > (double)ULONG_MAX) {
+                            info("cannot multiply a string by %.0g (factor too large)", num_f);
+                            FAIL(3);
+                        } else if (num_f > (double)ULONG_MAX / s1 - 1) {
+                            info("cannot multiply a string by %.0g (resulting string too long)", num_f);
+                            FAIL(3);
+                        }
+                        num = (size_t)num_f;
+
+                        s3 = s1 * num;
+
+                        if (!(i3.value.s = xmalloc((s3 + 1) * sizeof *i3.value.s))) {
+                            info("memory error");
+                            FAIL(1);
+                        }
+                        for (k = 0; k < num; k++) {
+                            strcpy(i3.value.s + (k * s1), str);
+                        }
+                        i3.value.s[s3] = '\0';
+                        break;
+                    case OP_ADD: case OP_SUB: case OP_DIV: /* fallthrough */
+                    case OP_MOD: case OP_POW:
+                        info("illegal operation on a string and a number");
+                        FAIL(3);
+                    default:
+                        STAMP();
+                        error("unmatched operator index (%d)", idx);
+                        FAIL(2);
                 }
+            } else {
+                info("illegal operation involving a %s and a %s",
+                        (i1.type == ARGVAL_TYPE_STRING)? "string" : "number",
+                        (i2.type == ARGVAL_TYPE_STRING)? "string" : "number");
+                FAIL(3);
+            }
+
+            /* Free temporary strings */
+            if (i1.type == ARGVAL_TYPE_STRING && i1.is_temporary) {
+                xfree(i1.value.s);
+            }
+            if (i2.type == ARGVAL_TYPE_STRING && i2.is_temporary) {
+                xfree(i2.value.s);
             }
-        }
 
-        /* Result is on the top of the stack */
-        result = valstackPop(vstack);
-        switch (result.type) {
-            case ARGVAL_TYPE_STRING:
-                printf("%s\n", result.value.s);
-                if (result.is_temporary) {
-                    free(result.value.s);
+            /* Push the new value */
+            if (valstackPush(vstack, i3)) {
+                info("memory error");
+                if (i3.type == ARGVAL_TYPE_STRING) {
+                    xfree(i3.value.s);
                 }
-                break;
-            case ARGVAL_TYPE_FLOAT:
-                printf("%.10g\n", result.value.f);
-                break;
-            default:
-                STAMP();
-                error("query result has invalid type %d", result.type);
-                valstackFree(vstack);
-                return 2;
+                valstackClear(vstack);
+                return 1;
+            }
+#undef FAIL
         }
+    }
 
-        /* Clear the stack */
+    /* Result is on the top of the stack */
+    *result = valstackPop(vstack);
+    if (result->type == ARGVAL_TYPE_NONE) {
+        STAMP();
+        error("query left no result on vstack");
         valstackClear(vstack);
+        return 2;
+    }
+
+    /* Clear the stack */
+    valstackClear(vstack);
+
+    return 0;
+}
+
+int printQueries(const Query **queries, size_t qcount)
+{
+    ValStack *vstack; /* evaluation stack */
+    size_t i;
+
+    if (!(vstack = valstackCreate())) {
+        info("memory error");
+        return 1;
+    }
+
+    for (i = 0; i < qcount; i++) {
+        ArgVal result;
+        StatsTimer timer;
+        int err;
+
+        statsStartCounted(&timer);
+        traceBegin("evalQuery", "query %lu", (unsigned long)i + 1);
+        PROBE_EVAL_START(i + 1);
+        err = evalQuery(queries[i], vstack, &result);
+        PROBE_EVAL_END(i + 1, err);
+        traceEnd();
+        statsStop(&timer, STATS_EVAL);
+        if (err) {
+            valstackFree(vstack);
+            return err;
+        }
+
+        statsStart(&timer);
+        argValPrint(stdout, &result);
+        putchar('\n');
+        statsStop(&timer, STATS_OUTPUT);
+        if (result.type == ARGVAL_TYPE_STRING && result.is_temporary) {
+            xfree(result.value.s);
+        }
     }
 
     /* Cleanup */
     valstackFree(vstack);
 
+    /* Include the actual writing in the output phase */
+    {
+        StatsTimer timer;
+        bool failed;
+
+        statsStart(&timer);
+        traceBegin("flush", NULL);
+        failed = fflush(stdout) || ferror(stdout);
+        traceEnd();
+        statsStop(&timer, STATS_OUTPUT);
+        if (failed) {
+            info("failed to write output");
+            return 5;
+        }
+    }
+
     return 0;
 }
+
+/* Applies a binary operator to two integers, returns 0 on success or 1 if
+ * the result must be computed on floats instead: because it does not fit
+ * in a long, or is not an integer (division always returns 1) */
+static int intOperation(int op, long a, long b, long *result)
+{
+    long acc;
+
+    switch (op) {
+        case OP_ADD:
+            if ((b > 0 && a > LONG_MAX - b) || (b < 0 && a < LONG_MIN - b)) {
+                return 1;
+            }
+            *result = a + b;
+            return 0;
+        case OP_SUB:
+            if ((b < 0 && a > LONG_MAX + b) || (b > 0 && a < LONG_MIN + b)) {
+                return 1;
+            }
+            *result = a - b;
+            return 0;
+        case OP_MUL:
+            if (mulOverflows(a, b)) {
+                return 1;
+            }
+            *result = a * b;
+            return 0;
+        case OP_MOD:
+            /* Like fmod, the result has the sign of a. C89 leaves the sign
+             * of '%' on negative numbers to the implementation, so it is
+             * computed on magnitudes. Modulo 0 is NaN, which needs floats. */
+            if (b == 0 || a == LONG_MIN || b == LONG_MIN) {
+                return 1;
+            }
+            *result = (a < 0)? -(labs(a) % labs(b)) : labs(a) % labs(b);
+            return 0;
+        case OP_POW:
+            if (b < 0) {
+                return 1;
+            }
+
+            /* Exponentiation by squaring */
+            for (acc = 1; b; b /= 2) {
+                if (b % 2) {
+                    if (mulOverflows(acc, a)) {
+                        return 1;
+                    }
+                    acc *= a;
+                }
+                if (b > 1) {
+                    if (mulOverflows(a, a)) {
+                        return 1;
+                    }
+                    a *= a;
+                }
+            }
+            *result = acc;
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+/* Returns true if a * b does not fit in a long */
+static bool mulOverflows(long a, long b)
+{
+    if (a == 0 || b == 0) {
+        return false;
+    }
+    if (a > 0) {
+        return (b > 0)? a > LONG_MAX / b : b < LONG_MIN / a;
+    }
+    return (b > 0)? a < LONG_MIN / b : b < LONG_MAX / a;
+}
+
+/* Records a pair in a layer unless it is already there, and stores the layer
+ * it was first recorded in in first. Returns 0 or 1 on memory error */
+static int shadowAdd(Shadow *shadow, const char *section, const char *key, size_t layer, size_t *first)
+{
+    size_t slen, klen, n;
+    char *name;
+
+    if (shadow->size && shadow->names[n = shadowSlot(shadow, section, key)]) {
+        *first = shadow->layers[n];
+        return 0;
+    }
+
+    /* Keep the load factor under 1/2 */
+    if (2 * (shadow->count + 1) > shadow->size) {
+        Shadow grown;
+        size_t i;
+
+        grown.count = shadow->count;
+        grown.size = shadow->size? 2 * shadow->size : 64; /* Arbitrary initial size */
+        grown.names = xcalloc(grown.size, sizeof *grown.names);
+        grown.layers = xmalloc(grown.size * sizeof *grown.layers);
+        if (!grown.names || !grown.layers) {
+            info("memory error");
+            xfree(grown.names);
+            xfree(grown.layers);
+            return 1;
+        }
+        for (i = 0; i < shadow->size; i++) {
+            if (shadow->names[i]) {
+                const char *const entry = shadow->names[i]; /* shortcut */
+
+                n = shadowSlot(&grown, entry, entry + strlen(entry) + 1);
+                grown.names[n] = shadow->names[i];
+                grown.layers[n] = shadow->layers[i];
+            }
+        }
+        xfree(shadow->names);
+        xfree(shadow->layers);
+        *shadow = grown;
+    }
+
+    slen = strlen(section);
+    klen = strlen(key);
+    if (!(name = xmalloc((slen + klen + 2) * sizeof *name))) {
+        info("memory error");
+        return 1;
+    }
+    memcpy(name, section, slen + 1);
+    memcpy(name + slen + 1, key, klen + 1);
+    n = shadowSlot(shadow, section, key);
+    shadow->names[n] = name;
+    shadow->layers[n] = layer;
+    shadow->count++;
+    *first = layer;
+
+    return 0;
+}
+
+/* Returns the slot of a pair, or the free slot it would take */
+static size_t shadowSlot(const Shadow *shadow, const char *section, const char *key)
+{
+    unsigned long h;
+    size_t n;
+
+    h = hashString(hashString(HASH_INIT, section), key);
+    for (n = h & (shadow->size - 1); shadow->names[n]; n = (n + 1) & (shadow->size - 1)) {
+        const char *const name = shadow->names[n]; /* shortcut */
+
+        if (strcmp(name, section) == 0 && strcmp(name + strlen(name) + 1, key) == 0) {
+            break;
+        }
+    }
+
+    return n;
+}
+
+static void shadowFree(Shadow *shadow)
+{
+    size_t i;
+
+    for (i = 0; i < shadow->size; i++) {
+        xfree(shadow->names[i]);
+    }
+    xfree(shadow->names);
+    xfree(shadow->layers);
+}
+
+/* Same as getLine, but stops after the first '=' of the line,
+ * in which case 3 is returned and the rest of the line is left
+ * in file (see readValue and skipValue) */
+static int getLineHead(FILE *file, char **buf_ptr, size_t *bufsize)
+{
+    size_t pos; /* Current position in the buffer */
+    int c;      /* Last read character from file */
+
+    if (!file || !buf_ptr || !*buf_ptr || !bufsize) {
+        STAMP();
+        error("one of getLineHead parameters is NULL");
+        return 2;
+    }
+
+    /* Read character-by-character until newline or '=' */
+    pos = 0;
+    c = fgetc(file);
+    while (c != EOF && c != '\n') {
+
+        /* Enlarge buffer if needed */
+        if (pos == *bufsize - 1) {
+            *bufsize *= 2;
+            if (!(*buf_ptr = xrealloc(*buf_ptr, *bufsize * sizeof **buf_ptr))) {
+                info("memory error");
+                return 1;
+            }
+        }
+
+        (*buf_ptr)[pos++] = c;
+        if (c == '=') {
+            (*buf_ptr)[pos] = '\0';
+            return 3;
+        }
+        c = fgetc(file);
+    }
+
+    /* Terminate the string */
+    (*buf_ptr)[pos] = '\0';
+
+    return (c == EOF)? EOF : 0;
+}
+
+/* Reads the rest of a line as the value of a key/value pair, which is built
+ * in the same buffer (see argValFromBuffer), and stores the number of bytes
+ * read in len (without the newline). Returns 0 if a newline was reached,
+ * EOF at end of file and 1 on memory error or if there is no value */
+static int readValue(FILE *file, ArgVal *value, size_t *len)
+{
+    size_t size;
+    char *val;
+    int c;
+
+    size = 256; /* Arbitrary non-zero initial size */
+    if (!(val = xmalloc(size * sizeof *val))) {
+        info("memory error");
+        return 1;
+    }
+
+    *len = 0;
+    while ((c = fgetc(file)) != EOF && c != '\n') {
+        if (*len == size - 1) {
+            char *new;
+
+            size *= 2;
+            if (!(new = xrealloc(val, size * sizeof *val))) {
+                info("memory error");
+                xfree(val);
+                return 1;
+            }
+            val = new;
+        }
+        val[(*len)++] = c;
+    }
+    val[*len] = '\0';
+
+    if (!iniValueValid(val, val + *len)) {
+        xfree(val);
+        return 1;
+    }
+    if ((*value = argValFromBuffer(val)).type == ARGVAL_TYPE_NONE) {
+        return 1;
+    }
+
+    return (c == EOF)? EOF : 0;
+}
+
+/* Reads the rest of a line without storing it. valid is set to false if
+ * it has no value (only whitespace until the end or a null byte), and
+ * len to the number of bytes read. Returns 0 if a newline was reached
+ * and EOF at end of file */
+static int skipValue(FILE *file, bool *valid, size_t *len)
+{
+    bool nul;
+    int c;
+
+    *valid = nul = false;
+    *len = 0;
+    while ((c = fgetc(file)) != EOF && c != '\n') {
+        if (c == '\0') {
+            nul = true;
+        } else if (!nul && !isspace(c)) {
+            *valid = true;
+        }
+        (*len)++;
+    }
+
+    return (c == EOF)? EOF : 0;
+}
+
+/* Extracts the key of a key/value pair line starting at i (its first
+ * character) into ret. Returns the position right after the '=' delimiter,
+ * or NULL if the line is invalid, in which case ret is an INI_LINE_ERROR */
+static const char *extractKey(const char *i, IniToken *ret)
+{
+    const char *j;
+
+    /* Find end of the key part */
+    j = i;
+    while (*i && !isspace(*i) && *i != '=')
+        i++;
+    if (!*i) {
+        info("error found in file (no value after key name)");
+        ret->type = INI_LINE_ERROR;
+        return NULL;
+    }
+
+    /* Store the key part in a new buffer */
+    if (!(ret->content.kvpair.key = xmalloc((i - j + 1) * sizeof *ret->content.kvpair.key))) {
+        info("memory error");
+        ret->type = INI_LINE_ERROR;
+        return NULL;
+    }
+    memcpy(ret->content.kvpair.key, j, i - j);
+    ret->content.kvpair.key[i - j] = '\0';
+
+    /* Search for '=' delimiter */
+    while (*i && *i != '=')
+        i++;
+    if (*i != '=') {
+        info("error found in file (no value after key name)");
+        xfree(ret->content.kvpair.key);
+        ret->type = INI_LINE_ERROR;
+        return NULL;
+    }
+
+    return i + 1;
+}
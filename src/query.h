@@ -39,12 +39,27 @@ enum OpCode
     OP_RPR = -7,
     /** Exponentiation '^' */
     OP_POW = -8,
+    /** Aggregate function 'sum(...)' */
+    OP_SUM = -9,
+    /** Aggregate function 'min(...)' */
+    OP_MIN = -10,
+    /** Aggregate function 'max(...)' */
+    OP_MAX = -11,
+    /** Aggregate function 'avg(...)' */
+    OP_AVG = -12,
+    /** Aggregate function 'count(...)' */
+    OP_CNT = -13,
+    /** Aggregate function 'join(...)' */
+    OP_JOIN = -14,
     /** This is not an actual OpCode, it is used as a constant
      *  for determining the array size required to fit all
      *  operator types. */
-    OP_COUNT = 9
+    OP_COUNT = 15
 };
 
+/** Evaluates to non-zero if @p X is an aggregate function @ref OpCode. */
+#define OP_IS_AGGREGATE(X) ((X) <= OP_SUM && (X) >= OP_JOIN)
+
 /** Numerical representation of operator associativity. */
 enum OpAssoc
 {
@@ -127,6 +142,9 @@ struct Query
 
     /** A reserved space for populating with values referenced by @ref set,
      * with the same indexing (see @ref ArgList for more details).
+     *
+     * Wildcard references (@ref Data::wildcard) are not bound to a
+     * value, but to an accumulator in @ref ArgList::accs instead.
      */
     ArgList *args;
 
@@ -137,6 +155,20 @@ struct Query
      * - operators (negative values by convention, see enum OpCode)
      */
     Stack *op_stack;
+
+    /** Locations of aggregate functions in @ref op_stack.
+     *
+     * For every aggregate function (in order of appearance), two
+     * elements are stored: the index of the first token of its
+     * argument, and the index of the function token itself. The
+     * argument is therefore the range [first, function) of
+     * @ref op_stack. Empty if the query has no aggregate functions.
+     *
+     * Aggregate functions may not be nested, and every operand
+     * of a query with aggregate functions must be inside one.
+     * A wildcard reference must be the whole argument of one.
+     */
+    Stack *aggs;
 };
 
 /** Holds complete information about a single (valid) line of an INI file. */
@@ -228,6 +260,36 @@ int tokenizeQueryString(Stack **tokens_ptr, DataSet **set_ptr, char *str);
  */
 int infixPostfix(Stack **postfix_ptr, const Stack *infix);
 
+/** Finds and validates aggregate functions in a postfix stack.
+ *
+ * See @ref Query::aggs for the output format and rules.
+ *
+ * @param[out] aggs_ptr Address of the output stack.
+ * @param[in] postfix Array of tokens in postfix order.
+ * @param[in] set The dataset referenced by @p postfix.
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error (malloc)
+ * - 2 - internal error
+ * - 3 - invalid use of aggregate functions or wildcards
+ */
+int findAggregates(Stack **aggs_ptr, const Stack *postfix, const DataSet *set);
+
+/** Creates an arglist suitable for binding the values of a query.
+ *
+ * Besides sizing the arglist after @ref Query::set, this sets up
+ * @ref ArgList::accs if the query has wildcard references.
+ *
+ * @param[in] query The query (only @ref Query::set and
+ * @ref Query::op_stack are used).
+ *
+ * @returns
+ * - valid address - success
+ * - @c NULL - failure (malloc)
+ */
+ArgList *queryArglistCreate(const Query *query);
+
 /** Frees all memory owned by a query. */
 void queryFree(Query *query);
 
@@ -251,9 +313,82 @@ void queryFree(Query *query);
  * - 2 - internal error
  * - 3 - illegal operation (e.g. multiplying strings)
  * - 4 - value not found in file
+ * - 5 - failed to write the output
  */
 int runQueries(FILE *file, const Query **queries, size_t qcount);
 
+/** Runs a list of queries on layers of INI files.
+ *
+ * Like @ref runQueries, but values come from @ref bindLayers.
+ *
+ * @param[inout] files The layers, from the lowest priority to the highest.
+ * @param[in] nfiles The number of elements in @p files.
+ * @param[in] queries An ordered list of queries to run.
+ * @param[in] qcount The number of elements in @p queries.
+ *
+ * @returns
+ * The same as @ref runQueries.
+ */
+int runLayers(FILE *const *files, size_t nfiles, const Query **queries, size_t qcount);
+
+/** Populates the arglists of a list of queries with values from a file.
+ *
+ * This is the scanning part of @ref runQueries. The file is read
+ * line by line, and reading stops as soon as all values are found.
+ * Values which could not be found are left as @ref ARGVAL_TYPE_NONE
+ * (see @ref reportMissing).
+ *
+ * Every value matching a wildcard reference is added to its
+ * accumulator as soon as it is read, so if any query has a
+ * wildcard reference, the whole file is always read.
+ *
+ * @param[inout] file The file to read values from.
+ * @param[in] queries An ordered list of queries to populate.
+ * @param[in] qcount The number of elements in @p queries.
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error (malloc/realloc), or error in the file
+ * - 2 - internal error
+ * - 4 - some values were not found in file
+ */
+int bindQueries(FILE *file, const Query **queries, size_t qcount);
+
+/** Populates the arglists of a list of queries with values from layers.
+ *
+ * Every layer overrides the ones before it, so each reference is
+ * bound to its value in the last file which defines it. Files are
+ * read like by @ref bindQueries, from the last one down, and the
+ * count of missing values carries over from one file to the next:
+ * a file is only read as long as some values are still missing,
+ * and none of the files before it are read once all values are
+ * found.
+ *
+ * Wildcard references see the merged layers: a pair which matches
+ * them is only accumulated from the last file which has its
+ * section and key (but every time it occurs there). Since any
+ * layer may add pairs, all files are read in that case.
+ *
+ * @param[inout] files The layers, from the lowest priority to the highest.
+ * @param[in] nfiles The number of elements in @p files.
+ * @param[in] queries An ordered list of queries to populate.
+ * @param[in] qcount The number of elements in @p queries.
+ *
+ * @returns
+ * The same as @ref bindQueries.
+ */
+int bindLayers(FILE *const *files, size_t nfiles, const Query **queries, size_t qcount);
+
+/** Prints all values which queries failed to find on stderr.
+ *
+ * Values which have not been found are the ones whose
+ * @ref Query::args entry is still of type @ref ARGVAL_TYPE_NONE.
+ *
+ * @param[in] queries The list of queries after running them.
+ * @param[in] qcount The number of elements in @p queries.
+ */
+void reportMissing(const Query **queries, size_t qcount);
+
 /** Utility function for fetching a new line into a buffer.
  *
  * The problem with built-in functions like @c fgets is that
@@ -293,6 +428,86 @@ int getLine(FILE *file, char **buf_ptr, size_t *bufsize);
  */
 IniToken iniExtractFromLine(const char *line);
 
+/** Validates the beginning of an INI file line and extracts information from it.
+ *
+ * This is @ref iniExtractFromLine for a line which has only been read
+ * up to its first '=', so that values which are not needed never have
+ * to be buffered. Only a key/value pair is incomplete at that point,
+ * and anything else is extracted exactly like from the whole line.
+ * A key/value pair is returned without its value (of type
+ * @ref ARGVAL_TYPE_NONE), which is the rest of the line: it is up to
+ * the caller to parse it (e.g. with @ref argValFromRange), or, if it
+ * is skipped, to check it with @ref iniValueValid.
+ *
+ * @param head The line up to and including its first '=' (or the
+ * whole line, if it has none).
+ *
+ * @returns
+ * Same as @ref iniExtractFromLine.
+ */
+IniToken iniExtractFromHead(const char *head);
+
+/** Checks that the rest of a line after @ref iniExtractFromHead is a value.
+ *
+ * An error is reported unless there is a non-whitespace byte in
+ * [@p beg, @p end) before any null byte.
+ *
+ * @param beg The first byte after the '=' of the line.
+ * @param end One past the last byte of the line (without the newline).
+ *
+ * @returns
+ * @c true if there is a value, @c false otherwise.
+ */
+bool iniValueValid(const char *beg, const char *end);
+
+/** Computes the result of a single query.
+ *
+ * This function assumes the query's @ref Query::args has already
+ * been populated with all necessary values.
+ *
+ * @param[in] query The query to compute.
+ * @param[inout] vstack Evaluation stack to use. It is always
+ * left empty when the function returns.
+ * @param[out] result The result of the query. If it is a string with
+ * @ref ArgVal::is_temporary set, the caller is responsible for freeing it.
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error
+ * - 2 - internal error
+ * - 3 - illegal operation (e.g. subtracting strings, division by 0)
+ * - 4 - an aggregate function of a wildcard has no values to aggregate
+ */
+int evalQuery(const Query *query, ValStack *vstack, ArgVal *result);
+
+/** Computes the result of a part of a query.
+ *
+ * This is a generalization of @ref evalQuery, which evaluates
+ * only the tokens [@p beg, @p end) of @ref Query::op_stack
+ * (which must form a complete expression).
+ *
+ * Without @p aggvals, an aggregate function is treated as if it was
+ * aggregating a single value (e.g. "sum" returns its argument and
+ * "count" returns 1), unless the argument is a wildcard reference,
+ * whose accumulator is used instead. With @p aggvals, the argument of each aggregate
+ * function is not evaluated at all, and the function evaluates to
+ * the corresponding element of @p aggvals instead.
+ *
+ * @param[in] query The query to compute.
+ * @param[inout] vstack Evaluation stack to use. It is always
+ * left empty when the function returns.
+ * @param[in] beg Index of the first token to evaluate.
+ * @param[in] end Index one past the last token to evaluate.
+ * @param[in] aggvals Final values of aggregate functions, in
+ * order of @ref Query::aggs, or @c NULL.
+ * @param[out] result The result (see @ref evalQuery).
+ *
+ * @returns
+ * Same as @ref evalQuery.
+ */
+int evalQueryRange(const Query *query, ValStack *vstack, size_t beg, size_t end,
+        const ArgVal *aggvals, ArgVal *result);
+
 /** Computes a list of queries and prints the results in order.
  *
  * This function assumes each query's @ref Query::args has already
@@ -306,6 +521,8 @@ IniToken iniExtractFromLine(const char *line);
  * - 1 - memory error
  * - 2 - internal error
  * - 3 - illegal operation (e.g. subtracting strings, division by 0)
+ * - 4 - an aggregate function of a wildcard has no values to aggregate
+ * - 5 - failed to write the output
  */
 int printQueries(const Query **queries, size_t qcount);
 
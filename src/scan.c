@@ -0,0 +1,767 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "scan.h"
+#include "query.h"
+#include "dataset.h"
+#include "arglist.h"
+#include "stats.h"
+#include "trace.h"
+#include "probes.h"
+#include "alloc.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <errno.h>
+
+/* Where a string value is in the mapped file, as offsets */
+typedef struct {
+    size_t beg, end;
+} Span;
+
+/* Everything a worker found in a single chunk */
+typedef struct {
+    size_t beg, end;  /* byte range of the chunk */
+    bool done;        /* the chunk has been scanned */
+    bool early;       /* all values were found, the scan stopped at end */
+    int err;          /* 0, or 1 if an error was found (the scan stopped there) */
+    char *section;    /* the last section header (NULL if none) */
+    ArgVal *prefix;   /* first values of each key before the first header */
+    ArgVal *body;     /* first values of each section/key pair after it */
+    Span *prefix_spans; /* where the strings of prefix are (passthrough only) */
+    Span *body_spans;   /* where the strings of body are (passthrough only) */
+    size_t lines;     /* the number of lines scanned (for stats) */
+    size_t keys;      /* the number of key lines compared (for stats) */
+} Chunk;
+
+/* State shared by all workers */
+typedef struct {
+    const char *map;       /* the mapped file */
+    const DataSet *refs;   /* all distinct section/key pairs of all queries */
+    bool passthrough;      /* strings are left in the map (their buffer is NULL) */
+
+    Chunk *chunks;
+    size_t nchunks;
+    size_t next;           /* index of the next chunk to scan */
+    bool stop;             /* all values were found, skip remaining chunks */
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;   /* signalled whenever a chunk is done */
+} ScanState;
+
+static int scanFile(const char *map, size_t len, const DataSet *refs, ArgVal *found, Span *spans,
+        unsigned nthreads);
+static void *scanWorker(void *arg);
+static int scanChunk(const ScanState *st, Chunk *chunk);
+static void chunkFree(Chunk *chunk, size_t nrefs);
+static int argValCopy(ArgVal *dest, const ArgVal *src);
+static int spanCopy(const char *map, ArgVal *val, const Span *span);
+static int writeFound(const char *map, size_t qcount, size_t *const *refidx, const ArgVal *found,
+        const Span *spans);
+
+int runQueriesParallel(const char *path, const Query **queries, size_t qcount, unsigned nthreads)
+{
+    DataSet *refs;       /* distinct section/key pairs */
+    size_t **refidx;     /* maps each query arg to an index in refs */
+    ArgVal *found;       /* merged values, indexed like refs */
+    bool *taken;         /* true if the string of found was taken over by an arglist */
+    Span *spans;         /* where the strings of found are (passthrough only) */
+    bool passthrough;    /* every query is a single reference */
+    size_t len, i, j;
+    int fd, err;
+    struct stat sb;
+    void *map;
+    StatsTimer timer;
+
+    /* The values of a wildcard in a chunk's prefix could belong to any
+     * section, so wildcards are left to the (streaming) serial scan */
+    for (i = 0; i < qcount; i++) {
+        for (j = 0; j < queries[i]->set->size; j++) {
+            if (queries[i]->set->data[j].wildcard) {
+                FILE *file;
+
+                if (!(file = fopen(path, "r"))) {
+                    info("failed to open file");
+                    return 5;
+                }
+                PROBE_FILE_OPEN(path);
+                err = runQueries(file, queries, qcount);
+                fclose(file);
+                return err;
+            }
+        }
+    }
+
+    /* Build a single set of section/key pairs referenced by all queries */
+    if (!(refs = datasetCreate())) {
+        return 1;
+    }
+    if (!(refidx = xmalloc(qcount * sizeof *refidx))) {
+        info("memory error");
+        datasetFree(refs);
+        return 1;
+    }
+    for (i = 0; i < qcount; i++) {
+        arglistClear(queries[i]->args);
+        if (!(refidx[i] = xmalloc((queries[i]->set->size + 1) * sizeof **refidx))) {
+            info("memory error");
+            while (i-- > 0) {
+                xfree(refidx[i]);
+            }
+            xfree(refidx);
+            datasetFree(refs);
+            return 1;
+        }
+        for (j = 0; j < queries[i]->set->size; j++) {
+            refidx[i][j] = datasetAdd(refs, queries[i]->set->data[j].section, queries[i]->set->data[j].key);
+        }
+    }
+
+    /* Temporary convenience macro */
+#define CLEANUP() do { \
+                for (i = 0; i < qcount; i++) { \
+                    xfree(refidx[i]); \
+                } \
+                xfree(refidx); \
+                datasetFree(refs); \
+            } while (0)
+
+    passthrough = true;
+    for (i = 0; i < qcount; i++) {
+        for (j = 0; j < queries[i]->set->size; j++) {
+            int idx = refidx[i][j];
+            if (idx < 0) {
+                CLEANUP();
+                return (idx == -1)? 1 : 2;
+            }
+        }
+        if (queries[i]->op_stack->size != 1) {
+            passthrough = false;
+        }
+    }
+
+    /* Map the file */
+    statsStartCounted(&timer);
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        info("failed to open file");
+        CLEANUP();
+        return 5;
+    }
+    PROBE_FILE_OPEN(path);
+    if (fstat(fd, &sb) < 0) {
+        info("failed to stat file");
+        close(fd);
+        CLEANUP();
+        return 5;
+    }
+    if (!S_ISREG(sb.st_mode)) {
+        /* Pipes and devices cannot be mapped, so they are streamed */
+        FILE *file;
+
+        CLEANUP();
+        if (!(file = fdopen(fd, "r"))) {
+            info("failed to open file");
+            close(fd);
+            return 5;
+        }
+        err = runQueries(file, queries, qcount);
+        fclose(file);
+        return err;
+    }
+    len = sb.st_size;
+    map = NULL;
+    if (len && (map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        info("failed to map file");
+        close(fd);
+        CLEANUP();
+        return 5;
+    }
+    close(fd);
+
+    /* Scan the file and merge the results into found */
+    taken = NULL;
+    spans = NULL;
+    if (!(found = xmalloc((refs->size + 1) * sizeof *found))
+            || !(taken = xcalloc(refs->size + 1, sizeof *taken))
+            || (passthrough && !(spans = xmalloc((refs->size + 1) * sizeof *spans)))) {
+        info("memory error");
+        err = 1;
+    } else {
+        for (i = 0; i < refs->size; i++) {
+            found[i].type = ARGVAL_TYPE_NONE;
+        }
+        traceBegin("scan", "%lu bytes", (unsigned long)len);
+        err = scanFile(map, len, refs, found, spans, nthreads);
+        traceEnd();
+    }
+
+    /* Strings left in the map are printed from there, unless a value is
+     * missing: then they are copied out, and everything goes as usual */
+    for (i = 0; !err && passthrough && i < refs->size && found[i].type != ARGVAL_TYPE_NONE; i++)
+        ;
+    if (!err && passthrough && i == refs->size) {
+        statsStop(&timer, STATS_SCAN);
+        err = writeFound(map, qcount, refidx, found, spans);
+    } else {
+        for (i = 0; !err && spans && i < refs->size; i++) {
+            err = spanCopy(map, found + i, spans + i);
+        }
+        passthrough = false;
+    }
+    if (map) {
+        munmap(map, len);
+    }
+
+    /* Distribute the values to queries (the first one takes a string over),
+     * unless they were printed already */
+    for (i = 0; !err && i < qcount; i++) {
+        for (j = 0; j < queries[i]->set->size; j++) {
+            const size_t idx = refidx[i][j]; /* shortcut */
+
+            if (found[idx].type == ARGVAL_TYPE_NONE) {
+                continue;
+            }
+            if (!passthrough && (taken[idx]? arglistSet(queries[i]->args, j, found + idx)
+                        : arglistTake(queries[i]->args, j, found + idx))) {
+                err = 1;
+                break;
+            }
+            taken[idx] = true;
+            PROBE_BIND(i + 1, queries[i]->set->data[j].section, queries[i]->set->data[j].key);
+        }
+    }
+    for (i = 0; found && i < refs->size; i++) {
+        if (found[i].type == ARGVAL_TYPE_STRING && !(taken && taken[i])) {
+            xfree(found[i].value.s);
+        }
+    }
+    xfree(found);
+    xfree(taken);
+    xfree(spans);
+    CLEANUP();
+#undef CLEANUP
+    if (!passthrough) {
+        statsStop(&timer, STATS_SCAN);
+    }
+
+    if (err || passthrough) {
+        return err;
+    }
+
+    /* Report not found values */
+    for (i = 0; i < qcount; i++) {
+        for (j = 0; j < queries[i]->args->size; j++) {
+            if (queries[i]->args->types[j] == ARGVAL_TYPE_NONE) {
+                reportMissing(queries, qcount);
+                return 4;
+            }
+        }
+    }
+
+    /* All queries' arglists are populated, so
+     * run computations and print the results. */
+    return printQueries(queries, qcount);
+}
+
+/* Returns 0 on success, 1 on memory error or error in the file and 2 on internal error.
+ * If spans is not NULL, strings are left in the map and spans tells where they are */
+static int scanFile(const char *map, size_t len, const DataSet *refs, ArgVal *found, Span *spans,
+        unsigned nthreads)
+{
+    ScanState st;
+    pthread_t *threads;
+    const char *section; /* section at the end of the last merged chunk */
+    size_t matches;      /* the number of yet-to-be-found pairs */
+    size_t csize, i, k;
+    int err;
+
+    /* Split the file into chunks */
+    if (nthreads == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (ncpu > 0)? ncpu : 1;
+    }
+    st.nchunks = len / SCAN_CHUNK_MIN;
+    if (nthreads == 1) {
+        /* A single worker gains nothing from more chunks, and it stops
+         * within the first one as soon as all values are found */
+        st.nchunks = 1;
+    } else if (st.nchunks > nthreads * SCAN_CHUNKS_PER_THREAD) {
+        st.nchunks = nthreads * SCAN_CHUNKS_PER_THREAD;
+    }
+    if (st.nchunks == 0) {
+        st.nchunks = 1;
+    }
+    if (nthreads > st.nchunks) {
+        nthreads = st.nchunks;
+    }
+    csize = len / st.nchunks;
+
+    if (!(st.chunks = xcalloc(st.nchunks, sizeof *st.chunks))) {
+        info("memory error");
+        return 1;
+    }
+    if (!(threads = xmalloc(nthreads * sizeof *threads))) {
+        info("memory error");
+        xfree(st.chunks);
+        return 1;
+    }
+    for (i = 0, k = 0; i < st.nchunks; i++) {
+        const char *nl;
+
+        st.chunks[i].beg = k;
+        if (i == st.nchunks - 1) {
+            k = len;
+        } else if ((k += csize) < len && (nl = memchr(map + k, '\n', len - k))) {
+            /* Move the boundary past the next newline */
+            k = nl - map + 1;
+        } else {
+            k = len;
+        }
+        st.chunks[i].end = k;
+    }
+    st.map = map;
+    st.refs = refs;
+    st.passthrough = spans != NULL;
+    st.next = 0;
+    st.stop = false;
+
+    /* Start workers */
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.cond, NULL);
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(threads + i, NULL, scanWorker, &st)) {
+            info("failed to create thread");
+            break;
+        }
+    }
+    nthreads = i;
+
+    /* Merge chunks in order, as they become available */
+    err = nthreads? 0 : 2;
+    matches = refs->size;
+    section = "";
+    if (stats.enabled) {
+        stats.matches += refs->size;
+    }
+    for (k = 0; k < st.nchunks && matches && !err; k++) {
+        Chunk *const chunk = st.chunks + k; /* shortcut */
+
+        pthread_mutex_lock(&st.lock);
+        while (!chunk->done) {
+            pthread_cond_wait(&st.cond, &st.lock);
+        }
+        pthread_mutex_unlock(&st.lock);
+        if (!chunk->prefix || !chunk->body) {
+            err = 1;
+            break;
+        }
+
+        /* Values before the first header belong to the inherited section,
+         * and precede all values found after it. */
+        for (i = 0; i < refs->size && !err; i++) {
+            ArgVal *src;
+            Span *span;
+
+            if (found[i].type != ARGVAL_TYPE_NONE) {
+                continue;
+            }
+            if (strcmp(refs->data[i].section, section) == 0 && chunk->prefix[i].type != ARGVAL_TYPE_NONE) {
+                src = chunk->prefix + i;
+                span = chunk->prefix_spans + i;
+            } else if (chunk->body[i].type != ARGVAL_TYPE_NONE) {
+                src = chunk->body + i;
+                span = chunk->body_spans + i;
+            } else {
+                continue;
+            }
+
+            /* Take over the value */
+            found[i] = *src;
+            if (spans) {
+                spans[i] = *span;
+            }
+            src->type = ARGVAL_TYPE_NONE;
+            matches--;
+        }
+
+        if (chunk->err && matches) {
+            /* The sequential scan would have stopped here */
+            err = chunk->err;
+        }
+        if (stats.enabled) {
+            stats.bytes += chunk->end - chunk->beg;
+            stats.lines += chunk->lines;
+            stats.key_lines += chunk->keys;
+            if (!matches && (chunk->early || k + 1 < st.nchunks)) {
+                stats.exit_offset = chunk->end;
+            }
+        }
+        if (chunk->section) {
+            section = chunk->section;
+        }
+    }
+
+    if (stats.enabled) {
+        stats.matches -= matches;
+    }
+
+    /* Stop remaining workers */
+    pthread_mutex_lock(&st.lock);
+    st.stop = true;
+    pthread_mutex_unlock(&st.lock);
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_cond_destroy(&st.cond);
+    pthread_mutex_destroy(&st.lock);
+
+    /* Cleanup */
+    for (i = 0; i < st.nchunks; i++) {
+        chunkFree(st.chunks + i, refs->size);
+    }
+    xfree(st.chunks);
+    xfree(threads);
+
+    return err;
+}
+
+static void *scanWorker(void *arg)
+{
+    ScanState *const st = arg;
+
+    traceThreadName("scan worker");
+    for (;;) {
+        Chunk *chunk;
+
+        /* Fetch the next chunk */
+        pthread_mutex_lock(&st->lock);
+        if (st->stop || st->next == st->nchunks) {
+            pthread_mutex_unlock(&st->lock);
+            break;
+        }
+        chunk = st->chunks + st->next++;
+        pthread_mutex_unlock(&st->lock);
+
+        traceBegin("scan chunk", "bytes %lu-%lu", (unsigned long)chunk->beg, (unsigned long)chunk->end);
+        chunk->err = scanChunk(st, chunk);
+        traceEnd();
+
+        pthread_mutex_lock(&st->lock);
+        chunk->done = true;
+        pthread_cond_broadcast(&st->cond);
+        pthread_mutex_unlock(&st->lock);
+    }
+
+    return NULL;
+}
+
+/* Returns 0 on success and 1 on error (stored in chunk->err) */
+static int scanChunk(const ScanState *st, Chunk *chunk)
+{
+    const DataSet *const refs = st->refs; /* shortcut */
+    char  *line;     /* Stores an entire line from file */
+    size_t lsize;    /* Remembers the line size */
+    size_t missing;  /* the number of pairs without a value (first chunk only) */
+    size_t pos, i;
+    int err;
+
+    if (!(chunk->prefix = xmalloc((refs->size + 1) * sizeof *chunk->prefix))) {
+        info("memory error");
+        return 1;
+    }
+    for (i = 0; i < refs->size; i++) {
+        chunk->prefix[i].type = ARGVAL_TYPE_NONE;
+    }
+    if (!(chunk->body = xmalloc((refs->size + 1) * sizeof *chunk->body))) {
+        info("memory error");
+        return 1;
+    }
+    for (i = 0; i < refs->size; i++) {
+        chunk->body[i].type = ARGVAL_TYPE_NONE;
+    }
+    if (st->passthrough && (!(chunk->prefix_spans = xmalloc((refs->size + 1) * sizeof *chunk->prefix_spans))
+                || !(chunk->body_spans = xmalloc((refs->size + 1) * sizeof *chunk->body_spans)))) {
+        info("memory error");
+        return 1;
+    }
+
+    lsize = 256; /* Arbitrary non-zero initial size */
+    if (!(line = xmalloc(lsize * sizeof *line))) {
+        info("memory error");
+        return 1;
+    }
+
+    err = 0;
+    missing = refs->size;
+    pos = chunk->beg;
+    while (pos < chunk->end && !err) {
+        const char *beg, *val, *eol;
+        IniToken tok;
+        Span span;
+        bool pending, taken;
+        size_t n;
+
+        /* Fetch next line, but only copy it up to its first '=',
+         * values are parsed directly from the map if needed */
+        beg = st->map + pos;
+        if (!(eol = memchr(beg, '\n', chunk->end - pos))) {
+            eol = st->map + chunk->end;
+        }
+        pos = eol - st->map + 1;
+        val = memchr(beg, '=', eol - beg);
+        val = val? val + 1 : eol;
+        n = val - beg;
+        if (n + 1 > lsize) {
+            while (n + 1 > lsize) {
+                lsize *= 2;
+            }
+            if (!(line = xrealloc(line, lsize * sizeof *line))) {
+                info("memory error");
+                return 1;
+            }
+        }
+        memcpy(line, beg, n);
+        line[n] = '\0';
+        chunk->lines++;
+
+        /* Parse INI line */
+        tok = iniExtractFromHead(line);
+        switch (tok.type) {
+            case INI_LINE_ERROR:
+                err = 1;
+                break;
+            case INI_LINE_INTERROR:
+                STAMP();
+                error("iniExtractFromLine internal error");
+                err = 1;
+                break;
+            case INI_LINE_SECTION:
+                xfree(chunk->section);
+                chunk->section = tok.content.section;
+                PROBE_SECTION(chunk->section);
+                break;
+            case INI_LINE_KVPAIR:
+                chunk->keys++;
+                pending = tok.content.kvpair.value.type == ARGVAL_TYPE_NONE;
+                taken = false;
+                span.beg = span.end = 0;
+                for (i = 0; i < refs->size; i++) {
+                    ArgVal *dest;
+                    Span *dspan;
+
+                    if (strcmp(tok.content.kvpair.key, refs->data[i].key) != 0) {
+                        continue;
+                    }
+                    if (!chunk->section) {
+                        /* The section is unknown until merging */
+                        dest = chunk->prefix + i;
+                        dspan = chunk->prefix_spans + i;
+                    } else if (strcmp(chunk->section, refs->data[i].section) == 0) {
+                        dest = chunk->body + i;
+                        dspan = chunk->body_spans + i;
+                    } else {
+                        continue;
+                    }
+                    if (dest->type != ARGVAL_TYPE_NONE) {
+                        continue;
+                    }
+
+                    /* The value is built once, by the first pair which needs it */
+                    if (pending) {
+                        const char *vbeg = val, *vend = eol;
+
+                        if (!iniValueValid(val, eol)) {
+                            err = 1;
+                            break;
+                        }
+                        if (st->passthrough && argValLocate(&vbeg, &vend) == ARGVAL_TYPE_STRING) {
+                            tok.content.kvpair.value.type = ARGVAL_TYPE_STRING;
+                            tok.content.kvpair.value.value.s = NULL;
+                            tok.content.kvpair.value.is_temporary = false;
+                            span.beg = vbeg - st->map;
+                            span.end = vend - st->map;
+                        } else if ((tok.content.kvpair.value = argValFromRange(val, eol)).type == ARGVAL_TYPE_NONE) {
+                            err = 1;
+                            break;
+                        }
+                        pending = false;
+                    }
+                    if (st->passthrough) {
+                        *dspan = span;
+                    }
+                    if (!taken) {
+                        *dest = tok.content.kvpair.value;
+                        taken = true;
+                    } else if (argValCopy(dest, &tok.content.kvpair.value)) {
+                        err = 1;
+                        break;
+                    }
+
+                    /* Values in the prefix of the first chunk belong to the global
+                     * section, and precede any found after a header */
+                    if ((dest == chunk->prefix + i)? refs->data[i].section[0] == '\0'
+                            : refs->data[i].section[0] != '\0' || chunk->prefix[i].type == ARGVAL_TYPE_NONE) {
+                        missing--;
+                    }
+                }
+                if (pending && !err && !iniValueValid(val, eol)) {
+                    err = 1;
+                }
+                xfree(tok.content.kvpair.key);
+                if (tok.content.kvpair.value.type == ARGVAL_TYPE_STRING && !taken) {
+                    xfree(tok.content.kvpair.value.value.s);
+                }
+                break;
+            case INI_LINE_BLANK:
+                /* Gracefully skip */
+                break;
+            default:
+                STAMP();
+                error("unmatched IniLineType %d", tok.type);
+                err = 1;
+        }
+
+        /* The first chunk has nothing before it, so once all of its values
+         * are found, the rest of the file cannot change the results */
+        if (chunk->beg == 0 && missing == 0 && !err && pos < chunk->end) {
+            chunk->end = pos;
+            chunk->early = true;
+        }
+    }
+
+    xfree(line);
+
+    return err;
+}
+
+static void chunkFree(Chunk *chunk, size_t nrefs)
+{
+    size_t i;
+
+    for (i = 0; i < nrefs; i++) {
+        if (chunk->prefix && chunk->prefix[i].type == ARGVAL_TYPE_STRING) {
+            xfree(chunk->prefix[i].value.s);
+        }
+        if (chunk->body && chunk->body[i].type == ARGVAL_TYPE_STRING) {
+            xfree(chunk->body[i].value.s);
+        }
+    }
+    xfree(chunk->prefix);
+    xfree(chunk->body);
+    xfree(chunk->prefix_spans);
+    xfree(chunk->body_spans);
+    xfree(chunk->section);
+}
+
+/* Copies a value, deep-copying strings (unless they are left in the map).
+ * Returns 0 on success and 1 on memory error */
+static int argValCopy(ArgVal *dest, const ArgVal *src)
+{
+    *dest = *src;
+    if (src->type == ARGVAL_TYPE_STRING && src->value.s) {
+        if (!(dest->value.s = xmalloc((strlen(src->value.s) + 1) * sizeof *dest->value.s))) {
+            info("memory error");
+            dest->type = ARGVAL_TYPE_NONE;
+            return 1;
+        }
+        strcpy(dest->value.s, src->value.s);
+    }
+    return 0;
+}
+
+/* Gives a string left in the map a buffer of its own. Returns 0 on success and 1 on memory error */
+static int spanCopy(const char *map, ArgVal *val, const Span *span)
+{
+    if (val->type != ARGVAL_TYPE_STRING || val->value.s) {
+        return 0;
+    }
+    if (!(val->value.s = xmalloc((span->end - span->beg + 1) * sizeof *val->value.s))) {
+        info("memory error");
+        val->type = ARGVAL_TYPE_NONE;
+        return 1;
+    }
+    memcpy(val->value.s, map + span->beg, span->end - span->beg);
+    val->value.s[span->end - span->beg] = '\0';
+    return 0;
+}
+
+/* Prints the results of single-reference queries with as few system calls
+ * as possible, strings straight from the map. Returns 0 on success, 1 on
+ * memory error and 5 if the output could not be written */
+static int writeFound(const char *map, size_t qcount, size_t *const *refidx, const ArgVal *found,
+        const Span *spans)
+{
+    static char newline[] = "\n";
+    struct iovec *iov;
+    char (*nums)[ARGVAL_NUMBER_SIZE + 1]; /* formatted numbers, with a newline */
+    size_t niov, done, i;
+    long maxiov;
+    StatsTimer timer;
+
+    if (!(iov = xmalloc((2 * qcount + 1) * sizeof *iov))) {
+        info("memory error");
+        return 1;
+    }
+    if (!(nums = xmalloc((qcount + 1) * sizeof *nums))) {
+        info("memory error");
+        xfree(iov);
+        return 1;
+    }
+
+    statsStart(&timer);
+    niov = 0;
+    for (i = 0; i < qcount; i++) {
+        const size_t idx = refidx[i][0]; /* shortcut */
+
+        if (found[idx].type == ARGVAL_TYPE_STRING) {
+            iov[niov].iov_base = (char*)map + spans[idx].beg;
+            iov[niov++].iov_len = spans[idx].end - spans[idx].beg;
+            iov[niov].iov_base = newline;
+            iov[niov++].iov_len = 1;
+        } else {
+            argValFormatNumber(nums[i], found + idx);
+            iov[niov].iov_base = nums[i];
+            iov[niov].iov_len = strlen(nums[i]);
+            nums[i][iov[niov++].iov_len++] = '\n';
+        }
+    }
+
+    /* Write everything out, resuming after partial writes */
+    if ((maxiov = sysconf(_SC_IOV_MAX)) <= 0) {
+        maxiov = 16;
+    }
+    fflush(stdout);
+    done = 0;
+    while (done < niov) {
+        const int n = (niov - done < (size_t)maxiov)? (int)(niov - done) : (int)maxiov;
+        ssize_t written;
+
+        if ((written = writev(STDOUT_FILENO, iov + done, n)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            info("failed to write output");
+            break;
+        }
+        while (done < niov && (size_t)written >= iov[done].iov_len) {
+            written -= iov[done++].iov_len;
+        }
+        if (done < niov) {
+            iov[done].iov_base = (char*)iov[done].iov_base + written;
+            iov[done].iov_len -= written;
+        }
+    }
+    statsStop(&timer, STATS_OUTPUT);
+
+    xfree(iov);
+    xfree(nums);
+
+    return (done < niov)? 5 : 0;
+}
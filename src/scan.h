@@ -0,0 +1,75 @@
+/** @file
+ * Parallel scanning of a single (large) INI file.
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "query.h"
+#include <stdlib.h>
+
+
+/********************************************************
+ *                     CONSTANTS                        *
+ ********************************************************/
+
+/** The minimum size of a chunk (in bytes) handed to a single worker. */
+#define SCAN_CHUNK_MIN (1UL << 20)
+
+/** The number of chunks per worker thread.
+ *
+ * Having more chunks than workers balances the load and
+ * lets the scan stop early once all values have been found.
+ */
+#define SCAN_CHUNKS_PER_THREAD 8
+
+
+/********************************************************
+ *                     FUNCTIONS                        *
+ ********************************************************/
+
+/** Runs a list of queries on a file, scanning it with multiple threads.
+ *
+ * This is an alternative to @ref runQueries with identical results.
+ * The file is memory-mapped and split into chunks at line boundaries.
+ * Each chunk is tokenized on a pool of worker threads, and every
+ * worker records:
+ * - the last section header in the chunk,
+ * - the first occurrence of each referenced key *before* the first
+ *   section header of the chunk (the section is not known yet),
+ * - the first occurrence of each referenced section/key pair after it.
+ *
+ * Chunks are then merged in file order, which rebuilds the section
+ * context of each chunk and preserves the first-match-wins semantics.
+ * As soon as all values are found, the remaining chunks are skipped.
+ *
+ * The first chunk also stops as soon as all values are found, and a
+ * single worker scans the whole file as one chunk, so that an early
+ * hit does not cost a full chunk.
+ *
+ * Queries with wildcard references are run with @ref runQueries
+ * instead, because the section of a value in a chunk's prefix
+ * is needed to decide whether it matches a wildcard. So are files
+ * which cannot be mapped (pipes and devices).
+ *
+ * If every query is a single reference, string values are not copied
+ * at all: workers only record where they are in the mapping, and the
+ * results are written straight from there with a single vectored
+ * write (numbers are still parsed, to print them the usual way).
+ *
+ * @param[in] path Path to the file to run the queries on.
+ * @param[in] queries An ordered list of queries to run.
+ * @param[in] qcount The number of elements in @p queries.
+ * @param[in] nthreads The number of worker threads (0 means one per CPU).
+ *
+ * @returns
+ * - 0 - success
+ * - 1 - memory error (malloc/realloc), or error in the file
+ * - 2 - internal error
+ * - 3 - illegal operation (e.g. multiplying strings)
+ * - 4 - value not found in file
+ * - 5 - failed to open or map the file, or to write the results
+ */
+int runQueriesParallel(const char *path, const Query **queries, size_t qcount, unsigned nthreads);
+
+#endif /* SCAN_H */
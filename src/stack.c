@@ -1,4 +1,5 @@
 #include "stack.h"
+#include "alloc.h"
 #include "error.h"
 #include "arglist.h"
 #include <stdlib.h>
@@ -8,15 +9,15 @@ Stack *stackCreate()
 {
     Stack *new;
 
-    if (!(new = malloc(sizeof *new))) {
+    if (!(new = xmalloc(sizeof *new))) {
         info("memory error");
         return NULL;
     }
 
     new->capacity = STACK_INIT_CAPACITY;
-    if (!(new->data = malloc(new->capacity * sizeof *new->data))) {
+    if (!(new->data = xmalloc(new->capacity * sizeof *new->data))) {
         info("memory error");
-        free(new);
+        xfree(new);
         return NULL;
     }
 
@@ -41,7 +42,7 @@ int stackPush(Stack *stack, int val)
     /* Increase capacity, if needed */
     if (stack->size == stack->capacity) {
         stack->capacity *= 2;
-        if (!(stack->data = realloc(stack->data, stack->capacity * sizeof *stack->data))) {
+        if (!(stack->data = xrealloc(stack->data, stack->capacity * sizeof *stack->data))) {
             info("memory error");
             return 1;
         }
@@ -91,23 +92,23 @@ void stackFree(Stack *stack)
         return;
     }
 
-    free(stack->data);
-    free(stack);
+    xfree(stack->data);
+    xfree(stack);
 }
 
 ValStack *valstackCreate()
 {
     ValStack *new;
 
-    if (!(new = malloc(sizeof *new))) {
+    if (!(new = xmalloc(sizeof *new))) {
         info("memory error");
         return NULL;
     }
 
     new->capacity = STACK_INIT_CAPACITY;
-    if (!(new->data = malloc(new->capacity * sizeof *new->data))) {
+    if (!(new->data = xmalloc(new->capacity * sizeof *new->data))) {
         info("memory error");
-        free(new);
+        xfree(new);
         return NULL;
     }
 
@@ -127,7 +128,7 @@ int valstackPush(ValStack *vstack, ArgVal val)
     /* Increase capacity, if needed */
     if (vstack->size == vstack->capacity) {
         vstack->capacity *= 2;
-        if (!(vstack->data = realloc(vstack->data, vstack->capacity * sizeof *vstack->data))) {
+        if (!(vstack->data = xrealloc(vstack->data, vstack->capacity * sizeof *vstack->data))) {
             info("memory error");
             return 1;
         }
@@ -196,8 +197,8 @@ void valstackClear(ValStack *vstack)
     }
 
     for (i = 0; i < vstack->size; i++) {
-        if (vstack->data[i].type == ARGVAL_TYPE_STRING) {
-            free(vstack->data[i].value.s);
+        if (vstack->data[i].type == ARGVAL_TYPE_STRING && vstack->data[i].is_temporary) {
+            xfree(vstack->data[i].value.s);
         }
     }
 
@@ -214,6 +215,6 @@ void valstackFree(ValStack *vstack)
 
     valstackClear(vstack);
 
-    free(vstack->data);
-    free(vstack);
+    xfree(vstack->data);
+    xfree(vstack);
 }
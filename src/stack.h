@@ -152,7 +152,11 @@ ArgVal valstackPop(ValStack *valstack);
  */
 ArgVal valstackPeek(const ValStack *valstack);
 
-/** Empties the stack of all elements */
+/** Empties the stack of all elements.
+ *
+ * Temporary strings (see @ref ArgVal::is_temporary) are freed,
+ * all other strings are owned by some @ref ArgList and left intact.
+ */
 void valstackClear(ValStack *vstack);
 
 /** Frees all memory owned by the valstack. */
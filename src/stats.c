@@ -0,0 +1,265 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE /* for syscall */
+
+#include "stats.h"
+#include "alloc.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+Stats stats;
+
+/* Names of phases, indexed like StatsPhase */
+static const char *const phaseNames[STATS_PHASE_COUNT] = {
+    "parse", "scan", "bind", "eval", "output"
+};
+
+/* The number of empty measurements used to estimate the overhead of a timer */
+#define CALIBRATION_ROUNDS 32
+
+/* The time spent reading the clocks of a single measurement */
+static StatsTimer overhead;
+
+/* Names of hardware counters, indexed like StatsCounter */
+static const char *const counterNames[STATS_COUNTER_COUNT] = {
+    "cycles", "instructions", "branch misses", "cache misses"
+};
+
+#ifdef __linux__
+/* File descriptors of the counters, indexed like StatsCounter */
+static int counterFds[STATS_COUNTER_COUNT];
+#endif
+
+static double clockSeconds(clockid_t clock);
+static void openCounters(void);
+static int readCounters(double *counts);
+
+void statsEnable(void)
+{
+    StatsTimer timer;
+    double wall, cpu;
+    int i;
+
+    memset(&stats, 0, sizeof stats);
+    stats.exit_offset = -1;
+    stats.enabled = true;
+
+    /* The smallest empty measurement is the overhead */
+    overhead.wall = overhead.cpu = 1;
+    for (i = 0; i < CALIBRATION_ROUNDS; i++) {
+        statsStart(&timer);
+        wall = clockSeconds(CLOCK_MONOTONIC) - timer.wall;
+        cpu  = clockSeconds(CLOCK_PROCESS_CPUTIME_ID) - timer.cpu;
+        overhead.wall = (wall < overhead.wall)? wall : overhead.wall;
+        overhead.cpu  = (cpu < overhead.cpu)? cpu : overhead.cpu;
+    }
+
+    openCounters();
+}
+
+void statsStart(StatsTimer *timer)
+{
+    if (!stats.enabled) {
+        return;
+    }
+    timer->wall = timer->lap = clockSeconds(CLOCK_MONOTONIC);
+    timer->cpu  = clockSeconds(CLOCK_PROCESS_CPUTIME_ID);
+    timer->counted = false;
+    timer->split = false;
+}
+
+void statsStartCounted(StatsTimer *timer)
+{
+    if (!stats.enabled) {
+        return;
+    }
+    timer->counted = !stats.counters_error && !readCounters(timer->counts);
+    timer->wall = timer->lap = clockSeconds(CLOCK_MONOTONIC);
+    timer->cpu  = clockSeconds(CLOCK_PROCESS_CPUTIME_ID);
+    timer->split = false;
+}
+
+void statsStop(const StatsTimer *timer, StatsPhase phase)
+{
+    double now, wall, cpu, counts[STATS_COUNTER_COUNT];
+    int i;
+
+    if (!stats.enabled) {
+        return;
+    }
+    now  = clockSeconds(CLOCK_MONOTONIC);
+    wall = now - timer->wall - overhead.wall;
+    cpu  = clockSeconds(CLOCK_PROCESS_CPUTIME_ID) - timer->cpu - overhead.cpu;
+    wall = (wall < 0)? 0 : wall;
+    cpu  = (cpu < 0)? 0 : cpu;
+
+    if (!timer->split) {
+        stats.wall[phase] += wall;
+        stats.cpu[phase]  += cpu;
+    } else {
+        /* The laps add up to the whole time, the last one included */
+        double laps[STATS_PHASE_COUNT], total;
+
+        total = 0;
+        for (i = 0; i < STATS_PHASE_COUNT; i++) {
+            laps[i] = timer->laps[i] + ((i == (int)phase)? now - timer->lap : 0);
+            total += laps[i];
+        }
+        for (i = 0; i < STATS_PHASE_COUNT; i++) {
+            stats.wall[i] += laps[i];
+            stats.cpu[i]  += (total > 0)? cpu * laps[i] / total : 0;
+        }
+    }
+
+    if (timer->counted && !readCounters(counts)) {
+        for (i = 0; i < STATS_COUNTER_COUNT; i++) {
+            stats.counts[phase][i] += counts[i] - timer->counts[i];
+        }
+    }
+}
+
+void statsSplit(StatsTimer *timer, StatsPhase phase)
+{
+    double now;
+
+    if (!stats.enabled) {
+        return;
+    }
+    if (!timer->split) {
+        memset(timer->laps, 0, sizeof timer->laps);
+        timer->split = true;
+    }
+    now = clockSeconds(CLOCK_MONOTONIC);
+    timer->laps[phase] += now - timer->lap;
+    timer->lap = now;
+}
+
+void statsPrint(FILE *out)
+{
+    struct rusage usage;
+    double wall, cpu;
+    int i;
+
+    fprintf(out, "iniget: stats:\n");
+    fprintf(out, "    %-20s %12s %12s\n", "phase", "wall (ms)", "cpu (ms)");
+    for (i = 0; i < STATS_PHASE_COUNT; i++) {
+        wall = stats.wall[i];
+        cpu  = stats.cpu[i];
+        fprintf(out, "    %-20s %12.3f %12.3f\n", phaseNames[i], wall * 1e3, cpu * 1e3);
+    }
+
+    fprintf(out, "    %-20s %12lu\n", "bytes read", stats.bytes);
+    fprintf(out, "    %-20s %12lu\n", "lines read", stats.lines);
+    if (stats.exit_offset < 0) {
+        fprintf(out, "    %-20s %12s\n", "early exit", "none");
+    } else {
+        fprintf(out, "    %-20s %12ld\n", "early exit at byte", stats.exit_offset);
+    }
+    fprintf(out, "    %-20s %12lu\n", "key lines compared", stats.key_lines);
+    fprintf(out, "    %-20s %12lu\n", "matches", stats.matches);
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        /* Linux and most BSDs report kilobytes */
+        fprintf(out, "    %-20s %9ld KiB\n", "peak RSS", (long)usage.ru_maxrss);
+    }
+
+    /* Hardware counters of the phases where they are collected */
+    if (stats.counters_error) {
+        fprintf(out, "    %-20s %s\n", "hardware counters", stats.counters_error);
+    } else {
+        fprintf(out, "    %-20s %12s %12s\n", "hardware counters", "scan", "eval");
+        for (i = 0; i < STATS_COUNTER_COUNT; i++) {
+            fprintf(out, "    %-20s %12.0f %12.0f\n", counterNames[i],
+                    stats.counts[STATS_SCAN][i], stats.counts[STATS_EVAL][i]);
+        }
+        fprintf(out, "    %-20s %12.2f %12.2f\n", "instructions/cycle",
+                stats.counts[STATS_SCAN][STATS_INSTRUCTIONS] / (stats.counts[STATS_SCAN][STATS_CYCLES] + 1e-9),
+                stats.counts[STATS_EVAL][STATS_INSTRUCTIONS] / (stats.counts[STATS_EVAL][STATS_CYCLES] + 1e-9));
+    }
+    allocPrint(out, stats.lines);
+}
+
+/* Returns the current time of a clock in seconds (0 if unavailable) */
+static double clockSeconds(clockid_t clock)
+{
+    struct timespec ts;
+
+    if (clock_gettime(clock, &ts) < 0) {
+        return 0;
+    }
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#ifdef __linux__
+
+/* Opens all counters, or none (setting stats.counters_error) */
+static void openCounters(void)
+{
+    static const unsigned long configs[STATS_COUNTER_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+    struct perf_event_attr attr;
+    int i;
+
+    for (i = 0; i < STATS_COUNTER_COUNT; i++) {
+        memset(&attr, 0, sizeof attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof attr;
+        attr.config = configs[i];
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.inherit = 1;        /* include threads created later */
+        attr.exclude_kernel = 1; /* permitted with perf_event_paranoid <= 2 */
+        attr.exclude_hv = 1;
+
+        if ((counterFds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0)) < 0) {
+            stats.counters_error = (errno == EACCES || errno == EPERM)
+                ? "not permitted (see perf_event_paranoid)"
+                : "not available";
+            while (i-- > 0) {
+                close(counterFds[i]);
+            }
+            return;
+        }
+    }
+}
+
+/* Reads all counters, scaled if they were multiplexed; returns 0 on success */
+static int readCounters(double *counts)
+{
+    __u64 buf[3]; /* value, time enabled, time running */
+    int i;
+
+    for (i = 0; i < STATS_COUNTER_COUNT; i++) {
+        if (read(counterFds[i], buf, sizeof buf) != sizeof buf) {
+            return 1;
+        }
+        counts[i] = (buf[2] && buf[2] < buf[1])? (double)buf[0] * buf[1] / buf[2] : (double)buf[0];
+    }
+
+    return 0;
+}
+
+#else /* __linux__ */
+
+static void openCounters(void)
+{
+    stats.counters_error = "not supported on this system";
+}
+
+static int readCounters(double *counts)
+{
+    (void)counts;
+    return 1;
+}
+
+#endif /* __linux__ */
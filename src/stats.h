@@ -0,0 +1,213 @@
+/** @file
+ * Run statistics reported by the --stats option.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+
+/********************************************************
+ *                     CONSTANTS                        *
+ ********************************************************/
+
+/** The phases of a run which are timed separately. */
+enum StatsPhase
+{
+    /** Parsing query strings (@ref parseQueryString). */
+    STATS_PARSE,
+
+    /** Reading and tokenizing the file, excluding @ref STATS_BIND. */
+    STATS_SCAN,
+
+    /** Matching key lines against queries and binding values, but not
+     * reading the values (timed on every key line, see @ref statsSplit). */
+    STATS_BIND,
+
+    /** Evaluating queries (@ref evalQuery). */
+    STATS_EVAL,
+
+    /** Printing results and flushing stdout. */
+    STATS_OUTPUT,
+
+    /** This is not an actual phase, it is the number of phases. */
+    STATS_PHASE_COUNT
+};
+
+/** Hardware events counted in phases started with @ref statsStartCounted. */
+enum StatsCounter
+{
+    /** CPU cycles. */
+    STATS_CYCLES,
+
+    /** Retired instructions. */
+    STATS_INSTRUCTIONS,
+
+    /** Mispredicted branches. */
+    STATS_BRANCH_MISSES,
+
+    /** Last-level cache misses. */
+    STATS_CACHE_MISSES,
+
+    /** This is not an actual counter, it is the number of counters. */
+    STATS_COUNTER_COUNT
+};
+
+
+/********************************************************
+ *                      TYPEDEFS                        *
+ ********************************************************/
+
+/** @cond */
+typedef enum StatsPhase StatsPhase;
+typedef enum StatsCounter StatsCounter;
+typedef struct Stats Stats;
+typedef struct StatsTimer StatsTimer;
+/** @endcond */
+
+
+/********************************************************
+ *                     STRUCTURES                       *
+ ********************************************************/
+
+/** Everything collected for the stats report.
+ *
+ * There is a single global instance, @ref stats. Nothing is
+ * collected unless @ref enabled is set, so the instance must
+ * not be enabled in modes which scan files on several threads
+ * at once (the counters are not synchronized).
+ */
+struct Stats
+{
+    /** If @c false, no statistics are collected. */
+    bool enabled;
+
+    /** Wall-clock time of each phase (in seconds). */
+    double wall[STATS_PHASE_COUNT];
+
+    /** CPU time of each phase (in seconds, all threads). */
+    double cpu[STATS_PHASE_COUNT];
+
+    /** The number of bytes read from the file. */
+    unsigned long bytes;
+
+    /** The number of lines read from the file. */
+    unsigned long lines;
+
+    /** The number of key lines compared against queries. */
+    unsigned long key_lines;
+
+    /** The number of values bound to queries (or wildcard accumulators). */
+    unsigned long matches;
+
+    /** The byte offset at which the scan stopped early,
+     * or -1 if the whole file was read. */
+    long exit_offset;
+
+    /** Hardware event counts of each phase (user space only,
+     * all threads), indexed by @ref StatsCounter. */
+    double counts[STATS_PHASE_COUNT][STATS_COUNTER_COUNT];
+
+    /** The reason why hardware events are not counted,
+     * or @c NULL if they are. */
+    const char *counters_error;
+};
+
+/** A started measurement of a phase. */
+struct StatsTimer
+{
+    /** Wall-clock time at the start. */
+    double wall;
+
+    /** CPU time at the start. */
+    double cpu;
+
+    /** Hardware event counts at the start. */
+    double counts[STATS_COUNTER_COUNT];
+
+    /** If @c true, @ref counts are valid. */
+    bool counted;
+
+    /** Wall-clock time of the last @ref statsSplit (or the start). */
+    double lap;
+
+    /** Wall-clock time split off to each phase so far. */
+    double laps[STATS_PHASE_COUNT];
+
+    /** If @c true, @ref statsSplit was called. */
+    bool split;
+};
+
+
+/********************************************************
+ *                 GLOBAL VARIABLES                     *
+ ********************************************************/
+
+/** The statistics of the current run. */
+extern Stats stats;
+
+
+/********************************************************
+ *                     FUNCTIONS                        *
+ ********************************************************/
+
+/** Enables collecting statistics and resets all of them.
+ *
+ * On Linux, this also opens hardware event counters with
+ * perf_event_open. If that is not permitted, the reason is stored
+ * in @ref Stats::counters_error and only the counters are missing.
+ */
+void statsEnable(void);
+
+/** Starts measuring time (does nothing if stats are disabled).
+ *
+ * @param[out] timer The timer to start.
+ */
+void statsStart(StatsTimer *timer);
+
+/** Starts measuring time and counting hardware events.
+ *
+ * Reading the counters costs a few system calls, so this is only
+ * meant for regions much longer than that (the scan of a file,
+ * the evaluation of a query). Otherwise like @ref statsStart.
+ *
+ * @param[out] timer The timer to start.
+ */
+void statsStartCounted(StatsTimer *timer);
+
+/** Adds the time elapsed since @ref statsStart to a phase.
+ *
+ * Does nothing if stats are disabled. If the timer was split (see
+ * @ref statsSplit), the rest of the wall-clock time goes to @p phase,
+ * every phase gets the wall-clock time split off to it, and the CPU
+ * time is divided among them in proportion to their wall-clock time
+ * (hardware events all go to @p phase).
+ *
+ * @param[in] timer The timer started with @ref statsStart.
+ * @param[in] phase The phase to add the time to.
+ */
+void statsStop(const StatsTimer *timer, StatsPhase phase);
+
+/** Ends a lap of a running timer and gives its wall-clock time to a phase.
+ *
+ * The next lap starts right away, so the laps of a timer cover all of
+ * its time, and phases which alternate quickly (such as scanning and
+ * binding, once per key line) are each measured on their own. Only the
+ * monotonic clock is read, which is cheap enough to do on every line.
+ * Does nothing if stats are disabled.
+ *
+ * @param[inout] timer The running timer.
+ * @param[in] phase The phase the lap belongs to.
+ */
+void statsSplit(StatsTimer *timer, StatsPhase phase);
+
+/** Prints the stats report.
+ *
+ * @param[inout] out The stream to print to.
+ */
+void statsPrint(FILE *out);
+
+#endif /* STATS_H */
@@ -0,0 +1,168 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+bool tracing;
+
+static FILE *file;
+static bool first;          /* true until the first event is written */
+static int tids[TRACE_MAX_THREADS]; /* pointed to by tidkey */
+static int nthreads;        /* the number of tracks so far */
+static double start;        /* the time of traceOpen, in microseconds */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t tidkey;
+
+static int threadId(void);
+static void writeEvent(char phase, const char *name, const char *detail);
+static void writeString(const char *str);
+static double now(void);
+
+int traceOpen(const char *path)
+{
+    if (!(file = fopen(path, "w"))) {
+        info("%s: failed to open trace file", path);
+        return 5;
+    }
+    if (pthread_key_create(&tidkey, NULL)) {
+        info("memory error");
+        fclose(file);
+        return 1;
+    }
+    first = true;
+    nthreads = 0;
+    start = now();
+    tracing = true;
+
+    fputs("[\n", file);
+    traceThreadName("main");
+
+    return 0;
+}
+
+int traceClose(void)
+{
+    int err;
+
+    if (!tracing) {
+        return 0;
+    }
+    tracing = false;
+
+    fputs("\n]\n", file);
+    err = ferror(file);
+    if (fclose(file) || err) {
+        info("failed to write trace file");
+        return 5;
+    }
+    pthread_key_delete(tidkey);
+
+    return 0;
+}
+
+void traceThreadName(const char *name)
+{
+    if (!tracing) {
+        return;
+    }
+    writeEvent('M', "thread_name", name);
+}
+
+void traceBegin(const char *name, const char *fmt, ...)
+{
+    char detail[TRACE_DETAIL_MAX];
+    va_list ap;
+
+    if (!tracing) {
+        return;
+    }
+    if (fmt) {
+        va_start(ap, fmt);
+        vsnprintf(detail, sizeof detail, fmt, ap);
+        va_end(ap);
+    }
+    writeEvent('B', name, fmt? detail : NULL);
+}
+
+void traceEnd(void)
+{
+    if (!tracing) {
+        return;
+    }
+    writeEvent('E', NULL, NULL);
+}
+
+/* Returns the track of the calling thread, assigning one on first use */
+static int threadId(void)
+{
+    int *tid;
+
+    if ((tid = pthread_getspecific(tidkey))) {
+        return *tid;
+    }
+    pthread_mutex_lock(&lock);
+    tid = tids + nthreads;
+    *tid = nthreads + 1;
+    if (nthreads < TRACE_MAX_THREADS - 1) {
+        nthreads++;
+    }
+    pthread_mutex_unlock(&lock);
+    pthread_setspecific(tidkey, tid);
+
+    return *tid;
+}
+
+static void writeEvent(char phase, const char *name, const char *detail)
+{
+    int tid = threadId();
+
+    pthread_mutex_lock(&lock);
+    fprintf(file, "%s{\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%ld,\"tid\":%d",
+            first? "" : ",\n", phase, now() - start, (long)getpid(), tid);
+    if (name) {
+        fputs(",\"name\":", file);
+        writeString(name);
+    }
+    if (detail) {
+        fputs(phase == 'M'? ",\"args\":{\"name\":" : ",\"args\":{\"detail\":", file);
+        writeString(detail);
+        putc('}', file);
+    }
+    putc('}', file);
+    first = false;
+    pthread_mutex_unlock(&lock);
+}
+
+/* Writes a JSON string literal */
+static void writeString(const char *str)
+{
+    putc('"', file);
+    for (; *str; str++) {
+        const unsigned char c = *str; /* shortcut */
+
+        if (c == '"' || c == '\\') {
+            putc('\\', file);
+            putc(c, file);
+        } else if (c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            putc(c, file);
+        }
+    }
+    putc('"', file);
+}
+
+/* Returns the current time in microseconds */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
@@ -0,0 +1,86 @@
+/** @file
+ * Event tracing in the Chrome trace format, for the --trace option.
+ *
+ * The output is a JSON array of begin/end events which can be loaded
+ * into chrome://tracing or https://ui.perfetto.dev. Every thread gets
+ * its own track. Unless tracing was started with @ref traceOpen, all
+ * functions return right away, so instrumentation may stay in place.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+
+
+/********************************************************
+ *                     CONSTANTS                        *
+ ********************************************************/
+
+/** The maximum length of an event's detail string (longer ones are cut). */
+#define TRACE_DETAIL_MAX 256
+
+/** The maximum number of tracks (further threads share the last one). */
+#define TRACE_MAX_THREADS 1024
+
+/** The sequential scan emits one event per this many bytes read. */
+#define TRACE_CHUNK_SIZE (1UL << 20)
+
+
+/********************************************************
+ *                 GLOBAL VARIABLES                     *
+ ********************************************************/
+
+/** @c true while a trace is being written. Check it before
+ * doing any extra work for the sake of an event. */
+extern bool tracing;
+
+
+/********************************************************
+ *                     FUNCTIONS                        *
+ ********************************************************/
+
+/** Starts writing a trace.
+ *
+ * The calling thread becomes the "main" track.
+ *
+ * @param[in] path The file to write to.
+ *
+ * @returns
+ * - 0 on success
+ * - 1 on memory error
+ * - 5 if the file could not be opened
+ */
+int traceOpen(const char *path);
+
+/** Finishes the trace and closes the file.
+ *
+ * All other threads must be done emitting events.
+ *
+ * @returns
+ * - 0 on success (or if no trace was open)
+ * - 5 if the file could not be written
+ */
+int traceClose(void);
+
+/** Names the track of the calling thread.
+ *
+ * @param[in] name The name to show.
+ */
+void traceThreadName(const char *name);
+
+/** Emits the beginning of an event on the calling thread's track.
+ *
+ * Events must be properly nested, every one of them ended
+ * with @ref traceEnd on the same thread.
+ *
+ * @param[in] name The name of the event, which should be a literal.
+ * @param[in] fmt A printf-style format of a detail string shown
+ * with the event, or @c NULL for none.
+ */
+void traceBegin(const char *name, const char *fmt, ...);
+
+/** Emits the end of the innermost event of the calling thread. */
+void traceEnd(void);
+
+#endif /* TRACE_H */
@@ -0,0 +1,668 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "watch.h"
+#include "buffer.h"
+#include "query.h"
+#include "arglist.h"
+#include "aggregate.h"
+#include "probes.h"
+#include "alloc.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+/* A distinct section name found in the watched file */
+typedef struct {
+    char *name;
+    unsigned long hash;    /* content hash from the last refresh */
+    unsigned long newhash; /* content hash being computed */
+    bool known;            /* hash is valid (section existed last time) */
+    bool seen;             /* section exists in the current file contents */
+    bool changed;          /* section content differs from last time */
+    bool rescan;           /* section must be re-read to recompute a wildcard */
+} Section;
+
+/* A contiguous range of lines belonging to a single section */
+typedef struct {
+    size_t section; /* index into sections */
+    size_t beg;     /* offset of the first byte */
+    size_t end;     /* offset one past the last byte */
+} Region;
+
+/* Everything remembered between two refreshes */
+typedef struct {
+    const Query **queries;
+    size_t qcount;
+
+    char *buf;       /* file contents */
+    size_t buflen;
+    size_t bufsize;
+
+    Section *sections;
+    size_t nsections;
+    size_t ssize;
+
+    Region *regions;
+    size_t nregions;
+    size_t rsize;
+
+    bool *dirty;     /* queries which need re-evaluation */
+    bool **collect;  /* wildcard args being re-accumulated, per query */
+    char **prev;     /* last printed result of each query (or NULL) */
+
+    ValStack *vstack;
+} WatchState;
+
+static int readFile(WatchState *st, const char *path);
+static long sectionFind(WatchState *st, const char *name, bool create);
+static int hashRegions(WatchState *st);
+static void unbindChanged(WatchState *st);
+static int bindChanged(WatchState *st);
+static int bindRegion(WatchState *st, const Region *reg, const char *secname);
+static int evaluateDirty(WatchState *st);
+static int refresh(WatchState *st, const char *path);
+static void forgetAll(WatchState *st);
+
+int watchQueries(const char *path, const Query **queries, size_t qcount)
+{
+    WatchState st;
+    const char *base;  /* file name without the directory part */
+    char *dir;         /* directory containing the file */
+    int fd, err;
+    size_t i;
+
+    /* Watching a directory instead of the file itself is necessary
+     * to also catch editors which replace the file by renaming. */
+    if ((base = strrchr(path, '/'))) {
+        size_t dsize = (base == path)? 2 : base - path + 1;
+        if (!(dir = xmalloc(dsize * sizeof *dir))) {
+            info("memory error");
+            return 1;
+        }
+        strncpy(dir, path, dsize - 1);
+        dir[dsize - 1] = '\0';
+        if (base == path) {
+            strcpy(dir, "/");
+        }
+        base++;
+    } else {
+        if (!(dir = xmalloc(2 * sizeof *dir))) {
+            info("memory error");
+            return 1;
+        }
+        strcpy(dir, ".");
+        base = path;
+    }
+
+    if ((fd = inotify_init()) < 0) {
+        info("failed to initialize inotify (%s)", strerror(errno));
+        xfree(dir);
+        return 2;
+    }
+    if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        info("failed to watch directory '%s' (%s)", dir, strerror(errno));
+        close(fd);
+        xfree(dir);
+        return 2;
+    }
+
+    /* Initialize state */
+    memset(&st, 0, sizeof st);
+    err = 0;
+    st.queries = queries;
+    st.qcount  = qcount;
+    if (!(st.dirty = xmalloc(qcount * sizeof *st.dirty))
+            || !(st.prev = xmalloc(qcount * sizeof *st.prev))
+            || !(st.collect = xcalloc(qcount + 1, sizeof *st.collect))
+            || !(st.vstack = valstackCreate())) {
+        info("memory error");
+        xfree(st.dirty);
+        xfree(st.prev);
+        xfree(st.collect);
+        close(fd);
+        xfree(dir);
+        return 1;
+    }
+    for (i = 0; i < qcount; i++) {
+        arglistClear(queries[i]->args);
+        st.dirty[i] = true;
+        st.prev[i] = NULL;
+        if (!(st.collect[i] = xcalloc(queries[i]->set->size + 1, sizeof **st.collect))) {
+            info("memory error");
+            err = 1;
+        }
+    }
+    if (err == 1) {
+        for (i = 0; i < qcount; i++) {
+            xfree(st.collect[i]);
+        }
+        xfree(st.collect);
+        xfree(st.dirty);
+        xfree(st.prev);
+        valstackFree(st.vstack);
+        close(fd);
+        xfree(dir);
+        return 1;
+    }
+
+    /* Evaluate, then re-evaluate after every change */
+    err = refresh(&st, path);
+    while (!err) {
+        union {
+            struct inotify_event ev;
+            char buf[4096];
+        } events;
+        ssize_t n;
+        char *pos;
+        bool modified;
+
+        if ((n = read(fd, events.buf, sizeof events.buf)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            info("failed to read inotify events (%s)", strerror(errno));
+            err = 2;
+            break;
+        }
+
+        modified = false;
+        for (pos = events.buf; pos < events.buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event*)pos;
+            if (ev->len && strcmp(ev->name, base) == 0) {
+                modified = true;
+            }
+            pos += sizeof *ev + ev->len;
+        }
+
+        if (modified) {
+            err = refresh(&st, path);
+        }
+    }
+
+    /* Cleanup */
+    for (i = 0; i < qcount; i++) {
+        xfree(st.prev[i]);
+        xfree(st.collect[i]);
+    }
+    xfree(st.collect);
+    for (i = 0; i < st.nsections; i++) {
+        xfree(st.sections[i].name);
+    }
+    xfree(st.sections);
+    xfree(st.regions);
+    xfree(st.buf);
+    xfree(st.dirty);
+    xfree(st.prev);
+    valstackFree(st.vstack);
+    close(fd);
+    xfree(dir);
+
+    return err;
+}
+
+/* Returns 0 on success, -1 if the file could not be read and 1 on memory error */
+static int readFile(WatchState *st, const char *path)
+{
+    FILE *file;
+    size_t n;
+
+    if (!(file = fopen(path, "r"))) {
+        info("failed to open file");
+        return -1;
+    }
+    PROBE_FILE_OPEN(path);
+
+    if (!st->buf) {
+        st->bufsize = 4096; /* Arbitrary non-zero initial size */
+        if (!(st->buf = xmalloc(st->bufsize * sizeof *st->buf))) {
+            info("memory error");
+            fclose(file);
+            return 1;
+        }
+    }
+
+    /* Always keep one spare byte for a terminating '\0' */
+    st->buflen = 0;
+    while ((n = fread(st->buf + st->buflen, 1, st->bufsize - st->buflen - 1, file)) > 0) {
+        st->buflen += n;
+        if (st->buflen == st->bufsize - 1) {
+            st->bufsize *= 2;
+            if (!(st->buf = xrealloc(st->buf, st->bufsize * sizeof *st->buf))) {
+                info("memory error");
+                fclose(file);
+                return 1;
+            }
+        }
+    }
+    if (ferror(file)) {
+        info("failed to read file");
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+
+    st->buf[st->buflen] = '\0';
+
+    return 0;
+}
+
+/* Returns the index of a section, or -1 (not found) or -2 (memory error) */
+static long sectionFind(WatchState *st, const char *name, bool create)
+{
+    size_t i;
+    Section *new;
+
+    for (i = 0; i < st->nsections; i++) {
+        if (strcmp(st->sections[i].name, name) == 0) {
+            return i;
+        }
+    }
+    if (!create) {
+        return -1;
+    }
+
+    /* Increase capacity, if needed */
+    if (st->nsections == st->ssize) {
+        st->ssize = st->ssize? st->ssize * 2 : 16;
+        if (!(st->sections = xrealloc(st->sections, st->ssize * sizeof *st->sections))) {
+            info("memory error");
+            return -2;
+        }
+    }
+
+    new = st->sections + st->nsections;
+    if (!(new->name = xmalloc((strlen(name) + 1) * sizeof *new->name))) {
+        info("memory error");
+        return -2;
+    }
+    strcpy(new->name, name);
+    new->hash = new->newhash = HASH_INIT;
+    new->known = new->seen = new->changed = new->rescan = false;
+
+    return st->nsections++;
+}
+
+/* Pass-through 1: split the file into regions and hash each section.
+ * Only section header lines are tokenized here.
+ * Returns 0 on success, -1 on error in the file and 1 on memory error */
+static int hashRegions(WatchState *st)
+{
+    size_t pos, beg;
+    long cur;
+    size_t i;
+
+    for (i = 0; i < st->nsections; i++) {
+        st->sections[i].newhash = HASH_INIT;
+        st->sections[i].seen = false;
+    }
+    st->nregions = 0;
+
+    /* Temporary convenience macro */
+#define CLOSE_REGION(END) do { \
+                if (st->nregions == st->rsize) { \
+                    st->rsize = st->rsize? st->rsize * 2 : 16; \
+                    if (!(st->regions = xrealloc(st->regions, st->rsize * sizeof *st->regions))) { \
+                        info("memory error"); \
+                        return 1; \
+                    } \
+                } \
+                st->regions[st->nregions].section = cur; \
+                st->regions[st->nregions].beg = beg; \
+                st->regions[st->nregions].end = (END); \
+                st->nregions++; \
+            } while (0)
+
+    /* The global scope is a section like any other */
+    if ((cur = sectionFind(st, "", true)) < 0) {
+        return 1;
+    }
+    st->sections[cur].seen = true;
+
+    pos = beg = 0;
+    while (pos < st->buflen) {
+        char *line, *eol, *i;
+
+        line = st->buf + pos;
+        if (!(eol = memchr(line, '\n', st->buflen - pos))) {
+            eol = st->buf + st->buflen;
+        }
+
+        /* Section header starts a new region */
+        for (i = line; i < eol && isspace(*i); i++)
+            ;
+        if (i < eol && *i == '[') {
+            IniToken tok;
+            char c = *eol;
+
+            CLOSE_REGION(pos);
+
+            *eol = '\0';
+            tok = iniExtractFromLine(line);
+            *eol = c;
+            if (tok.type != INI_LINE_SECTION) {
+                return (tok.type == INI_LINE_INTERROR)? 1 : -1;
+            }
+            cur = sectionFind(st, tok.content.section, true);
+            xfree(tok.content.section);
+            if (cur < 0) {
+                return 1;
+            }
+            st->sections[cur].seen = true;
+            beg = pos;
+        }
+
+        /* Hash the line, including its newline */
+        st->sections[cur].newhash = hashBytes(st->sections[cur].newhash, line,
+                (eol < st->buf + st->buflen)? eol + 1 - line : eol - line);
+
+        pos = eol - st->buf + 1;
+    }
+    CLOSE_REGION(st->buflen);
+#undef CLOSE_REGION
+
+    /* Compare with hashes from the previous refresh */
+    for (i = 0; i < st->nsections; i++) {
+        Section *const s = st->sections + i; /* shortcut */
+        s->changed = (s->seen != s->known) || (s->seen && s->hash != s->newhash);
+        s->hash  = s->newhash;
+        s->known = s->seen;
+    }
+
+    return 0;
+}
+
+/* Forget all values bound from changed sections. Wildcards can't forget
+ * only some values, so if any matching section changed, all of them are
+ * accumulated again (and unchanged ones are marked for rescan). */
+static void unbindChanged(WatchState *st)
+{
+    size_t i, j, s;
+
+    for (i = 0; i < st->qcount; i++) {
+        const Query *const query = st->queries[i]; /* shortcut */
+
+        for (j = 0; j < query->set->size; j++) {
+            long sec;
+
+            if (query->set->data[j].wildcard) {
+                for (s = 0; s < st->nsections; s++) {
+                    if (st->sections[s].changed
+                            && patternMatches(query->set->data[j].section, st->sections[s].name)) {
+                        break;
+                    }
+                }
+                if (s == st->nsections) {
+                    continue;
+                }
+
+                accumReset(query->args->accs + j);
+                st->collect[i][j] = true;
+                st->dirty[i] = true;
+                for (s = 0; s < st->nsections; s++) {
+                    if (patternMatches(query->set->data[j].section, st->sections[s].name)) {
+                        st->sections[s].rescan = true;
+                    }
+                }
+                continue;
+            }
+
+            sec = sectionFind(st, query->set->data[j].section, false);
+
+            if (sec >= 0 && st->sections[sec].changed) {
+                arglistUnset(query->args, j);
+                st->dirty[i] = true;
+            }
+        }
+    }
+}
+
+/* Pass-through 2: tokenize regions of changed sections and bind values.
+ * Returns 0 on success, -1 on error in the file and 1 on memory error */
+static int bindChanged(WatchState *st)
+{
+    size_t r;
+    int err;
+
+    err = 0;
+    for (r = 0; r < st->nregions && !err; r++) {
+        const Region *const reg = st->regions + r; /* shortcut */
+        const char *const secname = st->sections[reg->section].name; /* shortcut */
+
+        if (st->sections[reg->section].changed || st->sections[reg->section].rescan) {
+            err = bindRegion(st, reg, secname);
+        }
+    }
+
+    /* Wildcards are complete again */
+    for (r = 0; r < st->nsections; r++) {
+        st->sections[r].rescan = false;
+    }
+    for (r = 0; r < st->qcount; r++) {
+        memset(st->collect[r], 0, st->queries[r]->set->size * sizeof **st->collect);
+    }
+
+    return err;
+}
+
+/* Binds values from a single region, returns like bindChanged */
+static int bindRegion(WatchState *st, const Region *reg, const char *secname)
+{
+    size_t pos;
+
+    pos = reg->beg;
+    while (pos < reg->end) {
+        char *line, *eol, c;
+        IniToken tok;
+        size_t i, j;
+
+        line = st->buf + pos;
+        if (!(eol = memchr(line, '\n', reg->end - pos))) {
+            eol = st->buf + reg->end;
+        }
+        pos = eol - st->buf + 1;
+
+        c = *eol;
+        *eol = '\0';
+        tok = iniExtractFromLine(line);
+        *eol = c;
+
+        switch (tok.type) {
+            case INI_LINE_ERROR:
+                return -1;
+            case INI_LINE_INTERROR:
+                STAMP();
+                error("iniExtractFromLine internal error");
+                return 1;
+            case INI_LINE_SECTION:
+                xfree(tok.content.section);
+                break;
+            case INI_LINE_KVPAIR:
+                for (i = 0; i < st->qcount; i++) {
+                    const Query *const query = st->queries[i]; /* shortcut */
+
+                    for (j = 0; j < query->set->size; j++) {
+                        if (query->set->data[j].wildcard) {
+                            if (st->collect[i][j]
+                                    && dataMatches(query->set->data + j, secname, tok.content.kvpair.key)
+                                    && accumAdd(query->args->accs + j, &tok.content.kvpair.value)) {
+                                xfree(tok.content.kvpair.key);
+                                if (tok.content.kvpair.value.type == ARGVAL_TYPE_STRING) {
+                                    xfree(tok.content.kvpair.value.value.s);
+                                }
+                                return 1;
+                            }
+                            continue;
+                        }
+
+                        if (query->args->types[j] == ARGVAL_TYPE_NONE
+                                && strcmp(query->set->data[j].key, tok.content.kvpair.key) == 0
+                                && strcmp(query->set->data[j].section, secname) == 0) {
+
+                            if (arglistSet(query->args, j, &tok.content.kvpair.value)) {
+                                xfree(tok.content.kvpair.key);
+                                if (tok.content.kvpair.value.type == ARGVAL_TYPE_STRING) {
+                                    xfree(tok.content.kvpair.value.value.s);
+                                }
+                                return 1;
+                            }
+                            PROBE_BIND(i + 1, secname, tok.content.kvpair.key);
+                        }
+                    }
+                }
+                xfree(tok.content.kvpair.key);
+                if (tok.content.kvpair.value.type == ARGVAL_TYPE_STRING) {
+                    xfree(tok.content.kvpair.value.value.s);
+                }
+                break;
+            case INI_LINE_BLANK:
+                /* Gracefully skip */
+                break;
+            default:
+                STAMP();
+                error("unmatched IniLineType %d", tok.type);
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Evaluates dirty queries and prints changed results.
+ * Returns 0 on success, 1 on memory error and 5 if the output
+ * could not be written */
+static int evaluateDirty(WatchState *st)
+{
+    size_t i, j;
+
+    for (i = 0; i < st->qcount; i++) {
+        const Query *const query = st->queries[i]; /* shortcut */
+        ArgVal result;
+        char num[ARGVAL_NUMBER_SIZE], *str;
+        bool missing;
+        int err;
+
+        if (!st->dirty[i]) {
+            continue;
+        }
+        st->dirty[i] = false;
+
+        /* Report not found values */
+        missing = false;
+        for (j = 0; j < query->args->size; j++) {
+            const Data *const data = query->set->data + j; /* cache */
+
+            if (query->args->types[j] == ARGVAL_TYPE_NONE && !data->wildcard) {
+                if (!missing) {
+                    info("query %lu: failed to find the following values:", (unsigned long)i + 1);
+                    missing = true;
+                }
+                fprintf(stderr, "->\t%s%s%s\n", data->section, (*data->section)? "." : "", data->key);
+            }
+        }
+        if (missing) {
+            xfree(st->prev[i]);
+            st->prev[i] = NULL;
+            continue;
+        }
+
+        PROBE_EVAL_START(i + 1);
+        err = evalQuery(query, st->vstack, &result);
+        PROBE_EVAL_END(i + 1, err);
+        if (err) {
+            if (err == 1) {
+                return 1;
+            }
+            xfree(st->prev[i]);
+            st->prev[i] = NULL;
+            continue;
+        }
+
+        /* Compare the printed form of the result with the last one */
+        if (ARGVAL_IS_NUMBER(result)) {
+            argValFormatNumber(num, &result);
+            str = num;
+        } else {
+            str = result.value.s;
+        }
+        if (!st->prev[i] || strcmp(st->prev[i], str) != 0) {
+            printf("%lu\t%s\n", (unsigned long)i + 1, str);
+            xfree(st->prev[i]);
+            if (!(st->prev[i] = xmalloc((strlen(str) + 1) * sizeof *st->prev[i]))) {
+                info("memory error");
+                if (result.type == ARGVAL_TYPE_STRING && result.is_temporary) {
+                    xfree(result.value.s);
+                }
+                return 1;
+            }
+            strcpy(st->prev[i], str);
+        }
+        if (result.type == ARGVAL_TYPE_STRING && result.is_temporary) {
+            xfree(result.value.s);
+        }
+    }
+
+    if (fflush(stdout) || ferror(stdout)) {
+        info("failed to write output");
+        return 5;
+    }
+
+    return 0;
+}
+
+/* Drops all remembered state, so that the next refresh starts from scratch */
+static void forgetAll(WatchState *st)
+{
+    size_t i;
+
+    for (i = 0; i < st->nsections; i++) {
+        st->sections[i].known = false;
+    }
+    for (i = 0; i < st->qcount; i++) {
+        arglistClear(st->queries[i]->args);
+        st->dirty[i] = true;
+    }
+}
+
+/* Returns 0 on success (also if the file was invalid), 1 on memory
+ * error and 5 if the output could not be written */
+static int refresh(WatchState *st, const char *path)
+{
+    int err;
+
+    if ((err = readFile(st, path))) {
+        return (err > 0)? 1 : 0;
+    }
+
+    if ((err = hashRegions(st)) == 0) {
+        unbindChanged(st);
+        err = bindChanged(st);
+    }
+    if (err) {
+        forgetAll(st);
+        return (err > 0)? 1 : 0;
+    }
+
+    return evaluateDirty(st);
+}
+
+#else /* __linux__ */
+
+int watchQueries(const char *path, const Query **queries, size_t qcount)
+{
+    (void)path;
+    (void)queries;
+    (void)qcount;
+    info("watching files is not supported on this platform");
+    return 2;
+}
+
+#endif /* __linux__ */
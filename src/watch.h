@@ -0,0 +1,46 @@
+/** @file
+ * Continuous re-evaluation of queries as a file changes.
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "query.h"
+#include <stdlib.h>
+
+
+/********************************************************
+ *                     FUNCTIONS                        *
+ ********************************************************/
+
+/** Runs a list of queries on a file and re-runs them every time it changes.
+ *
+ * The file is first read in full and all queries are evaluated,
+ * then the function blocks, waiting for modifications (inotify).
+ * The state of the queries is kept between modifications, so that
+ * only the necessary work is redone:
+ * - every section of the file is hashed, and only the regions belonging
+ *   to sections whose hash changed are tokenized again,
+ * - only the values from changed sections are re-bound,
+ * - only the queries referencing changed sections are re-evaluated.
+ *
+ * Results are printed as lines in format "N<TAB>result", where N is
+ * the 1-based index of the query. A result is printed only if it
+ * differs from the last printed result of the same query. Errors
+ * found in the file (or missing values) are reported on stderr and
+ * the watch continues.
+ *
+ * @param[in] path Path to the file to watch.
+ * @param[in] queries An ordered list of queries to run.
+ * @param[in] qcount The number of elements in @p queries.
+ *
+ * This function only returns on errors that make watching impossible.
+ *
+ * @returns
+ * - 1 - memory error (malloc/realloc)
+ * - 2 - internal error (or watching is not supported on this platform)
+ * - 5 - failed to write the output
+ */
+int watchQueries(const char *path, const Query **queries, size_t qcount);
+
+#endif /* WATCH_H */